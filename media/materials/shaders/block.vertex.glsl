@@ -23,6 +23,7 @@ uniform vec3 sun_direction;
 uniform vec3 moon_direction;
 uniform vec3 sun_light_color;
 uniform vec3 moon_light_color;
+uniform vec3 chunk_origin;
 
 varying vec3 tangent_sun_direction;
 varying vec3 tangent_camera_direction;
@@ -31,10 +32,36 @@ varying vec3 base_lighting;
 varying vec3 texture_coordinates;
 varying float fog_depth;
 
+// The vertices are packed into bytes; see BlockVertex.
+attribute vec3 vertex_position;
+attribute float vertex_face;
+attribute vec3 vertex_texture_coordinates;
+attribute vec3 vertex_lighting;
+attribute vec3 vertex_sunlighting;
+
+// These are indexed by CardinalRelation.
+const vec3 FACE_NORMALS[6] = vec3[6](
+    vec3(  0.0,  1.0,  0.0 ),
+    vec3(  0.0, -1.0,  0.0 ),
+    vec3(  0.0,  0.0,  1.0 ),
+    vec3(  0.0,  0.0, -1.0 ),
+    vec3(  1.0,  0.0,  0.0 ),
+    vec3( -1.0,  0.0,  0.0 )
+);
+
+const vec3 FACE_TANGENTS[6] = vec3[6](
+    vec3(  0.0,  0.0,  1.0 ),
+    vec3(  0.0,  0.0, -1.0 ),
+    vec3(  1.0,  0.0,  0.0 ),
+    vec3( -1.0,  0.0,  0.0 ),
+    vec3(  0.0,  1.0,  0.0 ),
+    vec3(  0.0, -1.0,  0.0 )
+);
+
 void main()
 {
-    // TODO: Use a *much* less expensive shader for more distant geometry.  The bump/specular mapping
-    //       performed by this shader is pointless once the viewer is a few dozen meters away.
+    // The distant geometry is drawn with a much less expensive shader instead; see the block_far
+    // shaders.  The bump/specular mapping performed by this one is pointless that far away.
 
     // A TBN matrix can be used to transform coordinates from tangent space to object space.  However,
     // we want to do the exact opposite of that -- we want to go from object space to tangent space.
@@ -43,28 +70,32 @@ void main()
     //
     // NOTE: Digbuild actually uses a TNB matrix, because it uses the 'y' coordinate to represent height.
 
-    vec3 tangent = gl_MultiTexCoord0.xyz;
-    vec3 bitangent = cross( gl_Normal, tangent );
-    mat3 tbn_transpose = transpose( mat3( tangent, gl_Normal, bitangent ) );
+    int face = int( vertex_face );
+    vec3 normal = FACE_NORMALS[face];
+    vec3 tangent = FACE_TANGENTS[face];
+    vec4 world_position = vec4( chunk_origin + vertex_position, 1.0 );
+
+    vec3 bitangent = cross( normal, tangent );
+    mat3 tbn_transpose = transpose( mat3( tangent, normal, bitangent ) );
     tangent_sun_direction = normalize( tbn_transpose * sun_direction );
-    tangent_camera_direction = normalize( tbn_transpose * ( camera_position - gl_Vertex.xyz ) );
+    tangent_camera_direction = normalize( tbn_transpose * ( camera_position - world_position.xyz ) );
 
-    vec3 light_level = gl_MultiTexCoord2.rgb;
-    vec3 sunlight_level = gl_MultiTexCoord3.rgb;
+    vec3 light_level = vertex_lighting;
+    vec3 sunlight_level = vertex_sunlighting;
 
     sun_lighting = sunlight_level * sun_light_color;
 
-    float moon_incidence = 0.65 + 0.35 * dot( moon_direction, gl_Normal );
+    float moon_incidence = 0.65 + 0.35 * dot( moon_direction, normal );
     vec3 moon_lighting = moon_light_color * sunlight_level;
     vec3 moon_diffuse = moon_lighting * moon_incidence;
 
     vec3 ambient_light = vec3( 0.06, 0.06, 0.06 ) + 0.50 * sun_lighting + 0.45 * moon_lighting;
     base_lighting = ambient_light + light_level + moon_diffuse;
 
-    texture_coordinates = gl_MultiTexCoord1.stp;
+    texture_coordinates = vertex_texture_coordinates;
     
-    vec4 eye_position = gl_ModelViewMatrix * gl_Vertex;
+    vec4 eye_position = gl_ModelViewMatrix * world_position;
     fog_depth = abs( eye_position.z / eye_position.w );
 
-    gl_Position = ftransform();
+    gl_Position = gl_ModelViewProjectionMatrix * world_position;
 }
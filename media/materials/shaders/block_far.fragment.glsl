@@ -0,0 +1,36 @@
+///////////////////////////////////////////////////////////////////////////
+// Copyright 2011 Evan Mezeske.
+//
+// This file is part of Digbuild.
+// 
+// Digbuild is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.
+// 
+// Digbuild is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with Digbuild.  If not, see <http://www.gnu.org/licenses/>.
+///////////////////////////////////////////////////////////////////////////
+
+#version 130
+#extension GL_EXT_gpu_shader4 : enable
+
+uniform sampler2DArray material_texture_array;
+uniform float fog_distance;
+
+varying vec3 lighting;
+varying vec3 texture_coordinates;
+varying float fog_depth;
+
+void main()
+{
+    vec4 texture_color = texture2DArray( material_texture_array, texture_coordinates );
+
+    // The fog matches block.fragment.glsl, so that the near and far geometry blend together.
+    float fog_factor = clamp( ( fog_distance - fog_depth ) * 0.20, 0.0, 1.0 );
+    gl_FragColor = vec4( texture_color.rgb * lighting, fog_factor * texture_color.a );
+}
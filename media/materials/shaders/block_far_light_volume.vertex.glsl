@@ -0,0 +1,83 @@
+///////////////////////////////////////////////////////////////////////////
+// Copyright 2011 Evan Mezeske.
+//
+// This file is part of Digbuild.
+// 
+// Digbuild is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.
+// 
+// Digbuild is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with Digbuild.  If not, see <http://www.gnu.org/licenses/>.
+///////////////////////////////////////////////////////////////////////////
+
+#version 130
+
+uniform vec3 sun_direction;
+uniform vec3 moon_direction;
+uniform vec3 sun_light_color;
+uniform vec3 moon_light_color;
+uniform vec3 chunk_origin;
+uniform sampler3D light_volume;
+uniform sampler3D sunlight_volume;
+
+varying vec3 lighting;
+varying vec3 texture_coordinates;
+varying float fog_depth;
+
+// The vertices are packed into bytes; see BlockVertex.
+attribute vec3 vertex_position;
+attribute float vertex_face;
+attribute vec3 vertex_texture_coordinates;
+
+// These are indexed by CardinalRelation.
+const vec3 FACE_NORMALS[6] = vec3[6](
+    vec3(  0.0,  1.0,  0.0 ),
+    vec3(  0.0, -1.0,  0.0 ),
+    vec3(  0.0,  0.0,  1.0 ),
+    vec3(  0.0,  0.0, -1.0 ),
+    vec3(  1.0,  0.0,  0.0 ),
+    vec3( -1.0,  0.0,  0.0 )
+);
+
+// See block_light_volume.vertex.glsl.
+vec3 attenuate_light( vec3 level )
+{
+    return step( 0.5 / 255.0, level ) * pow( vec3( 0.75 ), 15.0 * ( vec3( 1.0 ) - level ) );
+}
+
+void main()
+{
+    // This is the distant counterpart of block_light_volume.vertex.glsl.  The bump and specular
+    // mapping are left out, as they make no visible difference this far away, so there is no
+    // need for a TBN matrix.  The sun lights the flat face instead of the bumps on it.
+
+    vec3 normal = FACE_NORMALS[int( vertex_face )];
+    vec4 world_position = vec4( chunk_origin + vertex_position, 1.0 );
+
+    vec3 volume_coordinates = ( gl_TextureMatrix[3] * vec4( world_position.xyz + 0.5 * normal, 1.0 ) ).xyz;
+    vec3 light_level = attenuate_light( textureLod( light_volume, volume_coordinates, 0.0 ).rgb );
+    vec3 sunlight_level = attenuate_light( textureLod( sunlight_volume, volume_coordinates, 0.0 ).rgb );
+
+    vec3 sun_lighting = sunlight_level * sun_light_color;
+    float sun_incidence = clamp( dot( sun_direction, normal ), 0.0, 1.0 );
+
+    float moon_incidence = 0.65 + 0.35 * dot( moon_direction, normal );
+    vec3 moon_lighting = moon_light_color * sunlight_level;
+    vec3 moon_diffuse = moon_lighting * moon_incidence;
+
+    vec3 ambient_light = vec3( 0.06, 0.06, 0.06 ) + 0.50 * sun_lighting + 0.45 * moon_lighting;
+    lighting = ambient_light + light_level + moon_diffuse + 0.50 * sun_incidence * sun_lighting;
+
+    texture_coordinates = vertex_texture_coordinates;
+
+    vec4 eye_position = gl_ModelViewMatrix * world_position;
+    fog_depth = abs( eye_position.z / eye_position.w );
+
+    gl_Position = gl_ModelViewProjectionMatrix * world_position;
+}
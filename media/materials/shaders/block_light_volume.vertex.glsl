@@ -0,0 +1,113 @@
+///////////////////////////////////////////////////////////////////////////
+// Copyright 2011 Evan Mezeske.
+//
+// This file is part of Digbuild.
+// 
+// Digbuild is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.
+// 
+// Digbuild is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with Digbuild.  If not, see <http://www.gnu.org/licenses/>.
+///////////////////////////////////////////////////////////////////////////
+
+#version 130
+
+uniform vec3 camera_position;
+uniform vec3 sun_direction;
+uniform vec3 moon_direction;
+uniform vec3 sun_light_color;
+uniform vec3 moon_light_color;
+uniform vec3 chunk_origin;
+uniform sampler3D light_volume;
+uniform sampler3D sunlight_volume;
+
+varying vec3 tangent_sun_direction;
+varying vec3 tangent_camera_direction;
+varying vec3 sun_lighting;
+varying vec3 base_lighting;
+varying vec3 texture_coordinates;
+varying float fog_depth;
+
+// The vertices are packed into bytes; see BlockVertex.
+attribute vec3 vertex_position;
+attribute float vertex_face;
+attribute vec3 vertex_texture_coordinates;
+
+// These are indexed by CardinalRelation.
+const vec3 FACE_NORMALS[6] = vec3[6](
+    vec3(  0.0,  1.0,  0.0 ),
+    vec3(  0.0, -1.0,  0.0 ),
+    vec3(  0.0,  0.0,  1.0 ),
+    vec3(  0.0,  0.0, -1.0 ),
+    vec3(  1.0,  0.0,  0.0 ),
+    vec3( -1.0,  0.0,  0.0 )
+);
+
+const vec3 FACE_TANGENTS[6] = vec3[6](
+    vec3(  0.0,  0.0,  1.0 ),
+    vec3(  0.0,  0.0, -1.0 ),
+    vec3(  1.0,  0.0,  0.0 ),
+    vec3( -1.0,  0.0,  0.0 ),
+    vec3(  0.0,  1.0,  0.0 ),
+    vec3(  0.0, -1.0,  0.0 )
+);
+
+// This is the same attenuation curve that is applied to the per-vertex lighting, minus the
+// ambient occlusion term.  Opaque Blocks are stored as unlit in the light volumes, so corners
+// surrounded by them are darkened by the interpolation instead.
+vec3 attenuate_light( vec3 level )
+{
+    return step( 0.5 / 255.0, level ) * pow( vec3( 0.75 ), 15.0 * ( vec3( 1.0 ) - level ) );
+}
+
+void main()
+{
+    // The distant geometry is drawn with a much less expensive shader instead; see the block_far
+    // shaders.  The bump/specular mapping performed by this one is pointless that far away.
+
+    // A TBN matrix can be used to transform coordinates from tangent space to object space.  However,
+    // we want to do the exact opposite of that -- we want to go from object space to tangent space.
+    // So we need inverse(TBN).  Luckily, the block faces all have orthonormal TBN matrices, so
+    // inverse(TBN) == transpose(TBN), which can be calulated much more efficiently.
+    //
+    // NOTE: Digbuild actually uses a TNB matrix, because it uses the 'y' coordinate to represent height.
+
+    int face = int( vertex_face );
+    vec3 normal = FACE_NORMALS[face];
+    vec3 tangent = FACE_TANGENTS[face];
+    vec4 world_position = vec4( chunk_origin + vertex_position, 1.0 );
+
+    vec3 bitangent = cross( normal, tangent );
+    mat3 tbn_transpose = transpose( mat3( tangent, normal, bitangent ) );
+    tangent_sun_direction = normalize( tbn_transpose * sun_direction );
+    tangent_camera_direction = normalize( tbn_transpose * ( camera_position - world_position.xyz ) );
+
+    // The light volumes hold the light levels of each Block in and around this Chunk, and the
+    // texture matrix maps world coordinates onto them.  Sampling half a Block out from a corner
+    // of the face interpolates between the four Blocks that touch that corner.
+    vec3 volume_coordinates = ( gl_TextureMatrix[3] * vec4( world_position.xyz + 0.5 * normal, 1.0 ) ).xyz;
+    vec3 light_level = attenuate_light( textureLod( light_volume, volume_coordinates, 0.0 ).rgb );
+    vec3 sunlight_level = attenuate_light( textureLod( sunlight_volume, volume_coordinates, 0.0 ).rgb );
+
+    sun_lighting = sunlight_level * sun_light_color;
+
+    float moon_incidence = 0.65 + 0.35 * dot( moon_direction, normal );
+    vec3 moon_lighting = moon_light_color * sunlight_level;
+    vec3 moon_diffuse = moon_lighting * moon_incidence;
+
+    vec3 ambient_light = vec3( 0.06, 0.06, 0.06 ) + 0.50 * sun_lighting + 0.45 * moon_lighting;
+    base_lighting = ambient_light + light_level + moon_diffuse;
+
+    texture_coordinates = vertex_texture_coordinates;
+    
+    vec4 eye_position = gl_ModelViewMatrix * world_position;
+    fog_depth = abs( eye_position.z / eye_position.w );
+
+    gl_Position = gl_ModelViewProjectionMatrix * world_position;
+}
@@ -0,0 +1,168 @@
+///////////////////////////////////////////////////////////////////////////
+// Copyright 2011 Evan Mezeske.
+//
+// This file is part of Digbuild.
+// 
+// Digbuild is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.
+// 
+// Digbuild is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with Digbuild.  If not, see <http://www.gnu.org/licenses/>.
+///////////////////////////////////////////////////////////////////////////
+
+#include <cassert>
+
+#include "arena_allocator.h"
+
+//////////////////////////////////////////////////////////////////////////////////
+// Function definitions for ArenaAllocator:
+//////////////////////////////////////////////////////////////////////////////////
+
+ArenaAllocator::ArenaAllocator( const unsigned size ) :
+    size_( 0 ),
+    num_allocated_( 0 )
+{
+    grow( size );
+}
+
+bool ArenaAllocator::allocate( const unsigned size, unsigned& offset )
+{
+    assert( size > 0 );
+
+    SizeMap::iterator size_it = free_sizes_.lower_bound( size );
+
+    if ( size_it == free_sizes_.end() )
+    {
+        return false;
+    }
+
+    const unsigned
+        free_offset = size_it->second,
+        free_size = size_it->first;
+
+    erase_free_range( free_ranges_.find( free_offset ) );
+
+    if ( free_size > size )
+    {
+        insert_free_range( free_offset + size, free_size - size );
+    }
+
+    allocated_ranges_.insert( std::make_pair( free_offset, size ) );
+    num_allocated_ += size;
+    offset = free_offset;
+    return true;
+}
+
+void ArenaAllocator::free( const unsigned offset )
+{
+    RangeMap::iterator allocated_it = allocated_ranges_.find( offset );
+    assert( allocated_it != allocated_ranges_.end() );
+
+    const unsigned size = allocated_it->second;
+    allocated_ranges_.erase( allocated_it );
+    num_allocated_ -= size;
+
+    insert_free_range( offset, size );
+}
+
+void ArenaAllocator::grow( const unsigned new_size )
+{
+    assert( new_size >= size_ );
+
+    if ( new_size > size_ )
+    {
+        insert_free_range( size_, new_size - size_ );
+        size_ = new_size;
+    }
+}
+
+void ArenaAllocator::shrink( const unsigned new_size )
+{
+    assert( new_size >= get_used_size() && new_size <= size_ );
+
+    if ( new_size < size_ )
+    {
+        // Everything past the last allocated range is in the one free range at the end.
+        RangeMap::iterator last_it = free_ranges_.end();
+        --last_it;
+        assert( last_it->first + last_it->second == size_ );
+
+        const unsigned last_offset = last_it->first;
+        erase_free_range( last_it );
+
+        if ( last_offset < new_size )
+        {
+            insert_free_range( last_offset, new_size - last_offset );
+        }
+
+        size_ = new_size;
+    }
+}
+
+unsigned ArenaAllocator::get_used_size() const
+{
+    if ( allocated_ranges_.empty() )
+    {
+        return 0;
+    }
+
+    RangeMap::const_reverse_iterator last_it = allocated_ranges_.rbegin();
+    return last_it->first + last_it->second;
+}
+
+void ArenaAllocator::insert_free_range( unsigned offset, unsigned size )
+{
+    RangeMap::iterator next_it = free_ranges_.lower_bound( offset );
+
+    // Since the free ranges never overlap, only the ranges immediately before and after
+    // the new one can be coalesced with it.
+    if ( next_it != free_ranges_.begin() )
+    {
+        RangeMap::iterator previous_it = next_it;
+        --previous_it;
+        assert( previous_it->first + previous_it->second <= offset );
+
+        if ( previous_it->first + previous_it->second == offset )
+        {
+            offset = previous_it->first;
+            size += previous_it->second;
+            erase_free_range( previous_it );
+        }
+    }
+
+    if ( next_it != free_ranges_.end() )
+    {
+        assert( offset + size <= next_it->first );
+
+        if ( offset + size == next_it->first )
+        {
+            size += next_it->second;
+            erase_free_range( next_it );
+        }
+    }
+
+    free_ranges_.insert( std::make_pair( offset, size ) );
+    free_sizes_.insert( std::make_pair( size, offset ) );
+}
+
+void ArenaAllocator::erase_free_range( const RangeMap::iterator range_it )
+{
+    std::pair<SizeMap::iterator, SizeMap::iterator> sizes = free_sizes_.equal_range( range_it->second );
+
+    for ( SizeMap::iterator size_it = sizes.first; size_it != sizes.second; ++size_it )
+    {
+        if ( size_it->second == range_it->first )
+        {
+            free_sizes_.erase( size_it );
+            break;
+        }
+    }
+
+    free_ranges_.erase( range_it );
+}
@@ -0,0 +1,77 @@
+///////////////////////////////////////////////////////////////////////////
+// Copyright 2011 Evan Mezeske.
+//
+// This file is part of Digbuild.
+// 
+// Digbuild is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.
+// 
+// Digbuild is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with Digbuild.  If not, see <http://www.gnu.org/licenses/>.
+///////////////////////////////////////////////////////////////////////////
+
+#ifndef ARENA_ALLOCATOR_H
+#define ARENA_ALLOCATOR_H
+
+#include <map>
+
+// An ArenaAllocator divides an arena of a given size (such as a GPU buffer) into ranges
+// that can be allocated and freed in any order.  It only does the bookkeeping, and never
+// touches the arena itself, so it does not depend on GL.  The free ranges are kept ordered
+// by offset, so that neighboring ones are coalesced as soon as they are freed, and each
+// allocation takes the smallest free range that it fits in, to limit fragmentation.
+struct ArenaAllocator
+{
+    ArenaAllocator( const unsigned size = 0 );
+
+    // Returns true and sets 'offset' to the start of the newly allocated range, if there
+    // is a free range of at least 'size' units.  Otherwise, the arena must be grown first.
+    bool allocate( const unsigned size, unsigned& offset );
+
+    // The 'offset' must be that of a range returned by allocate() that is not yet freed.
+    void free( const unsigned offset );
+
+    // This adds free space to the end of the arena, leaving it 'new_size' units long, which
+    // must not be less than its current size.
+    void grow( const unsigned new_size );
+
+    // This takes the free space at the end of the arena away again, leaving it 'new_size'
+    // units long, which must not be less than get_used_size().
+    void shrink( const unsigned new_size );
+
+    unsigned get_size() const { return size_; }
+    unsigned get_num_allocated() const { return num_allocated_; }
+    unsigned get_num_free_ranges() const { return free_ranges_.size(); }
+
+    // Returns the end of the last allocated range, below which the arena can not shrink.
+    unsigned get_used_size() const;
+
+protected:
+
+    // Both of these map the offsets of ranges to their sizes.
+    typedef std::map<unsigned, unsigned> RangeMap;
+
+    // This maps the sizes of the free ranges to their offsets, for the best fit search.
+    typedef std::multimap<unsigned, unsigned> SizeMap;
+
+    void insert_free_range( unsigned offset, unsigned size );
+    void erase_free_range( const RangeMap::iterator range_it );
+
+    RangeMap
+        free_ranges_,
+        allocated_ranges_;
+
+    SizeMap free_sizes_;
+
+    unsigned
+        size_,
+        num_allocated_;
+};
+
+#endif // ARENA_ALLOCATOR_H
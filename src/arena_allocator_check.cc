@@ -0,0 +1,393 @@
+///////////////////////////////////////////////////////////////////////////
+// Copyright 2011 Evan Mezeske.
+//
+// This file is part of Digbuild.
+// 
+// Digbuild is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.
+// 
+// Digbuild is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with Digbuild.  If not, see <http://www.gnu.org/licenses/>.
+///////////////////////////////////////////////////////////////////////////
+
+
+#include <algorithm>
+#include <limits>
+
+#include <boost/random/uniform_int.hpp>
+#include <boost/random/variate_generator.hpp>
+
+#include "log.h"
+#include "arena_allocator_check.h"
+
+//////////////////////////////////////////////////////////////////////////////////
+// Local definitions:
+//////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+// The random sequences stop growing the arena at this size, so that they keep reusing
+// the free ranges instead.
+const unsigned MAX_RANDOM_ARENA_SIZE = 1 << 12;
+
+const unsigned MAX_RANDOM_ALLOCATION_SIZE = 48;
+
+bool expect( const bool condition, const char* description )
+{
+    if ( !condition )
+    {
+        LOG( "Failed: " << description << "." );
+    }
+
+    return condition;
+}
+
+bool expect_allocation( ArenaAllocator& allocator, const unsigned size, const unsigned expected_offset, const char* description )
+{
+    unsigned offset;
+    return expect( allocator.allocate( size, offset ) && offset == expected_offset, description );
+}
+
+} // anonymous namespace
+
+//////////////////////////////////////////////////////////////////////////////////
+// Function definitions for ArenaAllocatorCheck:
+//////////////////////////////////////////////////////////////////////////////////
+
+ArenaAllocatorCheck::ArenaAllocatorCheck( const uint64_t seed, const unsigned num_operations ) :
+    num_operations_( num_operations ),
+    generator_( seed )
+{
+}
+
+bool ArenaAllocatorCheck::run()
+{
+    const bool
+        coalescing_correct = check_coalescing(),
+        best_fit_correct = check_best_fit(),
+        random_operations_correct = check_random_operations();
+
+    return coalescing_correct && best_fit_correct && random_operations_correct;
+}
+
+bool ArenaAllocatorCheck::check_coalescing()
+{
+    bool correct = true;
+
+    // Each case starts from three neighboring allocations that fill the whole arena, and
+    // frees them in a different order.
+    {
+        ArenaAllocator allocator( 30 );
+        correct &= expect_allocation( allocator, 10, 0, "allocating the first of three ranges" );
+        correct &= expect_allocation( allocator, 10, 10, "allocating the second of three ranges" );
+        correct &= expect_allocation( allocator, 10, 20, "allocating the third of three ranges" );
+        correct &= expect( allocator.get_num_free_ranges() == 0 && allocator.get_num_allocated() == 30, "filling the arena" );
+
+        allocator.free( 0 );
+        allocator.free( 20 );
+        correct &= expect( allocator.get_num_free_ranges() == 2, "freeing two ranges that are not neighbors" );
+
+        allocator.free( 10 );
+        correct &= expect( allocator.get_num_free_ranges() == 1, "coalescing with the free ranges on both sides" );
+        correct &= expect_allocation( allocator, 30, 0, "allocating the whole arena after coalescing" );
+    }
+
+    {
+        ArenaAllocator allocator( 30 );
+        correct &= expect_allocation( allocator, 10, 0, "allocating the first of three ranges" );
+        correct &= expect_allocation( allocator, 10, 10, "allocating the second of three ranges" );
+        correct &= expect_allocation( allocator, 10, 20, "allocating the third of three ranges" );
+
+        allocator.free( 0 );
+        allocator.free( 10 );
+        correct &= expect( allocator.get_num_free_ranges() == 1, "coalescing with the free range before" );
+        correct &= expect_allocation( allocator, 20, 0, "allocating the range coalesced with the one before" );
+    }
+
+    {
+        ArenaAllocator allocator( 30 );
+        correct &= expect_allocation( allocator, 10, 0, "allocating the first of three ranges" );
+        correct &= expect_allocation( allocator, 10, 10, "allocating the second of three ranges" );
+        correct &= expect_allocation( allocator, 10, 20, "allocating the third of three ranges" );
+
+        allocator.free( 20 );
+        allocator.free( 10 );
+        correct &= expect( allocator.get_num_free_ranges() == 1, "coalescing with the free range after" );
+        correct &= expect_allocation( allocator, 20, 10, "allocating the range coalesced with the one after" );
+    }
+
+    {
+        // Growing the arena adds to the free range at its end, if there is one.
+        ArenaAllocator allocator( 30 );
+        correct &= expect_allocation( allocator, 20, 0, "allocating the start of the arena" );
+
+        allocator.grow( 40 );
+        correct &= expect( allocator.get_num_free_ranges() == 1, "coalescing the grown space with the free end" );
+        correct &= expect_allocation( allocator, 20, 20, "allocating the grown space" );
+    }
+
+    {
+        // Shrinking the arena takes space away from the free range at its end.
+        ArenaAllocator allocator( 40 );
+        correct &= expect_allocation( allocator, 10, 0, "allocating the start of the arena" );
+        correct &= expect_allocation( allocator, 10, 10, "allocating the middle of the arena" );
+
+        allocator.free( 0 );
+        correct &= expect( allocator.get_used_size() == 20, "ending the used space after the last allocation" );
+
+        allocator.shrink( 25 );
+        correct &= expect( allocator.get_size() == 25 && allocator.get_num_free_ranges() == 2, "shrinking into the free end" );
+        correct &= expect_allocation( allocator, 5, 20, "allocating what is left of the free end" );
+
+        allocator.free( 20 );
+        allocator.shrink( 20 );
+        correct &= expect( allocator.get_size() == 20 && allocator.get_num_free_ranges() == 1, "shrinking away the whole free end" );
+    }
+
+    LOG( "Coalescing: " << ( correct ? "correct" : "wrong" ) );
+
+    return correct;
+}
+
+bool ArenaAllocatorCheck::check_best_fit()
+{
+    bool correct = true;
+
+    // This leaves free ranges of 10, 20 and 30 units, which are not neighbors, in the
+    // opposite order from their sizes.
+    ArenaAllocator allocator( 100 );
+    correct &= expect_allocation( allocator, 10, 0, "allocating the first range" );
+    correct &= expect_allocation( allocator, 5, 10, "allocating the second range" );
+    correct &= expect_allocation( allocator, 20, 15, "allocating the third range" );
+    correct &= expect_allocation( allocator, 5, 35, "allocating the fourth range" );
+    correct &= expect_allocation( allocator, 30, 40, "allocating the fifth range" );
+
+    allocator.free( 0 );
+    allocator.free( 15 );
+    correct &= expect( allocator.get_num_free_ranges() == 3, "freeing two ranges that are not neighbors" );
+
+    correct &= expect_allocation( allocator, 25, 70, "taking the only free range that fits" );
+    correct &= expect_allocation( allocator, 18, 15, "taking the smallest free range that fits" );
+    correct &= expect_allocation( allocator, 8, 0, "taking the smallest free range that fits again" );
+
+    unsigned offset;
+    correct &= expect( !allocator.allocate( 6, offset ), "refusing an allocation that nothing fits" );
+
+    // The 5 units left at the end are coalesced with the new space.
+    allocator.grow( 120 );
+    correct &= expect_allocation( allocator, 6, 95, "taking the free range at the end after growing" );
+    correct &= expect( allocator.allocate( 2, offset ) && ( offset == 8 || offset == 33 ), "taking either of two free ranges of the best size" );
+
+    LOG( "Best fit: " << ( correct ? "correct" : "wrong" ) );
+
+    return correct;
+}
+
+bool ArenaAllocatorCheck::check_random_operations()
+{
+    boost::variate_generator<boost::rand48&, boost::uniform_int<> >
+        operation_random( generator_, boost::uniform_int<>( 0, 9 ) ),
+        size_random( generator_, boost::uniform_int<>( 1, MAX_RANDOM_ALLOCATION_SIZE ) ),
+        index_random( generator_, boost::uniform_int<>( 0, std::numeric_limits<int>::max() ) );
+
+    ArenaAllocator allocator( MAX_RANDOM_ALLOCATION_SIZE + 16 );
+    UnitV units( allocator.get_size(), false );
+    RangeMap allocated;
+
+    unsigned
+        num_allocations = 0,
+        num_frees = 0,
+        num_grows = 0,
+        num_shrinks = 0,
+        num_errors = 0;
+
+    for ( unsigned i = 0; i < num_operations_ && num_errors == 0; ++i )
+    {
+        const int operation = operation_random();
+
+        // Frees are as likely as allocations, so the arena stays fragmented instead of
+        // filling up or emptying out.
+        if ( operation < 4 && !allocated.empty() )
+        {
+            RangeMap::iterator range_it = allocated.begin();
+            std::advance( range_it, index_random() % allocated.size() );
+
+            allocator.free( range_it->first );
+            std::fill( units.begin() + range_it->first, units.begin() + range_it->first + range_it->second, false );
+            allocated.erase( range_it );
+            ++num_frees;
+        }
+        else if ( operation == 4 )
+        {
+            if ( allocator.get_size() < MAX_RANDOM_ARENA_SIZE )
+            {
+                allocator.grow( allocator.get_size() + size_random() );
+                units.resize( allocator.get_size(), false );
+                ++num_grows;
+            }
+        }
+        else if ( operation == 5 )
+        {
+            // Half of the free space at the end is taken away, as the VertexArena would.
+            const unsigned used_size = allocator.get_used_size();
+            allocator.shrink( used_size + ( allocator.get_size() - used_size ) / 2 );
+            units.resize( allocator.get_size() );
+            ++num_shrinks;
+        }
+        else
+        {
+            const unsigned size = size_random();
+            unsigned
+                best_size = 0,
+                offset = 0;
+
+            const bool fits = find_best_fit( units, size, best_size );
+
+            if ( allocator.allocate( size, offset ) != fits )
+            {
+                LOG( "Failed: the allocation of " << size << " units did not match the free space." );
+                ++num_errors;
+                continue;
+            }
+
+            // When nothing fits, the arena is doubled, as the VertexArena does.  The allocations
+            // are all smaller than the initial arena, so doubling it once always makes room.
+            if ( !fits )
+            {
+                allocator.grow( allocator.get_size() * 2 );
+                units.resize( allocator.get_size(), false );
+                ++num_grows;
+
+                if ( !allocator.allocate( size, offset ) )
+                {
+                    LOG( "Failed: the allocation of " << size << " units did not fit after growing." );
+                    ++num_errors;
+                    continue;
+                }
+
+                find_best_fit( units, size, best_size );
+            }
+
+            // The range must be the start of a free run of exactly the best fitting size.
+            unsigned run_size = 0;
+
+            while ( offset + run_size < units.size() && !units[offset + run_size] )
+            {
+                ++run_size;
+            }
+
+            if ( ( offset > 0 && !units[offset - 1] ) || run_size != best_size )
+            {
+                LOG( "Failed: the allocation of " << size << " units at " << offset << " was not the best fit." );
+                ++num_errors;
+                continue;
+            }
+
+            std::fill( units.begin() + offset, units.begin() + offset + size, true );
+            allocated[offset] = size;
+            ++num_allocations;
+        }
+
+        if ( !check_counts( allocator, units ) )
+        {
+            ++num_errors;
+        }
+    }
+
+    while ( !allocated.empty() && num_errors == 0 )
+    {
+        allocator.free( allocated.begin()->first );
+        std::fill( units.begin() + allocated.begin()->first, units.begin() + allocated.begin()->first + allocated.begin()->second, false );
+        allocated.erase( allocated.begin() );
+
+        if ( !check_counts( allocator, units ) )
+        {
+            ++num_errors;
+        }
+    }
+
+    if ( num_errors == 0 && allocator.get_num_free_ranges() != 1 )
+    {
+        LOG( "Failed: the arena was not coalesced into one free range after freeing everything." );
+        ++num_errors;
+    }
+
+    LOG( "Random operations: " << num_allocations << " allocations, " << num_frees << " frees, "
+         << num_grows << " grows, " << num_shrinks << " shrinks, final size " << allocator.get_size() << ", " << num_errors << " errors" );
+
+    return num_errors == 0;
+}
+
+bool ArenaAllocatorCheck::check_counts( const ArenaAllocator& allocator, const UnitV& units ) const
+{
+    unsigned
+        num_allocated = 0,
+        num_free_ranges = 0,
+        used_size = 0;
+
+    for ( size_t i = 0; i < units.size(); ++i )
+    {
+        if ( units[i] )
+        {
+            ++num_allocated;
+            used_size = i + 1;
+        }
+        else if ( i == 0 || units[i - 1] )
+        {
+            ++num_free_ranges;
+        }
+    }
+
+    if ( allocator.get_size() != units.size() ||
+         allocator.get_num_allocated() != num_allocated ||
+         allocator.get_num_free_ranges() != num_free_ranges ||
+         allocator.get_used_size() != used_size )
+    {
+        LOG( "Failed: the allocator counts " << allocator.get_num_allocated() << " allocated units in "
+             << allocator.get_num_free_ranges() << " free ranges, used up to " << allocator.get_used_size()
+             << ", instead of " << num_allocated << " in " << num_free_ranges << ", used up to " << used_size << "." );
+        return false;
+    }
+
+    return true;
+}
+
+bool ArenaAllocatorCheck::find_best_fit( const UnitV& units, const unsigned size, unsigned& best_size ) const
+{
+    bool found = false;
+    size_t i = 0;
+
+    while ( i < units.size() )
+    {
+        if ( units[i] )
+        {
+            ++i;
+            continue;
+        }
+
+        size_t run_end = i;
+
+        while ( run_end < units.size() && !units[run_end] )
+        {
+            ++run_end;
+        }
+
+        const unsigned run_size = run_end - i;
+
+        if ( run_size >= size && ( !found || run_size < best_size ) )
+        {
+            best_size = run_size;
+            found = true;
+        }
+
+        i = run_end;
+    }
+
+    return found;
+}
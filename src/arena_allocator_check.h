@@ -0,0 +1,68 @@
+///////////////////////////////////////////////////////////////////////////
+// Copyright 2011 Evan Mezeske.
+//
+// This file is part of Digbuild.
+// 
+// Digbuild is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.
+// 
+// Digbuild is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with Digbuild.  If not, see <http://www.gnu.org/licenses/>.
+///////////////////////////////////////////////////////////////////////////
+
+
+#ifndef ARENA_ALLOCATOR_CHECK_H
+#define ARENA_ALLOCATOR_CHECK_H
+
+#include <map>
+#include <vector>
+
+#include <boost/random/linear_congruential.hpp>
+
+#include "arena_allocator.h"
+
+// The ArenaAllocatorCheck is a headless check of the ArenaAllocator.  A few fixed sequences
+// check that freed ranges are coalesced with the free ranges on either side of them, that
+// each allocation takes the smallest free range that it fits in, and that shrinking only
+// takes away free space.  Then long random sequences of allocations, frees, grows and
+// shrinks are checked against a map of which units of the arena are in use: no two
+// allocations may overlap, each must take the start of the best fitting free run, and the
+// allocator's counts must agree with the map after every operation.
+struct ArenaAllocatorCheck
+{
+    ArenaAllocatorCheck( const uint64_t seed, const unsigned num_operations = 20000 );
+
+    // Returns true if the ArenaAllocator behaved as expected throughout.
+    bool run();
+
+protected:
+
+    // This holds, for each unit of the arena, whether it is allocated.
+    typedef std::vector<bool> UnitV;
+
+    // This maps the offsets of the allocated ranges to their sizes.
+    typedef std::map<unsigned, unsigned> RangeMap;
+
+    bool check_coalescing();
+    bool check_best_fit();
+    bool check_random_operations();
+
+    // Returns true if the allocator's counts agree with the map of units.
+    bool check_counts( const ArenaAllocator& allocator, const UnitV& units ) const;
+
+    // Finds the smallest free run in the map of units that 'size' units fit in.  Returns
+    // false if there is none.
+    bool find_best_fit( const UnitV& units, const unsigned size, unsigned& best_size ) const;
+
+    unsigned num_operations_;
+
+    boost::rand48 generator_;
+};
+
+#endif // ARENA_ALLOCATOR_CHECK_H
@@ -26,6 +26,7 @@
 #include <vector>
 
 #include "math.h"
+#include "cardinal_relation.h"
 
 enum BlockMaterial
 {
@@ -254,49 +255,66 @@ std::ostream& operator<<( std::ostream& s, const Block& block );
 
 typedef std::vector<Block*> BlockV;
 
-struct BlockFace
+// The Chunk geometry is meshed directly into BlockVertices, which the renderer uploads
+// as they are.  They are packed into 16 bytes: positions are relative to the origin of
+// their Chunk, and their normals and tangents are determined by which way their faces
+// point.  Each face is a quad of four consecutive vertices.
+struct BlockVertex
 {
-    enum { NUM_VERTICES = 4 };
+    enum { VERTICES_PER_FACE = 4 };
 
-    struct Vertex
-    {
-        Vertex()
-        {
-        }
+    // The vertex lighting is quantized into the range [0, MAX_LIGHTING].
+    enum { MAX_LIGHTING = 0xff };
 
-        Vertex( const Vector3f& position, const Vector3f& lighting, Vector3f& sunlighting ) :
-            position_( position ),
-            lighting_( lighting ),
-            sunlighting_( sunlighting )
-        {
-        }
-
-        Vector3f position_;
-        Vector3f lighting_;
-        Vector3f sunlighting_;
-    };
-
-    BlockFace()
+    BlockVertex()
     {
     }
 
-    BlockFace( const Vector3f& normal, const Vector3f& tangent, const BlockMaterial material ) :
-        normal_( normal ),
-        tangent_( tangent ),
-        material_( material )
+    BlockVertex(
+        const Vector3i& position,
+        const CardinalRelation face,
+        const Vector2i& texcoords,
+        const BlockMaterial material
+    ) :
+        x_( position[0] ), y_( position[1] ), z_( position[2] ),
+        face_( face ),
+        s_( texcoords[0] ), t_( texcoords[1] ), p_( material ),
+        padding0_( 0 ),
+        lr_( 0 ), lg_( 0 ), lb_( 0 ),
+        padding1_( 0 ),
+        slr_( 0 ), slg_( 0 ), slb_( 0 ),
+        padding2_( 0 )
     {
     }
 
-    Vertex vertices_[NUM_VERTICES];
+    Vector3i get_position() const { return Vector3i( x_, y_, z_ ); }
+    CardinalRelation get_relation() const { return CardinalRelation( face_ ); }
+    BlockMaterial get_material() const { return BlockMaterial( p_ ); }
+    Vector3ub get_lighting() const { return Vector3ub( lr_, lg_, lb_ ); }
+    Vector3ub get_sunlighting() const { return Vector3ub( slr_, slg_, slb_ ); }
+
+    void set_lighting( const Vector3ub& lighting, const Vector3ub& sunlighting )
+    {
+        lr_ = lighting[0];
+        lg_ = lighting[1];
+        lb_ = lighting[2];
+        slr_ = sunlighting[0];
+        slg_ = sunlighting[1];
+        slb_ = sunlighting[2];
+    }
 
-    Vector3f
-        normal_,
-        tangent_;
+    uint8_t x_, y_, z_;       // Position, relative to the Chunk
+    uint8_t face_;            // CardinalRelation of the face
+    uint8_t s_, t_, p_;       // Texture coordinates (the 'p' coordinate is the material)
+    uint8_t padding0_;
+    uint8_t lr_, lg_, lb_;    // Light color
+    uint8_t padding1_;
+    uint8_t slr_, slg_, slb_; // Sunlight color
+    uint8_t padding2_;
 
-    BlockMaterial material_;
-};
+} __attribute__( ( packed ) );
 
-typedef std::vector<BlockFace> BlockFaceV;
+typedef std::vector<BlockVertex> BlockVertexV;
 
 struct BlockDataFlowable
 {
@@ -17,6 +17,7 @@
 ///////////////////////////////////////////////////////////////////////////
 
 #include <queue>
+#include <algorithm>
 
 #include <boost/foreach.hpp>
 
@@ -30,29 +31,74 @@
 
 namespace {
 
-Scalar get_lighting_attenuation( const Scalar power )
+// The lighting for a vertex is an average of the light levels of the blocks that
+// contribute to it, attenuated by the amount of ambient occlusion.  Since all of the
+// inputs are small integers, every possible result is computed ahead of time and
+// stored in this table.  The table is filled in during static initialization, before
+// any worker threads exist, so it can be read concurrently without locking.
+struct VertexLightingTable
 {
-    const int MAX_POWER = 32;
-    const int GRANULARITY = 10;
-
-    static Scalar lighting_attenuation_table[MAX_POWER * GRANULARITY + 1];
-    static bool initialized = false;
-
-    if ( !initialized )
+    enum
     {
-        for ( int i = 0; i <= MAX_POWER * GRANULARITY; ++i )
+        MAX_CONTRIBUTORS = 4,
+        MAX_LEVEL_SUM = MAX_CONTRIBUTORS * Block::MAX_LIGHT_COMPONENT_LEVEL,
+        MIN_AMBIENT_OCCLUSION_POWER = -1,
+        MAX_AMBIENT_OCCLUSION_POWER = 3,
+        NUM_AMBIENT_OCCLUSION_POWERS = MAX_AMBIENT_OCCLUSION_POWER - MIN_AMBIENT_OCCLUSION_POWER + 1,
+        NUM_QUANTIZED_LEVELS = 32
+    };
+
+    VertexLightingTable()
+    {
+        const int MAX_POWER = 32;
+        const int GRANULARITY = 10;
+
+        for ( int power = MIN_AMBIENT_OCCLUSION_POWER; power <= MAX_AMBIENT_OCCLUSION_POWER; ++power )
         {
-            lighting_attenuation_table[i] = gmtl::Math::pow( 0.75f, Scalar( i ) / Scalar( GRANULARITY ) );
+            const int power_base = Block::MAX_LIGHT_COMPONENT_LEVEL + 2 * power;
+
+            for ( int contributors = 1; contributors <= MAX_CONTRIBUTORS; ++contributors )
+            {
+                for ( int level_sum = 0; level_sum <= MAX_LEVEL_SUM; ++level_sum )
+                {
+                    uint8_t& entry = table_[power - MIN_AMBIENT_OCCLUSION_POWER][contributors - 1][level_sum];
+                    const Scalar average = Scalar( level_sum ) / Scalar( contributors );
+
+                    // The lighting is left at zero if there is no light at all.
+                    if ( average > gmtl::GMTL_EPSILON )
+                    {
+                        int index = int( roundf( ( power_base - average ) * Scalar( GRANULARITY ) ) );
+                        index = std::max( index, 0 );
+                        index = std::min( index, MAX_POWER * GRANULARITY );
+
+                        // The result is quantized a little more coarsely than it needs to be, so that more
+                        // of the faces next to each other end up lit the same, and can be merged together.
+                        const Scalar attenuation = gmtl::Math::pow( 0.75f, Scalar( index ) / Scalar( GRANULARITY ) );
+                        const Scalar quantized = roundf( attenuation * Scalar( NUM_QUANTIZED_LEVELS - 1 ) );
+                        entry = uint8_t( roundf( quantized * Scalar( BlockVertex::MAX_LIGHTING ) / Scalar( NUM_QUANTIZED_LEVELS - 1 ) ) );
+                    }
+                    else entry = 0;
+                }
+            }
         }
+    }
+
+    uint8_t lookup( const int level_sum, const int contributors, const int ambient_occlusion_power ) const
+    {
+        assert( level_sum >= 0 && level_sum <= MAX_LEVEL_SUM );
+        assert( contributors >= 1 && contributors <= MAX_CONTRIBUTORS );
+        assert( ambient_occlusion_power >= MIN_AMBIENT_OCCLUSION_POWER &&
+                ambient_occlusion_power <= MAX_AMBIENT_OCCLUSION_POWER );
 
-        initialized = true;
+        return table_[ambient_occlusion_power - MIN_AMBIENT_OCCLUSION_POWER][contributors - 1][level_sum];
     }
 
-    int index = int( roundf( power * Scalar( GRANULARITY ) ) );
-    index = std::max( index, 0 );
-    index = std::min( index, MAX_POWER * GRANULARITY );
-    return lighting_attenuation_table[index];
-}
+private:
+
+    uint8_t table_[NUM_AMBIENT_OCCLUSION_POWERS][MAX_CONTRIBUTORS][MAX_LEVEL_SUM + 1];
+};
+
+const VertexLightingTable VERTEX_LIGHTING_TABLE;
 
 // This function returns true if the incoming light affected the current light.
 bool mix_light( Vector3i& current, const Vector3i& incoming )
@@ -179,74 +225,312 @@ struct InternalNeighborStrategy
     }
 };
 
-typedef std::pair<const BlockIterator, const Vector3i> FloodFillBlock;
-typedef std::queue<FloodFillBlock> FloodFillQueue;
+// The corners of each face of a Block, in the order in which their vertices are
+// stored.  Each corner is lit by the Block in front of the face, the Blocks next to
+// that one in the directions 'a' and 'b', and the Block diagonally between those two.
+struct FaceCorner
+{
+    int position_[3];
+    int neighbor_a_[3];
+    int neighbor_b_[3];
+};
 
-// The 'queue' and 'blocks_visited' parameters here could be local variables
-// (with the queue seed passed in instead).  The reason they are parameters is
-// so that if flood_fill_light() is called many times, they will not have to be
-// allocated repeatedly.  This gives a significant (and measured) performance gain.
-template <typename LightStrategy, typename NeighborStrategy>
-void flood_fill_light( const bool skip_source_block, FloodFillQueue& queue, BlockV& blocks_visited )
+const FaceCorner FACE_CORNERS[NUM_CARDINAL_RELATIONS][BlockVertex::VERTICES_PER_FACE] =
+{
+    { // CARDINAL_RELATION_ABOVE
+        { { 0, 1, 0 }, { -1, 0, 0 }, { 0, 0, -1 } },
+        { { 1, 1, 0 }, {  1, 0, 0 }, { 0, 0, -1 } },
+        { { 1, 1, 1 }, {  1, 0, 0 }, { 0, 0,  1 } },
+        { { 0, 1, 1 }, { -1, 0, 0 }, { 0, 0,  1 } }
+    },
+    { // CARDINAL_RELATION_BELOW
+        { { 0, 0, 0 }, { -1, 0, 0 }, { 0, 0, -1 } },
+        { { 0, 0, 1 }, { -1, 0, 0 }, { 0, 0,  1 } },
+        { { 1, 0, 1 }, {  1, 0, 0 }, { 0, 0,  1 } },
+        { { 1, 0, 0 }, {  1, 0, 0 }, { 0, 0, -1 } }
+    },
+    { // CARDINAL_RELATION_NORTH
+        { { 1, 0, 1 }, {  1, 0, 0 }, { 0, -1, 0 } },
+        { { 0, 0, 1 }, { -1, 0, 0 }, { 0, -1, 0 } },
+        { { 0, 1, 1 }, { -1, 0, 0 }, { 0,  1, 0 } },
+        { { 1, 1, 1 }, {  1, 0, 0 }, { 0,  1, 0 } }
+    },
+    { // CARDINAL_RELATION_SOUTH
+        { { 0, 0, 0 }, { -1, 0, 0 }, { 0, -1, 0 } },
+        { { 1, 0, 0 }, {  1, 0, 0 }, { 0, -1, 0 } },
+        { { 1, 1, 0 }, {  1, 0, 0 }, { 0,  1, 0 } },
+        { { 0, 1, 0 }, { -1, 0, 0 }, { 0,  1, 0 } }
+    },
+    { // CARDINAL_RELATION_EAST
+        { { 1, 0, 0 }, { 0, 0, -1 }, { 0, -1, 0 } },
+        { { 1, 0, 1 }, { 0, 0,  1 }, { 0, -1, 0 } },
+        { { 1, 1, 1 }, { 0, 0,  1 }, { 0,  1, 0 } },
+        { { 1, 1, 0 }, { 0, 0, -1 }, { 0,  1, 0 } }
+    },
+    { // CARDINAL_RELATION_WEST
+        { { 0, 0, 0 }, { 0, 0, -1 }, { 0, -1, 0 } },
+        { { 0, 1, 0 }, { 0, 0, -1 }, { 0,  1, 0 } },
+        { { 0, 1, 1 }, { 0, 0,  1 }, { 0,  1, 0 } },
+        { { 0, 0, 1 }, { 0, 0,  1 }, { 0, -1, 0 } }
+    }
+};
+
+Vector3i make_vector( const int v[3] )
+{
+    return Vector3i( v[0], v[1], v[2] );
+}
+
+// Returns the axis along which a face's edge from its first corner to 'corner' runs.
+int get_edge_axis( const CardinalRelation relation, const int corner )
+{
+    for ( int i = 0; i < Vector3i::Size; ++i )
+    {
+        if ( FACE_CORNERS[relation][corner].position_[i] != FACE_CORNERS[relation][0].position_[i] )
+        {
+            return i;
+        }
+    }
+
+    throw std::runtime_error( "Invalid face corner." );
+}
+
+// Returns a step of one Block along the axis of a face's edge.  Faces are always merged
+// towards the positive end of the axis, whichever way the edge itself points.
+Vector3i get_edge_step( const CardinalRelation relation, const int corner )
+{
+    Vector3i step( 0, 0, 0 );
+    step[get_edge_axis( relation, corner )] = 1;
+    return step;
+}
+
+// Returns the position of a face's corner relative to the Block that the face starts from.
+// A face that covers more than one Block is stretched along its first and last edges.
+Vector3i get_corner_position( const CardinalRelation relation, const int corner, const Vector2i& extent )
+{
+    Vector3i position = make_vector( FACE_CORNERS[relation][corner].position_ );
+    position[get_edge_axis( relation, 1 )] *= extent[0];
+    position[get_edge_axis( relation, BlockVertex::VERTICES_PER_FACE - 1 )] *= extent[1];
+    return position;
+}
+
+// Recovers the Block that a face starts from out of the position of its first corner, and
+// its extent out of the texture coordinates of its third corner.
+void get_face_blocks( const BlockVertex* face_vertices, Vector2i& extent, Vector3i& block_index )
+{
+    const CardinalRelation relation = face_vertices[0].get_relation();
+    extent = Vector2i( face_vertices[2].s_, face_vertices[2].t_ );
+    block_index = face_vertices[0].get_position() - get_corner_position( relation, 0, extent );
+}
+
+// Returns the first Block of the layer just in front of a cell's face.  The layer is 'scale'
+// Blocks wide along each of the face's edges.
+Vector3i get_lod_front_start( const Vector3i& cell_index, const int scale, const CardinalRelation relation )
+{
+    const int normal_axis = Vector3i::Size - get_edge_axis( relation, 1 ) - get_edge_axis( relation, BlockVertex::VERTICES_PER_FACE - 1 );
+
+    Vector3i front_start = cell_index * scale;
+    front_start[normal_axis] += cardinal_relation_vector( relation )[normal_axis] > 0 ? scale : -1;
+    return front_start;
+}
+
+const uint64_t
+    FNV_OFFSET_BASIS = 14695981039346656037ULL,
+    FNV_PRIME = 1099511628211ULL;
+
+void hash_combine( uint64_t& hash, const uint32_t value )
+{
+    hash = ( hash ^ value ) * FNV_PRIME;
+}
+
+int get_block_offset( const Vector3i& index )
+{
+    return ( index[0] * Chunk::SIZE_Y + index[1] ) * Chunk::SIZE_Z + index[2];
+}
+
+bool cell_in_range( const Vector3i& index, const Vector3i& num_cells )
+{
+    return index[0] >= 0 && index[1] >= 0 && index[2] >= 0 &&
+           index[0] < num_cells[0] && index[1] < num_cells[1] && index[2] < num_cells[2];
+}
+
+int get_cell_offset( const Vector3i& index, const Vector3i& num_cells )
 {
-    bool source_block = true;
+    return ( index[0] * num_cells[1] + index[1] ) * num_cells[2] + index[2];
+}
 
-    while ( !queue.empty() )
+// Returns true if two meshes are made of the same faces in the same order, whether or not
+// their vertices are lit the same.
+bool have_same_faces( const BlockVertexV& a, const BlockVertexV& b )
+{
+    if ( a.size() != b.size() )
     {
-        const FloodFillBlock flood_block = queue.front();
-        Block& block = *flood_block.first.block_;
-        queue.pop();
+        return false;
+    }
 
-        if ( !block.is_visited() )
+    for ( size_t i = 0; i < a.size(); ++i )
+    {
+        if ( a[i].x_ != b[i].x_ || a[i].y_ != b[i].y_ || a[i].z_ != b[i].z_ ||
+             a[i].face_ != b[i].face_ ||
+             a[i].s_ != b[i].s_ || a[i].t_ != b[i].t_ || a[i].p_ != b[i].p_ )
         {
-            blocks_visited.push_back( &block );
-            block.set_visited( true );
-            Vector3i light_level = flood_block.second;
+            return false;
+        }
+    }
 
-            if ( !skip_source_block || !source_block )
-            {
-                filter_light( light_level, block );
+    return true;
+}
 
-                Vector3i block_light_level = LightStrategy::get_light( block );
-                if ( !mix_light( block_light_level, light_level ) )
-                {
-                    continue; // The incoming light had no effect on this block.
-                }
+int get_brightest_component( const Vector3i& light_level )
+{
+    return std::max( light_level[0], std::max( light_level[1], light_level[2] ) );
+}
 
-                LightStrategy::set_light( block, block_light_level );
-            }
-            else source_block = false;
+// A LightQueue holds the Blocks whose light has yet to be spread to their neighbors.  It
+// hands them out brightest first, bucketed by their brightest light component, so that
+// most Blocks are already as bright as they will get by the time their light is spread.
+// A Block is marked as visited while it is queued, and it is never queued twice: when its
+// light increases while it is queued, its new light is simply spread when it is popped.
+struct LightQueue
+{
+    LightQueue() :
+        brightest_( Block::MIN_LIGHT_COMPONENT_LEVEL )
+    {
+    }
+
+    void push( const BlockIterator& block_it, const Vector3i& light_level )
+    {
+        if ( !block_it.block_->is_visited() )
+        {
+            const int brightest = get_brightest_component( light_level );
+            block_it.block_->set_visited( true );
+            buckets_[brightest].push_back( block_it );
+            brightest_ = std::max( brightest_, brightest );
+        }
+    }
 
-            if ( attenuate_light( light_level ) )
+    bool pop( BlockIterator& block_it )
+    {
+        while ( buckets_[brightest_].empty() )
+        {
+            if ( brightest_ == Block::MIN_LIGHT_COMPONENT_LEVEL )
             {
-                continue; // The light has been attenuated down to zero.
+                return false;
             }
 
-            FOREACH_CARDINAL_RELATION( relation )
+            --brightest_;
+        }
+
+        block_it = buckets_[brightest_].back();
+        buckets_[brightest_].pop_back();
+        block_it.block_->set_visited( false );
+        return true;
+    }
+
+private:
+
+    typedef std::vector<BlockIterator> BlockIteratorV;
+
+    BlockIteratorV buckets_[Block::MAX_LIGHT_COMPONENT_LEVEL + 1];
+    int brightest_;
+};
+
+// Returns true if the light of a Block, as it is, would change the light of any of its
+// neighbors.  Most of the sunlight sources are surrounded by Blocks that are already as
+// bright as their light could make them, so most of them are never queued at all.
+template <typename LightStrategy, typename NeighborStrategy>
+bool light_would_spread( const BlockIterator& block_it )
+{
+    Vector3i light_level = LightStrategy::get_light( *block_it.block_ );
+
+    if ( attenuate_light( light_level ) )
+    {
+        return false;
+    }
+
+    FOREACH_CARDINAL_RELATION( relation )
+    {
+        const BlockIterator neighbor = NeighborStrategy::get_block_neighbor( block_it, cardinal_relation_vector( relation ) );
+
+        if ( neighbor.block_ &&
+             neighbor.block_->is_translucent() &&
+             light_would_be_affected( LightStrategy::get_light( *neighbor.block_ ), light_level ) )
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Spreads the light of every queued Block until no Block's light would change any more.
+// A Block ends up with the brightest light that reaches it along any path from any of the
+// queued Blocks, no matter what order they were queued in.
+template <typename LightStrategy, typename NeighborStrategy>
+void spread_light( LightQueue& queue )
+{
+    BlockIterator block_it;
+
+    while ( queue.pop( block_it ) )
+    {
+        Vector3i light_level = LightStrategy::get_light( *block_it.block_ );
+
+        if ( attenuate_light( light_level ) )
+        {
+            continue; // The light has been attenuated down to zero.
+        }
+
+        FOREACH_CARDINAL_RELATION( relation )
+        {
+            const BlockIterator neighbor = NeighborStrategy::get_block_neighbor( block_it, cardinal_relation_vector( relation ) );
+
+            if ( neighbor.block_ && neighbor.block_->is_translucent() )
             {
-                const Vector3i relation_vector = cardinal_relation_vector( relation );
-                const BlockIterator neighbor = NeighborStrategy::get_block_neighbor( flood_block.first, relation_vector );
+                Vector3i neighbor_light_level = LightStrategy::get_light( *neighbor.block_ );
 
-                if ( neighbor.block_ &&
-                     !neighbor.block_->is_visited() &&
-                     neighbor.block_->is_translucent() )
+                if ( light_would_be_affected( neighbor_light_level, light_level ) )
                 {
-                    if ( light_would_be_affected(
-                             LightStrategy::get_light( *neighbor.block_ ), light_level ) )
+                    Vector3i incoming_light_level = light_level;
+                    filter_light( incoming_light_level, *neighbor.block_ );
+
+                    if ( mix_light( neighbor_light_level, incoming_light_level ) )
                     {
-                        queue.push( std::make_pair( neighbor, light_level ) );
+                        LightStrategy::set_light( *neighbor.block_, neighbor_light_level );
+                        queue.push( neighbor, neighbor_light_level );
                     }
                 }
             }
         }
     }
+}
 
-    BOOST_FOREACH( Block* block, blocks_visited )
+// Queues the Blocks on the edges of a Chunk whose light would spread into the Chunks
+// around it.
+template <typename LightStrategy>
+void queue_edge_light( Chunk& chunk, LightQueue& queue )
+{
+    for ( int x = 0; x < Chunk::SIZE_X; ++x )
     {
-        block->set_visited( false );
-    }
+        for ( int y = 0; y < Chunk::SIZE_Y; ++y )
+        {
+            const bool
+                x_interior = x > 0 && x < Chunk::SIZE_X - 1,
+                y_interior = y > 0 && y < Chunk::SIZE_Y - 1;
+
+            const int z_step = x_interior && y_interior ? Chunk::SIZE_Z - 1 : 1;
+
+            for ( int z = 0; z < Chunk::SIZE_Z; z += z_step )
+            {
+                const Vector3i index( x, y, z );
+                Block& block = chunk.get_block( index );
+                BlockIterator block_it( &chunk, &block, index );
 
-    blocks_visited.clear();
+                if ( light_would_spread<LightStrategy, ExternalNeighborStrategy>( block_it ) )
+                {
+                    queue.push( block_it, LightStrategy::get_light( block ) );
+                }
+            }
+        }
+    }
 }
 
 } // anonymous namespace
@@ -262,12 +546,54 @@ const int
 
 const Vector3i Chunk::SIZE( SIZE_X, SIZE_Y, SIZE_Z );
 
+const int
+    Chunk::SECTION_SIZE_Y,
+    Chunk::NUM_SECTIONS,
+    Chunk::NUM_LODS;
+
+//////////////////////////////////////////////////////////////////////////////////
+// Static constant definitions for Chunk::FaceConnectivity:
+//////////////////////////////////////////////////////////////////////////////////
+
+const uint8_t Chunk::FaceConnectivity::ALL_FACES;
+
+#ifdef LIGHT_VOLUMES
+
+//////////////////////////////////////////////////////////////////////////////////
+// Static constant definitions for Chunk::LightVolume:
+//////////////////////////////////////////////////////////////////////////////////
+
+const int
+    Chunk::LightVolume::BORDER,
+    Chunk::LightVolume::SIZE_X,
+    Chunk::LightVolume::SIZE_Y,
+    Chunk::LightVolume::SIZE_Z,
+    Chunk::LightVolume::NUM_COMPONENTS,
+    Chunk::LightVolume::MAX_LEVEL;
+
+#endif
+
+//////////////////////////////////////////////////////////////////////////////////
+// Function definitions for Chunk::Section:
+//////////////////////////////////////////////////////////////////////////////////
+
+Chunk::Section::Section() :
+    geometry_version_( 0 ),
+    lighting_version_( 0 ),
+    geometry_hash_( 0 ),
+    lighting_hash_( 0 )
+{
+    std::fill( opaque_face_offsets_, opaque_face_offsets_ + NUM_CARDINAL_RELATIONS + 1, 0 );
+}
+
 //////////////////////////////////////////////////////////////////////////////////
 // Function definitions for Chunk:
 //////////////////////////////////////////////////////////////////////////////////
 
 Chunk::Chunk( const Vector3i& position ) :
-    position_( position )
+    position_( position ),
+    occluder_height_( 0 ),
+    mesh_version_( 0 )
 {
     FOREACH_SURROUNDING( x, y, z )
     {
@@ -472,9 +798,9 @@ void Chunk::reset_lighting()
 
 void Chunk::apply_lighting_to_self()
 {
-    FloodFillQueue sun_flood_queue;
-    FloodFillQueue color_flood_queue;
-    BlockV blocks_visited;
+    // The sunlight and the colored light are spread one after the other, because a Block
+    // is marked as visited while it is queued for either of them.
+    LightQueue queue;
 
     FOREACH_BLOCK( x, y, z )
     {
@@ -482,203 +808,1013 @@ void Chunk::apply_lighting_to_self()
         Block& block = get_block( index );
         BlockIterator block_it( this, &block, index );
 
-        if ( block.is_sunlight_source() )
+        if ( block.is_sunlight_source() &&
+             light_would_spread<SunLightStrategy, InternalNeighborStrategy>( block_it ) )
         {
-            sun_flood_queue.push( std::make_pair( block_it, block.get_sunlight_level() ) );
-            flood_fill_light<SunLightStrategy, InternalNeighborStrategy>( true, sun_flood_queue, blocks_visited );
+            queue.push( block_it, block.get_sunlight_level() );
         }
+    }
+
+    spread_light<SunLightStrategy, InternalNeighborStrategy>( queue );
+
+    FOREACH_BLOCK( x, y, z )
+    {
+        const Vector3i index( x, y, z );
+        Block& block = get_block( index );
 
         if ( block.is_light_source() )
         {
-            const Vector3i light_color =
+            Vector3i light_color =
                 vector_cast<int>(
                     pointwise_round( Vector3f( block.get_color() * Scalar( Block::MAX_LIGHT_COMPONENT_LEVEL ) ) ) );
-            color_flood_queue.push( std::make_pair( block_it, light_color ) );
-            flood_fill_light<ColorLightStrategy, InternalNeighborStrategy>( false, color_flood_queue, blocks_visited );
+            filter_light( light_color, block );
+
+            Vector3i light_level = block.get_light_level();
+            if ( mix_light( light_level, light_color ) )
+            {
+                block.set_light_level( light_level );
+                queue.push( BlockIterator( this, &block, index ), light_level );
+            }
         }
     }
+
+    spread_light<ColorLightStrategy, InternalNeighborStrategy>( queue );
 }
 
 void Chunk::apply_lighting_to_neighbors()
 {
-    FloodFillQueue sun_flood_queue;
-    FloodFillQueue color_flood_queue;
-    BlockV blocks_visited;
+    LightQueue queue;
 
-    FOREACH_BLOCK( x, y, z )
+    queue_edge_light<SunLightStrategy>( *this, queue );
+    spread_light<SunLightStrategy, ExternalNeighborStrategy>( queue );
+
+    queue_edge_light<ColorLightStrategy>( *this, queue );
+    spread_light<ColorLightStrategy, ExternalNeighborStrategy>( queue );
+}
+
+void Chunk::update_geometry()
+{
+    Chunk* neighbor_columns[NUM_CARDINAL_RELATIONS];
+    get_neighbor_columns( neighbor_columns );
+
+    MergeableFaceV mergeable_faces;
+
+    bool
+        remeshed = false,
+        relit = false;
+
+    for ( int i = 0; i < NUM_SECTIONS; ++i )
     {
-        // Throw out any Block that is not on the edge of this Chunk.
-        //
-        // FIXME: This is super ugly and slow.  This _NEEDS_ to be rewritten with a
-        //        loop that only generates the edge coordinates.
-        //
-        if ( x > 0 && x < SIZE_X - 1 &&
-             y > 0 && y < SIZE_Y - 1 &&
-             z > 0 && z < SIZE_Z - 1 )
-        {
-            continue;
-        }
+        Section& section = sections_[i];
 
-        const Vector3i index( x, y, z );
-        Block& block = get_block( index );
-        BlockIterator block_it( this, &block, index );
+        uint64_t
+            geometry_hash,
+            lighting_hash;
+
+        hash_section( i, neighbor_columns, geometry_hash, lighting_hash );
 
-        if ( block.get_sunlight_level() != Block::MIN_LIGHT_LEVEL )
+        if ( section.geometry_version_ == 0 || geometry_hash != section.geometry_hash_ )
         {
-            sun_flood_queue.push( std::make_pair( block_it, block.get_sunlight_level() ) );
-            flood_fill_light<SunLightStrategy, ExternalNeighborStrategy>( true, sun_flood_queue, blocks_visited );
+            mesh_section( i, neighbor_columns, mergeable_faces );
+            remeshed = true;
         }
-
-        if ( block.get_light_level() != Block::MIN_LIGHT_LEVEL )
+        else if ( lighting_hash != section.lighting_hash_ )
         {
-            color_flood_queue.push( std::make_pair( block_it, block.get_light_level() ) );
-            flood_fill_light<ColorLightStrategy, ExternalNeighborStrategy>( true, color_flood_queue, blocks_visited );
+            relight_section( i, mergeable_faces );
+            relit = true;
         }
+
+        section.geometry_hash_ = geometry_hash;
+        section.lighting_hash_ = lighting_hash;
+    }
+
+    // The occlusion only depends on the materials of the Chunk's own Blocks, which are
+    // covered by the geometry hashes.
+    if ( remeshed )
+    {
+        update_occlusion();
+    }
+
+    // The coarser levels of detail depend on the same Blocks as the Sections do.
+    if ( remeshed || relit )
+    {
+        mesh_lods( neighbor_columns );
     }
 }
 
-void Chunk::update_geometry()
+void Chunk::get_neighbor_columns( Chunk* neighbor_columns[NUM_CARDINAL_RELATIONS] )
 {
-    external_faces_.clear();
-
     Chunk* column = get_column_bottom();
-    Chunk* neighbor_columns[NUM_CARDINAL_RELATIONS];
     FOREACH_CARDINAL_RELATION( relation )
     {
         neighbor_columns[relation] = 
             column->get_neighbor( cardinal_relation_vector( relation ) );
     }
+}
 
-    FOREACH_BLOCK( x, y, z )
+const Block* Chunk::get_nearby_block( const Vector3i& index )
+{
+    if ( block_in_range( index ) )
     {
-        const Vector3i block_index( x, y, z );
-        const Block& block = get_block( block_index );
+        return &get_block( index );
+    }
 
-        if ( block.get_material() != BLOCK_MATERIAL_AIR )
-        {
-            const Vector3f block_position = vector_cast<Scalar>( Vector3i( position_ + block_index ) );
+    Vector3i clamped_index;
 
-            FOREACH_CARDINAL_RELATION( relation )
-            {
-                const Vector3i relation_vector = cardinal_relation_vector( relation );
-                const Block* block_neighbor = get_block_neighbor( block_index, relation_vector ).block_;
+    for ( int i = 0; i < Vector3i::Size; ++i )
+    {
+        clamped_index[i] = std::min( std::max( index[i], 0 ), SIZE[i] - 1 );
+    }
+
+    return get_block_neighbor( clamped_index, index - clamped_index ).block_;
+}
+
+void Chunk::hash_section(
+    const int section,
+    Chunk* const neighbor_columns[NUM_CARDINAL_RELATIONS],
+    uint64_t& geometry_hash,
+    uint64_t& lighting_hash
+)
+{
+    geometry_hash = FNV_OFFSET_BASIS;
+    lighting_hash = FNV_OFFSET_BASIS;
 
-                bool add_face = false;
+    // Faces are not added on the sides of the Chunk where there is no column of Chunks.
+    FOREACH_CARDINAL_RELATION( relation )
+    {
+        hash_combine( geometry_hash, neighbor_columns[relation] != 0 );
+    }
+
+    // Each face depends on the Block it belongs to, the Block in front of it, and the Blocks
+    // beside that one, so the Blocks within one Block of the Section are all that matter.
+    const int
+        y_begin = section * SECTION_SIZE_Y - 1,
+        y_end = ( section + 1 ) * SECTION_SIZE_Y + 1;
+
+    for ( int x = -1; x <= SIZE_X; ++x )
+    {
+        for ( int y = y_begin; y < y_end; ++y )
+        {
+            for ( int z = -1; z <= SIZE_Z; ++z )
+            {
+                const Block* block = get_nearby_block( Vector3i( x, y, z ) );
 
-                if ( block_neighbor )
+                if ( block )
                 {
-                    add_face = ( block_neighbor->is_translucent() &&
-                                 block.get_material() != block_neighbor->get_material() );
+                    const Vector3i
+                        light_level = block->get_light_level(),
+                        sunlight_level = block->get_sunlight_level();
+
+                    hash_combine( geometry_hash, block->get_material() + 1 );
+                    hash_combine( lighting_hash,
+                        ( light_level[0] << 0 ) | ( light_level[1] << 4 ) | ( light_level[2] << 8 ) |
+                        ( sunlight_level[0] << 12 ) | ( sunlight_level[1] << 16 ) | ( sunlight_level[2] << 20 ) );
                 }
                 else
                 {
-                    // Don't add faces on the sides of the chunk in which there is not presently a column
-                    // of chunks.  Also, don't add faces on the bottom of the column, facing downward.
-                    add_face = ( relation == CARDINAL_RELATION_ABOVE ||
-                               ( relation != CARDINAL_RELATION_BELOW && neighbor_columns[relation] ) );
-                }
-
-                if ( add_face )
-                {
-                    add_external_face( block_index, block_position, block, relation, relation_vector );
+                    hash_combine( geometry_hash, 0 );
+                    hash_combine( lighting_hash, 1 << 24 );
                 }
             }
         }
     }
 }
 
-void Chunk::add_external_face( const Vector3i& block_index, const Vector3f& block_position, const Block& block, const CardinalRelation relation, const Vector3i& relation_vector )
+void Chunk::mesh_section( const int section_index, Chunk* const neighbor_columns[NUM_CARDINAL_RELATIONS], MergeableFaceV& mergeable_faces )
 {
-    external_faces_.push_back(
-        BlockFace(
-            vector_cast<Scalar>( relation_vector ),
-            vector_cast<Scalar>( cardinal_relation_vector( cardinal_relation_tangent( relation ) ) ),
-            block.get_material()
-        )
-    );
+    Section& section = sections_[section_index];
 
-    Vector3f
-        average_lighting,
-        average_sunlighting;
+    // Although each vertex specifies its own texture ID, and thus the faces can be drawn in
+    // any order, it makes sense to group them together by texture, under the assumption that
+    // this will be more friendly to the GPU's texture cache.  Each material is meshed into a
+    // separate stream, which means that the order will also stay fixed when only the lighting
+    // is updated.  The opaque streams are flushed after each direction, so that the opaque
+    // faces are grouped by direction first.
+    BlockVertexV material_vertices[NUM_BLOCK_MATERIALS];
 
-    #define V( vertex, x, y, z, nax, nay, naz, nbx, nby, nbz )\
-        {\
-            calculate_vertex_lighting( block_index, relation_vector, Vector3i( nax, nay, naz ), Vector3i( nbx, nby, nbz ), average_lighting, average_sunlighting );\
-            external_faces_.back().vertices_[vertex] =\
-                BlockFace::Vertex( block_position + Vector3f( x, y, z ), average_lighting, average_sunlighting );\
-        }
+    section.opaque_vertices_.clear();
+    section.translucent_vertices_.clear();
 
-    switch ( relation )
+    // The opaque faces are held back here, one direction at a time, so that they can be
+    // merged together once all of them are known.
+    mergeable_faces.resize( SIZE_X * SIZE_Y * SIZE_Z );
+
+    FOREACH_CARDINAL_RELATION( relation )
     {
-        case CARDINAL_RELATION_ABOVE:
-            V( 0, 0, 1, 0, -1, 0, 0, 0, 0, -1 );
-            V( 1, 1, 1, 0,  1, 0, 0, 0, 0, -1 );
-            V( 2, 1, 1, 1,  1, 0, 0, 0, 0,  1 );
-            V( 3, 0, 1, 1, -1, 0, 0, 0, 0,  1 );
-            break;
+        const Vector3i relation_vector = cardinal_relation_vector( relation );
 
-        case CARDINAL_RELATION_BELOW:
-            V( 0, 0, 0, 0, -1, 0, 0, 0, 0, -1 );
-            V( 1, 0, 0, 1, -1, 0, 0, 0, 0,  1 );
-            V( 2, 1, 0, 1,  1, 0, 0, 0, 0,  1 );
-            V( 3, 1, 0, 0,  1, 0, 0, 0, 0, -1 );
-            break;
+        FOREACH_SECTION_BLOCK( section_index, x, y, z )
+        {
+            const Vector3i block_index( x, y, z );
+            const Block& block = get_block( block_index );
 
-        case CARDINAL_RELATION_NORTH:
-            V( 0, 1, 0, 1,  1, 0, 0, 0, -1, 0 );
-            V( 1, 0, 0, 1, -1, 0, 0, 0, -1, 0 );
-            V( 2, 0, 1, 1, -1, 0, 0, 0,  1, 0 );
-            V( 3, 1, 1, 1,  1, 0, 0, 0,  1, 0 );
-            break;
+            if ( block.get_material() == BLOCK_MATERIAL_AIR )
+            {
+                continue;
+            }
 
-        case CARDINAL_RELATION_SOUTH:
-            V( 0, 0, 0, 0, -1, 0, 0, 0, -1, 0 );
-            V( 1, 1, 0, 0,  1, 0, 0, 0, -1, 0 );
-            V( 2, 1, 1, 0,  1, 0, 0, 0,  1, 0 );
-            V( 3, 0, 1, 0, -1, 0, 0, 0,  1, 0 );
-            break;
+            const Block* block_neighbor = get_block_neighbor( block_index, relation_vector ).block_;
 
-        case CARDINAL_RELATION_EAST:
-            V( 0, 1, 0, 0, 0, 0, -1, 0, -1, 0 );
-            V( 1, 1, 0, 1, 0, 0,  1, 0, -1, 0 );
-            V( 2, 1, 1, 1, 0, 0,  1, 0,  1, 0 );
-            V( 3, 1, 1, 0, 0, 0, -1, 0,  1, 0 );
-            break;
+            bool add_face = false;
 
-        case CARDINAL_RELATION_WEST:
-            V( 0, 0, 0, 0, 0, 0, -1, 0, -1, 0 );
-            V( 1, 0, 1, 0, 0, 0, -1, 0,  1, 0 );
-            V( 2, 0, 1, 1, 0, 0,  1, 0,  1, 0 );
-            V( 3, 0, 0, 1, 0, 0,  1, 0, -1, 0 );
-            break;
+            if ( block_neighbor )
+            {
+                add_face = ( block_neighbor->is_translucent() &&
+                             block.get_material() != block_neighbor->get_material() );
+            }
+            else
+            {
+                // Don't add faces on the sides of the chunk in which there is not presently a column
+                // of chunks.  Also, don't add faces on the bottom of the column, facing downward.
+                add_face = ( relation == CARDINAL_RELATION_ABOVE ||
+                           ( relation != CARDINAL_RELATION_BELOW && neighbor_columns[relation] ) );
+            }
 
-        default:
-            throw std::runtime_error( "Invalid cardinal relation." );
-    }
-    #undef V
-}
+            if ( add_face )
+            {
+                MergeableFace face( block.get_material() );
 
-void Chunk::calculate_vertex_lighting(
-    const Vector3i& primary_index,
-    const Vector3i& primary_relation,
-    const Vector3i& neighbor_relation_a,
-    const Vector3i& neighbor_relation_b,
-    Vector3f& vertex_lighting,
-    Vector3f& vertex_sunlighting
-)
-{
-    const int NUM_NEIGHBORS = 4;
-    BlockIterator neighbors[NUM_NEIGHBORS];
-    neighbors[0] = get_block_neighbor( primary_index, primary_relation );
-    neighbors[1] = get_block_neighbor( primary_index, primary_relation + neighbor_relation_a );
-    neighbors[2] = get_block_neighbor( primary_index, primary_relation + neighbor_relation_b );
+                if ( block.is_translucent() )
+                {
+                    // When LIGHT_VOLUMES is defined, the renderer samples the lighting from the LightVolume instead.
+#ifndef LIGHT_VOLUMES
+                    calculate_face_lighting( block_index, relation, face );
+#endif
+                    add_face_vertices( block_index, relation, face, Vector2i( 1, 1 ), material_vertices[face.material_] );
+                }
+                else
+                {
+                    // The lighting of the opaque faces decides which of them can be merged, so it is
+                    // always calculated.  The face is added by merge_faces().
+                    calculate_face_lighting( block_index, relation, face );
+                    mergeable_faces[get_block_offset( block_index )] = face;
+                }
+            }
+        }
 
-    // The 'ab' neighbor cannot contribute light to the vertex if both neighbors 'a' and 'b'
-    // are opaque, because they would fully block any light from 'ab'.
-    bool neighbor_ab_contributes = false;
+        merge_faces( relation, section_index, mergeable_faces, material_vertices );
 
-    if ( !neighbors[1].block_ || neighbors[1].block_->is_translucent() ||
-         !neighbors[2].block_ || neighbors[2].block_->is_translucent() )
+        section.opaque_face_offsets_[relation] = section.opaque_vertices_.size() / BlockVertex::VERTICES_PER_FACE;
+
+        FOREACH_BLOCK_MATERIAL( material )
+        {
+            if ( !get_block_material_attributes( material ).translucent_ )
+            {
+                BlockVertexV& vertices = material_vertices[material];
+                section.opaque_vertices_.insert( section.opaque_vertices_.end(), vertices.begin(), vertices.end() );
+                vertices.clear();
+            }
+        }
+    }
+
+    section.opaque_face_offsets_[NUM_CARDINAL_RELATIONS] = section.opaque_vertices_.size() / BlockVertex::VERTICES_PER_FACE;
+
+    FOREACH_BLOCK_MATERIAL( material )
+    {
+        if ( get_block_material_attributes( material ).translucent_ )
+        {
+            const BlockVertexV& vertices = material_vertices[material];
+            section.translucent_vertices_.insert( section.translucent_vertices_.end(), vertices.begin(), vertices.end() );
+        }
+    }
+
+    // The streams are kept for as long as the Section's geometry stays the same, so any
+    // spare capacity is given back.
+    BlockVertexV( section.opaque_vertices_ ).swap( section.opaque_vertices_ );
+    BlockVertexV( section.translucent_vertices_ ).swap( section.translucent_vertices_ );
+
+    ++section.geometry_version_;
+    ++mesh_version_;
+}
+
+void Chunk::relight_section( const int section_index, MergeableFaceV& mergeable_faces )
+{
+    Section& section = sections_[section_index];
+    FaceIndexV split_faces;
+
+    // The translucent faces are never merged, so they can always be relit in place.
+    update_face_lighting( section.translucent_vertices_, split_faces );
+    assert( split_faces.empty() );
+
+    update_face_lighting( section.opaque_vertices_, split_faces );
+
+    if ( split_faces.empty() )
+    {
+        ++section.lighting_version_;
+    }
+    else
+    {
+        // Splitting the faces changes the number of vertices, so the renderer has to treat
+        // the Section as new geometry, even though most of it did not have to be remeshed.
+        split_opaque_faces( section_index, split_faces, mergeable_faces );
+        ++section.geometry_version_;
+    }
+
+    ++mesh_version_;
+}
+
+void Chunk::mesh_lods( Chunk* const neighbor_columns[NUM_CARDINAL_RELATIONS] )
+{
+    for ( int lod = 1; lod <= NUM_LODS; ++lod )
+    {
+        mesh_lod( lod, neighbor_columns );
+    }
+}
+
+void Chunk::mesh_lod( const int lod, Chunk* const neighbor_columns[NUM_CARDINAL_RELATIONS] )
+{
+    Section& section = lod_sections_[lod - 1];
+
+    const int
+        scale = 1 << lod,
+        cell_volume = scale * scale * scale;
+
+    const Vector3i num_cells( SIZE_X / scale, SIZE_Y / scale, SIZE_Z / scale );
+
+    // Each cell that is at least half opaque is solid, and takes the material of its highest
+    // opaque Block, so that the surface of the terrain keeps its colors from a distance.
+    std::vector<BlockMaterial> cells( num_cells[0] * num_cells[1] * num_cells[2], BLOCK_MATERIAL_AIR );
+
+    for ( int x = 0; x < num_cells[0]; ++x )
+    {
+        for ( int y = 0; y < num_cells[1]; ++y )
+        {
+            for ( int z = 0; z < num_cells[2]; ++z )
+            {
+                BlockMaterial material = BLOCK_MATERIAL_AIR;
+                int num_opaque = 0;
+
+                for ( int block_y = ( y + 1 ) * scale - 1; block_y >= y * scale; --block_y )
+                {
+                    for ( int block_x = x * scale; block_x < ( x + 1 ) * scale; ++block_x )
+                    {
+                        for ( int block_z = z * scale; block_z < ( z + 1 ) * scale; ++block_z )
+                        {
+                            const Block& block = blocks_[block_x][block_y][block_z];
+
+                            if ( !block.is_translucent() )
+                            {
+                                if ( material == BLOCK_MATERIAL_AIR )
+                                {
+                                    material = block.get_material();
+                                }
+
+                                ++num_opaque;
+                            }
+                        }
+                    }
+                }
+
+                if ( 2 * num_opaque >= cell_volume )
+                {
+                    cells[get_cell_offset( Vector3i( x, y, z ), num_cells )] = material;
+                }
+            }
+        }
+    }
+
+    BlockVertexV vertices;
+    unsigned face_offsets[NUM_CARDINAL_RELATIONS + 1];
+
+    FOREACH_CARDINAL_RELATION( relation )
+    {
+        face_offsets[relation] = vertices.size() / BlockVertex::VERTICES_PER_FACE;
+
+        const Vector3i relation_vector = cardinal_relation_vector( relation );
+
+        // The faces on the sides of the Chunk are added for every solid cell, unless all of
+        // the Blocks in front of them are opaque, just as mesh_section() only adds a face in
+        // front of a translucent Block.  The neighboring Chunk may be drawn at a different
+        // level of detail, so its Blocks are looked at instead of its cells, and these faces
+        // close off any gaps between the two meshes.  They follow the same rules as
+        // mesh_section() where there is no neighboring Chunk.
+        const bool add_border_faces =
+            get_neighbor( relation_vector ) ||
+            relation == CARDINAL_RELATION_ABOVE ||
+            ( relation != CARDINAL_RELATION_BELOW && neighbor_columns[relation] );
+
+        // The faces are merged together in runs along their first edges.
+        const int
+            run_axis = get_edge_axis( relation, 1 ),
+            row_axis = get_edge_axis( relation, BlockVertex::VERTICES_PER_FACE - 1 ),
+            normal_axis = Vector3i::Size - run_axis - row_axis;
+
+        Vector3i cell_index;
+
+        for ( cell_index[normal_axis] = 0; cell_index[normal_axis] < num_cells[normal_axis]; ++cell_index[normal_axis] )
+        {
+            for ( cell_index[row_axis] = 0; cell_index[row_axis] < num_cells[row_axis]; ++cell_index[row_axis] )
+            {
+                MergeableFace run;
+                Vector3i run_start;
+                int run_length = 0;
+
+                for ( cell_index[run_axis] = 0; cell_index[run_axis] <= num_cells[run_axis]; ++cell_index[run_axis] )
+                {
+                    MergeableFace face;
+
+                    if ( cell_index[run_axis] < num_cells[run_axis] )
+                    {
+                        const BlockMaterial material = cells[get_cell_offset( cell_index, num_cells )];
+                        const Vector3i neighbor_index = cell_index + relation_vector;
+
+                        if ( material != BLOCK_MATERIAL_AIR &&
+                             ( cell_in_range( neighbor_index, num_cells ) ?
+                                 cells[get_cell_offset( neighbor_index, num_cells )] == BLOCK_MATERIAL_AIR :
+                                 add_border_faces && !is_lod_face_covered( cell_index, scale, relation ) ) )
+                        {
+                            face = MergeableFace( material );
+                            calculate_lod_face_lighting( cell_index, scale, relation, face );
+                        }
+                    }
+
+                    if ( run_length > 0 && run.can_merge_with( face ) )
+                    {
+                        ++run_length;
+                        continue;
+                    }
+
+                    if ( run_length > 0 )
+                    {
+                        add_lod_face_vertices( run_start, scale, relation, run, run_length, vertices );
+                    }
+
+                    run = face;
+                    run_start = cell_index;
+                    run_length = face.present_ ? 1 : 0;
+                }
+            }
+        }
+    }
+
+    face_offsets[NUM_CARDINAL_RELATIONS] = vertices.size() / BlockVertex::VERTICES_PER_FACE;
+
+    // The levels of detail are remeshed whenever any Section is relit, but most of the time
+    // their faces are the same as before, and only their lighting (if anything) differs.
+    // The renderer can then overwrite the lighting of its existing copy in place.
+    if ( !have_same_faces( vertices, section.opaque_vertices_ ) )
+    {
+        std::copy( face_offsets, face_offsets + NUM_CARDINAL_RELATIONS + 1, section.opaque_face_offsets_ );
+        BlockVertexV( vertices ).swap( section.opaque_vertices_ );
+        ++section.geometry_version_;
+    }
+    else if ( !vertices.empty() &&
+              memcmp( &vertices[0], &section.opaque_vertices_[0], vertices.size() * sizeof( BlockVertex ) ) != 0 )
+    {
+        section.opaque_vertices_.swap( vertices );
+        ++section.lighting_version_;
+    }
+}
+
+void Chunk::add_lod_face_vertices(
+    const Vector3i& cell_index,
+    const int scale,
+    const CardinalRelation relation,
+    const MergeableFace& face,
+    const int run_length,
+    BlockVertexV& vertices
+)
+{
+    const Vector2i extent( run_length * scale, scale );
+
+    // As in add_face_vertices(), the texture repeats once per Block.
+    const Vector2i texcoords[BlockVertex::VERTICES_PER_FACE] =
+    {
+        Vector2i( 0, 0 ),
+        Vector2i( extent[0], 0 ),
+        Vector2i( extent[0], extent[1] ),
+        Vector2i( 0, extent[1] )
+    };
+
+    for ( int i = 0; i < BlockVertex::VERTICES_PER_FACE; ++i )
+    {
+        // Unlike a Block's face, a cell's face is one cell deep along the normal, too.
+        Vector3i position = get_corner_position( relation, i, extent );
+
+        for ( int j = 0; j < Vector3i::Size; ++j )
+        {
+            if ( j != get_edge_axis( relation, 1 ) && j != get_edge_axis( relation, BlockVertex::VERTICES_PER_FACE - 1 ) )
+            {
+                position[j] *= scale;
+            }
+        }
+
+        vertices.push_back( BlockVertex( cell_index * scale + position, relation, texcoords[i], face.material_ ) );
+        vertices.back().set_lighting( face.lighting_[i], face.sunlighting_[i] );
+    }
+}
+
+void Chunk::calculate_lod_face_lighting( const Vector3i& cell_index, const int scale, const CardinalRelation relation, MergeableFace& face )
+{
+    const int
+        run_axis = get_edge_axis( relation, 1 ),
+        row_axis = get_edge_axis( relation, BlockVertex::VERTICES_PER_FACE - 1 );
+
+    const Vector3i front_start = get_lod_front_start( cell_index, scale, relation );
+
+    // The whole face is lit evenly, by the brightest of the Blocks in front of it that light
+    // could pass through.  Nonexistent Blocks are treated as in calculate_vertex_lighting().
+    Vector3i
+        light_level = Block::MIN_LIGHT_LEVEL,
+        sunlight_level = Block::MIN_LIGHT_LEVEL;
+
+    for ( int a = 0; a < scale; ++a )
+    {
+        for ( int b = 0; b < scale; ++b )
+        {
+            Vector3i index = front_start;
+            index[run_axis] += a;
+            index[row_axis] += b;
+
+            const Block* block = get_nearby_block( index );
+
+            if ( !block )
+            {
+                sunlight_level = Block::MAX_LIGHT_LEVEL;
+            }
+            else if ( block->is_translucent() )
+            {
+                const Vector3i
+                    block_light_level = block->get_light_level(),
+                    block_sunlight_level = block->get_sunlight_level();
+
+                for ( int i = 0; i < Vector3i::Size; ++i )
+                {
+                    light_level[i] = std::max( light_level[i], block_light_level[i] );
+                    sunlight_level[i] = std::max( sunlight_level[i], block_sunlight_level[i] );
+                }
+            }
+        }
+    }
+
+    for ( int i = 0; i < BlockVertex::VERTICES_PER_FACE; ++i )
+    {
+        for ( int j = 0; j < Vector3i::Size; ++j )
+        {
+            face.lighting_[i][j] = VERTEX_LIGHTING_TABLE.lookup( light_level[j], 1, VertexLightingTable::MIN_AMBIENT_OCCLUSION_POWER );
+            face.sunlighting_[i][j] = VERTEX_LIGHTING_TABLE.lookup( sunlight_level[j], 1, VertexLightingTable::MIN_AMBIENT_OCCLUSION_POWER );
+        }
+    }
+}
+
+bool Chunk::is_lod_face_covered( const Vector3i& cell_index, const int scale, const CardinalRelation relation )
+{
+    const int
+        run_axis = get_edge_axis( relation, 1 ),
+        row_axis = get_edge_axis( relation, BlockVertex::VERTICES_PER_FACE - 1 );
+
+    const Vector3i front_start = get_lod_front_start( cell_index, scale, relation );
+
+    for ( int a = 0; a < scale; ++a )
+    {
+        for ( int b = 0; b < scale; ++b )
+        {
+            Vector3i index = front_start;
+            index[run_axis] += a;
+            index[row_axis] += b;
+
+            const Block* block = get_nearby_block( index );
+
+            if ( !block || block->is_translucent() )
+            {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+void Chunk::update_occlusion()
+{
+    const FaceConnectivity old_connectivity = face_connectivity_;
+    const int old_occluder_height = occluder_height_;
+
+    face_connectivity_.disconnect_all();
+
+    bool visited[SIZE_X][SIZE_Y][SIZE_Z] = { { { false } } };
+    std::vector<Vector3i> flood_stack;
+
+    // Each connected region of translucent Blocks connects all of the faces that it touches.
+    FOREACH_BLOCK( x, y, z )
+    {
+        if ( visited[x][y][z] || !blocks_[x][y][z].is_translucent() )
+        {
+            continue;
+        }
+
+        uint8_t faces = 0;
+
+        visited[x][y][z] = true;
+        flood_stack.push_back( Vector3i( x, y, z ) );
+
+        while ( !flood_stack.empty() )
+        {
+            const Vector3i index = flood_stack.back();
+            flood_stack.pop_back();
+
+            FOREACH_CARDINAL_RELATION( relation )
+            {
+                const Vector3i neighbor_index = index + cardinal_relation_vector( relation );
+
+                if ( !block_in_range( neighbor_index ) )
+                {
+                    faces |= 1 << relation;
+                }
+                else if ( !visited[neighbor_index[0]][neighbor_index[1]][neighbor_index[2]] &&
+                          get_block( neighbor_index ).is_translucent() )
+                {
+                    visited[neighbor_index[0]][neighbor_index[1]][neighbor_index[2]] = true;
+                    flood_stack.push_back( neighbor_index );
+                }
+            }
+        }
+
+        face_connectivity_.connect( faces );
+    }
+
+    // If no translucent Block touches any face, the whole surface of the Chunk is opaque.
+    // Otherwise, only the completely opaque layers at the bottom are used.
+    bool sealed = true;
+
+    FOREACH_CARDINAL_RELATION( relation )
+    {
+        sealed = sealed && !face_connectivity_.is_connected( relation );
+    }
+
+    if ( sealed )
+    {
+        occluder_height_ = SIZE_Y;
+    }
+    else
+    {
+        for ( occluder_height_ = 0; occluder_height_ < SIZE_Y; ++occluder_height_ )
+        {
+            bool opaque_layer = true;
+
+            for ( int x = 0; x < SIZE_X && opaque_layer; ++x )
+            {
+                for ( int z = 0; z < SIZE_Z && opaque_layer; ++z )
+                {
+                    opaque_layer = !blocks_[x][occluder_height_][z].is_translucent();
+                }
+            }
+
+            if ( !opaque_layer )
+            {
+                break;
+            }
+        }
+    }
+
+    // The renderer only hears about Chunks whose mesh version changed.
+    if ( face_connectivity_ != old_connectivity || occluder_height_ != old_occluder_height )
+    {
+        ++mesh_version_;
+    }
+}
+
+void Chunk::update_face_lighting( BlockVertexV& vertices, FaceIndexV& split_faces )
+{
+    for ( size_t f = 0; f < vertices.size(); f += BlockVertex::VERTICES_PER_FACE )
+    {
+        BlockVertex* face_vertices = &vertices[f];
+        const CardinalRelation relation = face_vertices[0].get_relation();
+        Vector2i extent;
+        Vector3i block_index;
+        get_face_blocks( face_vertices, extent, block_index );
+
+        if ( extent == Vector2i( 1, 1 ) )
+        {
+#ifndef LIGHT_VOLUMES
+            MergeableFace face( face_vertices[0].get_material() );
+            calculate_face_lighting( block_index, relation, face );
+
+            for ( int i = 0; i < BlockVertex::VERTICES_PER_FACE; ++i )
+            {
+                face_vertices[i].set_lighting( face.lighting_[i], face.sunlighting_[i] );
+            }
+#endif
+            continue;
+        }
+
+        // A merged face stays valid for as long as all of the Blocks it covers are still lit
+        // the same as each other, and evenly along each edge that it was stretched over, so
+        // then only its corners need to be relit.  Otherwise it must be split up again.
+        MergeableFace merged_face( face_vertices[0].get_material() );
+        calculate_face_lighting( block_index, relation, merged_face );
+
+        bool split =
+            ( extent[0] > 1 && !merged_face.is_constant_along( 0, 1, 2, 3 ) ) ||
+            ( extent[1] > 1 && !merged_face.is_constant_along( 0, 3, 2, 1 ) );
+
+        const Vector3i
+            step_a = get_edge_step( relation, 1 ),
+            step_b = get_edge_step( relation, BlockVertex::VERTICES_PER_FACE - 1 );
+
+        for ( int i = 0; i < extent[0] && !split; ++i )
+        {
+            for ( int j = 0; j < extent[1] && !split; ++j )
+            {
+                if ( i != 0 || j != 0 )
+                {
+                    MergeableFace block_face( merged_face.material_ );
+                    calculate_face_lighting( block_index + step_a * i + step_b * j, relation, block_face );
+                    split = !merged_face.can_merge_with( block_face );
+                }
+            }
+        }
+
+        if ( split )
+        {
+            split_faces.push_back( f );
+        }
+        else
+        {
+            for ( int i = 0; i < BlockVertex::VERTICES_PER_FACE; ++i )
+            {
+                face_vertices[i].set_lighting( merged_face.lighting_[i], merged_face.sunlighting_[i] );
+            }
+        }
+    }
+}
+
+void Chunk::split_opaque_faces( const int section_index, const FaceIndexV& split_faces, MergeableFaceV& mergeable_faces )
+{
+    Section& section = sections_[section_index];
+
+    BlockVertexV
+        opaque_vertices,
+        material_vertices[NUM_BLOCK_MATERIALS];
+
+    unsigned opaque_face_offsets[NUM_CARDINAL_RELATIONS + 1];
+
+    mergeable_faces.resize( SIZE_X * SIZE_Y * SIZE_Z );
+    opaque_vertices.reserve( section.opaque_vertices_.size() );
+
+    FaceIndexV::const_iterator split_it = split_faces.begin();
+
+    FOREACH_CARDINAL_RELATION( relation )
+    {
+        const size_t
+            relation_begin = section.opaque_face_offsets_[relation] * BlockVertex::VERTICES_PER_FACE,
+            relation_end = section.opaque_face_offsets_[relation + 1] * BlockVertex::VERTICES_PER_FACE;
+
+        bool relation_split = false;
+
+        for ( size_t f = relation_begin; f < relation_end; f += BlockVertex::VERTICES_PER_FACE )
+        {
+            const BlockVertex* face_vertices = &section.opaque_vertices_[f];
+
+            if ( split_it == split_faces.end() || *split_it != f )
+            {
+                BlockVertexV& vertices = material_vertices[face_vertices[0].get_material()];
+                vertices.insert( vertices.end(), face_vertices, face_vertices + BlockVertex::VERTICES_PER_FACE );
+                continue;
+            }
+
+            // The Blocks that the face covered are merged anew, but only with each other.  The
+            // rest of the Section's faces are kept as they are.
+            Vector2i extent;
+            Vector3i block_index;
+            get_face_blocks( face_vertices, extent, block_index );
+
+            const Vector3i
+                step_a = get_edge_step( relation, 1 ),
+                step_b = get_edge_step( relation, BlockVertex::VERTICES_PER_FACE - 1 );
+
+            for ( int i = 0; i < extent[0]; ++i )
+            {
+                for ( int j = 0; j < extent[1]; ++j )
+                {
+                    const Vector3i index = block_index + step_a * i + step_b * j;
+                    MergeableFace face( face_vertices[0].get_material() );
+                    calculate_face_lighting( index, relation, face );
+                    mergeable_faces[get_block_offset( index )] = face;
+                }
+            }
+
+            relation_split = true;
+            ++split_it;
+        }
+
+        if ( relation_split )
+        {
+            merge_faces( relation, section_index, mergeable_faces, material_vertices );
+        }
+
+        opaque_face_offsets[relation] = opaque_vertices.size() / BlockVertex::VERTICES_PER_FACE;
+
+        FOREACH_BLOCK_MATERIAL( material )
+        {
+            if ( !get_block_material_attributes( material ).translucent_ )
+            {
+                BlockVertexV& vertices = material_vertices[material];
+                opaque_vertices.insert( opaque_vertices.end(), vertices.begin(), vertices.end() );
+                vertices.clear();
+            }
+        }
+    }
+
+    assert( split_it == split_faces.end() );
+
+    opaque_face_offsets[NUM_CARDINAL_RELATIONS] = opaque_vertices.size() / BlockVertex::VERTICES_PER_FACE;
+    std::copy( opaque_face_offsets, opaque_face_offsets + NUM_CARDINAL_RELATIONS + 1, section.opaque_face_offsets_ );
+
+    BlockVertexV( opaque_vertices ).swap( section.opaque_vertices_ );
+}
+
+void Chunk::add_face_vertices(
+    const Vector3i& block_index,
+    const CardinalRelation relation,
+    const MergeableFace& face,
+    const Vector2i& extent,
+    BlockVertexV& vertices
+)
+{
+    // The texture coordinates of merged faces run past 1, so that the texture repeats once per Block.
+    const Vector2i texcoords[BlockVertex::VERTICES_PER_FACE] =
+    {
+        Vector2i( 0, 0 ),
+        Vector2i( extent[0], 0 ),
+        Vector2i( extent[0], extent[1] ),
+        Vector2i( 0, extent[1] )
+    };
+
+    for ( int i = 0; i < BlockVertex::VERTICES_PER_FACE; ++i )
+    {
+        vertices.push_back( BlockVertex( block_index + get_corner_position( relation, i, extent ), relation, texcoords[i], face.material_ ) );
+        vertices.back().set_lighting( face.lighting_[i], face.sunlighting_[i] );
+    }
+}
+
+void Chunk::merge_faces(
+    const CardinalRelation relation,
+    const int section,
+    MergeableFaceV& mergeable_faces,
+    BlockVertexV* material_vertices
+)
+{
+    // Faces are not merged across Sections, so that each Section can be remeshed by itself.
+    const Vector3i section_end( SIZE_X, ( section + 1 ) * SECTION_SIZE_Y, SIZE_Z );
+
+    const int
+        axis_a = get_edge_axis( relation, 1 ),
+        axis_b = get_edge_axis( relation, BlockVertex::VERTICES_PER_FACE - 1 );
+
+    const Vector3i
+        step_a = get_edge_step( relation, 1 ),
+        step_b = get_edge_step( relation, BlockVertex::VERTICES_PER_FACE - 1 );
+
+    FOREACH_SECTION_BLOCK( section, x, y, z )
+    {
+        const Vector3i origin( x, y, z );
+        const MergeableFace face = mergeable_faces[get_block_offset( origin )];
+
+        if ( !face.present_ )
+        {
+            continue;
+        }
+
+        // The face is grown as far as it can go along its first edge, and then it is grown
+        // along its last edge one row at a time, for as long as each whole row matches.
+        Vector2i extent( 1, 1 );
+
+        if ( face.is_constant_along( 0, 1, 2, 3 ) )
+        {
+            while ( origin[axis_a] + extent[0] < section_end[axis_a] &&
+                    face.can_merge_with( mergeable_faces[get_block_offset( origin + step_a * extent[0] )] ) )
+            {
+                ++extent[0];
+            }
+        }
+
+        bool row_matches = face.is_constant_along( 0, 3, 2, 1 );
+
+        while ( row_matches && origin[axis_b] + extent[1] < section_end[axis_b] )
+        {
+            for ( int i = 0; i < extent[0] && row_matches; ++i )
+            {
+                row_matches = face.can_merge_with( mergeable_faces[get_block_offset( origin + step_a * i + step_b * extent[1] )] );
+            }
+
+            if ( row_matches )
+            {
+                ++extent[1];
+            }
+        }
+
+        for ( int i = 0; i < extent[0]; ++i )
+        {
+            for ( int j = 0; j < extent[1]; ++j )
+            {
+                mergeable_faces[get_block_offset( origin + step_a * i + step_b * j )] = MergeableFace();
+            }
+        }
+
+        add_face_vertices( origin, relation, face, extent, material_vertices[face.material_] );
+    }
+}
+
+void Chunk::calculate_face_lighting( const Vector3i& block_index, const CardinalRelation relation, MergeableFace& face )
+{
+    const Vector3i relation_vector = cardinal_relation_vector( relation );
+
+    for ( int i = 0; i < BlockVertex::VERTICES_PER_FACE; ++i )
+    {
+        const FaceCorner& corner = FACE_CORNERS[relation][i];
+
+        calculate_vertex_lighting(
+            block_index,
+            relation_vector,
+            make_vector( corner.neighbor_a_ ),
+            make_vector( corner.neighbor_b_ ),
+            face.lighting_[i],
+            face.sunlighting_[i]
+        );
+    }
+}
+
+#ifdef LIGHT_VOLUMES
+void Chunk::get_light_volume( LightVolume& volume ) const
+{
+    for ( int x = 0; x < LightVolume::SIZE_X; ++x )
+    {
+        for ( int y = 0; y < LightVolume::SIZE_Y; ++y )
+        {
+            for ( int z = 0; z < LightVolume::SIZE_Z; ++z )
+            {
+                // The Blocks in the border are looked up in the neighboring Chunks.
+                Vector3i index = Vector3i( x, y, z ) - Vector3i( LightVolume::BORDER, LightVolume::BORDER, LightVolume::BORDER );
+                Vector3i relation( 0, 0, 0 );
+
+                for ( int i = 0; i < Vector3i::Size; ++i )
+                {
+                    if ( index[i] < 0 )
+                    {
+                        relation[i] = -1;
+                        index[i] += SIZE[i];
+                    }
+                    else if ( index[i] >= SIZE[i] )
+                    {
+                        relation[i] = 1;
+                        index[i] -= SIZE[i];
+                    }
+                }
+
+                const Chunk* chunk = neighbors_[relation[0] + 1][relation[1] + 1][relation[2] + 1];
+                const Block* block = chunk ? &chunk->blocks_[index[0]][index[1]][index[2]] : 0;
+
+                // This matches the treatment of the Blocks in calculate_vertex_lighting(): nonexistent
+                // Blocks are treated as open to the sky, and opaque Blocks do not contribute any light.
+                Vector3i
+                    light_level = Block::MIN_LIGHT_LEVEL,
+                    sunlight_level = Block::MIN_LIGHT_LEVEL;
+
+                if ( !block )
+                {
+                    sunlight_level = Block::MAX_LIGHT_LEVEL;
+                }
+                else if ( block->is_translucent() )
+                {
+                    light_level = block->get_light_level();
+                    sunlight_level = block->get_sunlight_level();
+                }
+
+                for ( int i = 0; i < LightVolume::NUM_COMPONENTS; ++i )
+                {
+                    volume.light_[z][y][x][i] =
+                        uint8_t( light_level[i] * LightVolume::MAX_LEVEL / Block::MAX_LIGHT_COMPONENT_LEVEL );
+                    volume.sunlight_[z][y][x][i] =
+                        uint8_t( sunlight_level[i] * LightVolume::MAX_LEVEL / Block::MAX_LIGHT_COMPONENT_LEVEL );
+                }
+            }
+        }
+    }
+}
+#endif
+
+void Chunk::calculate_vertex_lighting(
+    const Vector3i& primary_index,
+    const Vector3i& primary_relation,
+    const Vector3i& neighbor_relation_a,
+    const Vector3i& neighbor_relation_b,
+    Vector3ub& vertex_lighting,
+    Vector3ub& vertex_sunlighting
+)
+{
+    const int NUM_NEIGHBORS = 4;
+    BlockIterator neighbors[NUM_NEIGHBORS];
+    neighbors[0] = get_block_neighbor( primary_index, primary_relation );
+    neighbors[1] = get_block_neighbor( primary_index, primary_relation + neighbor_relation_a );
+    neighbors[2] = get_block_neighbor( primary_index, primary_relation + neighbor_relation_b );
+
+    // The 'ab' neighbor cannot contribute light to the vertex if both neighbors 'a' and 'b'
+    // are opaque, because they would fully block any light from 'ab'.
+    bool neighbor_ab_contributes = false;
+
+    if ( !neighbors[1].block_ || neighbors[1].block_->is_translucent() ||
+         !neighbors[2].block_ || neighbors[2].block_->is_translucent() )
     {
         neighbor_ab_contributes = true;
         neighbors[3] = get_block_neighbor( primary_index, primary_relation + neighbor_relation_a + neighbor_relation_b );
@@ -715,28 +1851,12 @@ void Chunk::calculate_vertex_lighting(
         }
     }
 
-    const Vector3f average_lighting = vector_cast<Scalar>( total_lighting ) / Scalar( num_contributors );
-    const Vector3f average_sunlighting = vector_cast<Scalar>( total_sunlighting ) / Scalar( num_contributors );
     const int ambient_occlusion_power = NUM_NEIGHBORS - neighbor_ab_contributes - num_contributors;
-    const int power_base = Block::MAX_LIGHT_COMPONENT_LEVEL + 2 * ambient_occlusion_power;
-    
+
     for ( int i = 0; i < Vector3i::Size; ++i )
     {
-        // Don't bother computing the attenuation if the lighting is nearly zero.
-        if ( average_lighting[i] > gmtl::GMTL_EPSILON )
-        {
-            const Scalar power = power_base - average_lighting[i];
-            vertex_lighting[i] = get_lighting_attenuation( power );
-        }
-        else vertex_lighting[i] = 0.0f;
-
-        // TODO: Remove duplication.
-        if ( average_sunlighting[i] > gmtl::GMTL_EPSILON )
-        {
-            const Scalar power = power_base - average_sunlighting[i];
-            vertex_sunlighting[i] = get_lighting_attenuation( power );
-        }
-        else vertex_sunlighting[i] = 0.0f;
+        vertex_lighting[i] = VERTEX_LIGHTING_TABLE.lookup( total_lighting[i], num_contributors, ambient_occlusion_power );
+        vertex_sunlighting[i] = VERTEX_LIGHTING_TABLE.lookup( total_sunlighting[i], num_contributors, ambient_occlusion_power );
     }
 }
 
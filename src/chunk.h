@@ -21,6 +21,7 @@
 
 #include <vector>
 #include <map>
+#include <algorithm>
 #include <set>
 #include <boost/shared_ptr.hpp>
 #include <boost/utility.hpp>
@@ -34,6 +35,11 @@
         for ( int y_name = 0; y_name < Chunk::SIZE_Y; ++y_name )\
             for ( int z_name = 0; z_name < Chunk::SIZE_Z; ++z_name )
 
+#define FOREACH_SECTION_BLOCK( section, x_name, y_name, z_name )\
+    for ( int x_name = 0; x_name < Chunk::SIZE_X; ++x_name )\
+        for ( int y_name = ( section ) * Chunk::SECTION_SIZE_Y; y_name < ( ( section ) + 1 ) * Chunk::SECTION_SIZE_Y; ++y_name )\
+            for ( int z_name = 0; z_name < Chunk::SIZE_Z; ++z_name )
+
 #define FOREACH_SURROUNDING( x_name, y_name, z_name )\
     for ( int x_name = -1; x_name <= 1; ++x_name )\
         for ( int y_name = -1; y_name <= 1; ++y_name )\
@@ -66,6 +72,127 @@ struct Chunk : public boost::noncopyable
 
     static const Vector3i SIZE;
 
+    // The geometry is meshed in Sections, which are horizontal slabs of the Chunk.  Each
+    // Section keeps hashes of the materials and lighting of the Blocks that its faces
+    // depend on (its own Blocks, plus a border one Block wide), so that only the Sections
+    // in which something actually changed are remeshed or relit.
+    static const int
+        SECTION_SIZE_Y = 4,
+        NUM_SECTIONS   = SIZE_Y / SECTION_SIZE_Y;
+
+    struct Section
+    {
+        Section();
+
+        unsigned get_num_faces() const
+        {
+            return ( opaque_vertices_.size() + translucent_vertices_.size() ) / BlockVertex::VERTICES_PER_FACE;
+        }
+
+        // The vertices are grouped by material.  The opaque and translucent faces are kept
+        // apart, as they are rendered separately, and the opaque faces are also grouped by
+        // the direction they point in, so that the ones facing away from the camera can be
+        // skipped.  The opaque faces pointing in a given direction start at the index in
+        // opaque_face_offsets_ for that relation; the last entry is the total number of them.
+        BlockVertexV
+            opaque_vertices_,
+            translucent_vertices_;
+
+        unsigned opaque_face_offsets_[NUM_CARDINAL_RELATIONS + 1];
+
+        // The geometry version changes each time the Section is remeshed, and the lighting
+        // version each time only its lighting is updated.  The renderer uses them to decide
+        // which Sections to upload, and whether it can just patch the lighting of the vertices.
+        unsigned
+            geometry_version_,
+            lighting_version_;
+
+        uint64_t
+            geometry_hash_,
+            lighting_hash_;
+    };
+
+    // Distant Chunks are drawn with coarser versions of their opaque geometry.  At each level
+    // of detail, the Blocks are grouped into cells twice as large along each axis as at the
+    // level below, and each cell that is at least half opaque is meshed as a single cube.
+    // Level 0 is the full resolution geometry in the Sections.
+    static const int NUM_LODS = 3;
+
+    // The FaceConnectivity records which pairs of the Chunk's faces are joined by some path
+    // of translucent Blocks through it, i.e. which faces could be seen through the Chunk
+    // from which others.  The renderer uses it to skip Chunks that are hidden by terrain.
+    struct FaceConnectivity
+    {
+        FaceConnectivity()
+        {
+            connect_all();
+        }
+
+        void connect_all()
+        {
+            std::fill( connections_, connections_ + NUM_CARDINAL_RELATIONS, ALL_FACES );
+        }
+
+        void disconnect_all()
+        {
+            std::fill( connections_, connections_ + NUM_CARDINAL_RELATIONS, 0 );
+        }
+
+        // Connects every pair of the faces in the mask, which has one bit per CardinalRelation.
+        void connect( const uint8_t faces )
+        {
+            FOREACH_CARDINAL_RELATION( relation )
+            {
+                if ( faces & ( 1 << relation ) )
+                {
+                    connections_[relation] |= faces;
+                }
+            }
+        }
+
+        bool are_connected( const CardinalRelation a, const CardinalRelation b ) const
+        {
+            return connections_[a] & ( 1 << b );
+        }
+
+        // Returns true if the face is connected to any face at all, including itself.
+        bool is_connected( const CardinalRelation relation ) const
+        {
+            return connections_[relation] != 0;
+        }
+
+        bool operator!=( const FaceConnectivity& other ) const
+        {
+            return !std::equal( connections_, connections_ + NUM_CARDINAL_RELATIONS, other.connections_ );
+        }
+
+        static const uint8_t ALL_FACES = ( 1 << NUM_CARDINAL_RELATIONS ) - 1;
+
+    private:
+
+        uint8_t connections_[NUM_CARDINAL_RELATIONS];
+    };
+
+#ifdef LIGHT_VOLUMES
+    // A LightVolume holds the light levels of the Blocks in a Chunk, plus a border of
+    // the neighboring Blocks so that the lighting can be interpolated smoothly across
+    // Chunk boundaries.  The levels are scaled into the range [0, MAX_LEVEL], and are
+    // laid out so that they can be uploaded directly as 3D RGB textures.
+    struct LightVolume
+    {
+        static const int
+            BORDER = 1,
+            SIZE_X = Chunk::SIZE_X + 2 * BORDER,
+            SIZE_Y = Chunk::SIZE_Y + 2 * BORDER,
+            SIZE_Z = Chunk::SIZE_Z + 2 * BORDER,
+            NUM_COMPONENTS = 3,
+            MAX_LEVEL = 0xff;
+
+        uint8_t light_[SIZE_Z][SIZE_Y][SIZE_X][NUM_COMPONENTS];
+        uint8_t sunlight_[SIZE_Z][SIZE_Y][SIZE_X][NUM_COMPONENTS];
+    };
+#endif
+
     Chunk( const Vector3i& position );
 
     const Vector3i& get_position() const { return position_; }
@@ -168,9 +295,53 @@ struct Chunk : public boost::noncopyable
     void reset_lighting();
     void apply_lighting_to_self();
     void apply_lighting_to_neighbors();
+
+    // This remeshes each of the Sections whose faces have changed since the last time it
+    // was called.  A Section whose faces are unchanged but whose lighting has changed is
+    // relit in place instead: the lighting of its existing vertices is recalculated, and the
+    // merged faces that are no longer lit evenly enough to stay merged are split up again.
     void update_geometry();
 
-    const BlockFaceV& get_external_faces() const { return external_faces_; }
+    // The mesh version changes whenever any Section is remeshed or relit, so a Chunk whose
+    // mesh version is unchanged after an update has nothing new to upload.
+    unsigned get_mesh_version() const { return mesh_version_; }
+
+    // These are brought up to date by update_geometry().
+    const FaceConnectivity& get_face_connectivity() const { return face_connectivity_; }
+
+    // The occluder height is the height of the box at the bottom of the Chunk that is known
+    // to be completely opaque from the outside, which the renderer can use as an occluder.
+    int get_occluder_height() const { return occluder_height_; }
+
+    const Section& get_section( const int section ) const
+    {
+        assert( section >= 0 && section < NUM_SECTIONS );
+        return sections_[section];
+    }
+
+    // The coarser levels of detail are kept in Sections of their own, which only hold opaque
+    // faces.  They are rebuilt by update_geometry() whenever any of the Sections change.
+    const Section& get_lod_section( const int lod ) const
+    {
+        assert( lod >= 1 && lod <= NUM_LODS );
+        return lod_sections_[lod - 1];
+    }
+
+    unsigned get_num_faces() const
+    {
+        unsigned num_faces = 0;
+
+        for ( int i = 0; i < NUM_SECTIONS; ++i )
+        {
+            num_faces += sections_[i].get_num_faces();
+        }
+
+        return num_faces;
+    }
+
+#ifdef LIGHT_VOLUMES
+    void get_light_volume( LightVolume& volume ) const;
+#endif
 
 private:
 
@@ -209,28 +380,145 @@ private:
         return extreme;
     }
 
-    void add_external_face(
+    // The material and corner lighting of a face.  For opaque faces, these decide whether
+    // it can be merged with the faces beside it.  Only faces whose lighting does not change
+    // along an edge can be merged along that edge, so that the merged face is lit exactly
+    // the same.
+    struct MergeableFace
+    {
+        MergeableFace() :
+            present_( false )
+        {
+        }
+
+        MergeableFace( const BlockMaterial material ) :
+            present_( true ),
+            material_( material )
+        {
+        }
+
+        bool can_merge_with( const MergeableFace& other ) const
+        {
+            if ( !present_ || !other.present_ || material_ != other.material_ )
+            {
+                return false;
+            }
+
+            for ( int i = 0; i < BlockVertex::VERTICES_PER_FACE; ++i )
+            {
+                if ( lighting_[i] != other.lighting_[i] || sunlighting_[i] != other.sunlighting_[i] )
+                {
+                    return false;
+                }
+            }
+
+            return true;
+        }
+
+        // Returns true if the lighting is the same at both ends of the edges that run from
+        // corner 'a' to corner 'b', and from corner 'd' to corner 'c'.
+        bool is_constant_along( const int a, const int b, const int c, const int d ) const
+        {
+            return lighting_[a] == lighting_[b] && sunlighting_[a] == sunlighting_[b] &&
+                   lighting_[d] == lighting_[c] && sunlighting_[d] == sunlighting_[c];
+        }
+
+        bool present_;
+        BlockMaterial material_;
+        Vector3ub lighting_[BlockVertex::VERTICES_PER_FACE];
+        Vector3ub sunlighting_[BlockVertex::VERTICES_PER_FACE];
+    };
+
+    typedef std::vector<MergeableFace> MergeableFaceV;
+
+    // The indices of faces' first vertices in a vertex stream.
+    typedef std::vector<size_t> FaceIndexV;
+
+    // Appends the vertices of a face covering 'extent' Blocks, along its first and last edges
+    // respectively, starting from the Block at 'block_index'.
+    void add_face_vertices(
         const Vector3i& block_index,
-        const Vector3f& block_position,
-        const Block& block,
         const CardinalRelation relation,
-        const Vector3i& relation_vector
+        const MergeableFace& face,
+        const Vector2i& extent,
+        BlockVertexV& vertices
+    );
+
+    // The neighbor columns are the bottom Chunks of the columns beside this one, if any.
+    void get_neighbor_columns( Chunk* neighbor_columns[NUM_CARDINAL_RELATIONS] );
+
+    // Returns the Block at 'index', which may be up to one Block outside of this Chunk.
+    const Block* get_nearby_block( const Vector3i& index );
+
+    void hash_section(
+        const int section,
+        Chunk* const neighbor_columns[NUM_CARDINAL_RELATIONS],
+        uint64_t& geometry_hash,
+        uint64_t& lighting_hash
+    );
+
+    void mesh_section( const int section, Chunk* const neighbor_columns[NUM_CARDINAL_RELATIONS], MergeableFaceV& mergeable_faces );
+    void relight_section( const int section, MergeableFaceV& mergeable_faces );
+
+    // Replaces each of the merged opaque faces at 'split_faces' with faces merged anew from
+    // the Blocks that it covered, leaving the rest of the Section's faces as they are.
+    void split_opaque_faces( const int section, const FaceIndexV& split_faces, MergeableFaceV& mergeable_faces );
+
+    void merge_faces(
+        const CardinalRelation relation,
+        const int section,
+        MergeableFaceV& mergeable_faces,
+        BlockVertexV* material_vertices
     );
 
+    void mesh_lods( Chunk* const neighbor_columns[NUM_CARDINAL_RELATIONS] );
+    void mesh_lod( const int lod, Chunk* const neighbor_columns[NUM_CARDINAL_RELATIONS] );
+
+    // Appends the vertices of a run of 'run_length' faces of cells 'scale' Blocks wide,
+    // starting from the cell at 'cell_index'.
+    void add_lod_face_vertices(
+        const Vector3i& cell_index,
+        const int scale,
+        const CardinalRelation relation,
+        const MergeableFace& face,
+        const int run_length,
+        BlockVertexV& vertices
+    );
+
+    void calculate_lod_face_lighting( const Vector3i& cell_index, const int scale, const CardinalRelation relation, MergeableFace& face );
+
+    // Returns true if all of the Blocks in front of a cell's face exist and are opaque.
+    bool is_lod_face_covered( const Vector3i& cell_index, const int scale, const CardinalRelation relation );
+
+    void update_occlusion();
+
+    // Relights the faces in place, except for the merged faces whose Blocks are no longer lit
+    // evenly; those are left alone and appended to 'split_faces'.
+    void update_face_lighting( BlockVertexV& vertices, FaceIndexV& split_faces );
+    void calculate_face_lighting( const Vector3i& block_index, const CardinalRelation relation, MergeableFace& face );
+
     void calculate_vertex_lighting(
         const Vector3i& primary_index,
         const Vector3i& primary_relation,
         const Vector3i& neighbor_relation_a,
         const Vector3i& neighbor_relation_b,
-        Vector3f& vertex_lighting,
-        Vector3f& vertex_sunlighting
+        Vector3ub& vertex_lighting,
+        Vector3ub& vertex_sunlighting
     );
 
     Vector3i position_;
 
     Block blocks_[SIZE_X][SIZE_Y][SIZE_Z];
 
-    BlockFaceV external_faces_;
+    Section sections_[NUM_SECTIONS];
+
+    Section lod_sections_[NUM_LODS];
+
+    FaceConnectivity face_connectivity_;
+
+    int occluder_height_;
+
+    unsigned mesh_version_;
 
     Chunk* neighbors_[3][3][3];
 };
@@ -0,0 +1,73 @@
+///////////////////////////////////////////////////////////////////////////
+// Copyright 2011 Evan Mezeske.
+//
+// This file is part of Digbuild.
+// 
+// Digbuild is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.
+// 
+// Digbuild is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with Digbuild.  If not, see <http://www.gnu.org/licenses/>.
+///////////////////////////////////////////////////////////////////////////
+
+#include "chunk_hierarchy.h"
+
+//////////////////////////////////////////////////////////////////////////////////
+// Function definitions:
+//////////////////////////////////////////////////////////////////////////////////
+
+FrustumContainment classify_aabb( const gmtl::Frustumf& frustum, const AABoxf& aabb )
+{
+    const Vector3f& min = aabb.getMin();
+    const Vector3f& max = aabb.getMax();
+
+    FrustumContainment containment = FRUSTUM_INSIDE;
+
+    for ( int i = 0; i < 6; ++i )
+    {
+        const gmtl::Planef& plane = frustum.mPlanes[i];
+
+        // Only the corners that are farthest along and against the plane normal matter.
+        Vector3f
+            far_corner,
+            near_corner;
+
+        for ( int j = 0; j < Vector3f::Size; ++j )
+        {
+            far_corner[j] = plane.mNorm[j] >= 0.0f ? max[j] : min[j];
+            near_corner[j] = plane.mNorm[j] >= 0.0f ? min[j] : max[j];
+        }
+
+        if ( gmtl::dot( plane.mNorm, far_corner ) - plane.mOffset < 0.0f )
+        {
+            return FRUSTUM_OUTSIDE;
+        }
+
+        if ( gmtl::dot( plane.mNorm, near_corner ) - plane.mOffset < 0.0f )
+        {
+            containment = FRUSTUM_INTERSECTING;
+        }
+    }
+
+    return containment;
+}
+
+Vector3i get_cell_index( const Vector3i& coordinates, const int cell_size )
+{
+    Vector3i cell_index;
+
+    for ( int i = 0; i < Vector3i::Size; ++i )
+    {
+        cell_index[i] = coordinates[i] >= 0 ?
+            coordinates[i] / cell_size :
+            -( ( -coordinates[i] + cell_size - 1 ) / cell_size );
+    }
+
+    return cell_index;
+}
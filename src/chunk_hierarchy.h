@@ -0,0 +1,226 @@
+///////////////////////////////////////////////////////////////////////////
+// Copyright 2011 Evan Mezeske.
+//
+// This file is part of Digbuild.
+// 
+// Digbuild is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.
+// 
+// Digbuild is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with Digbuild.  If not, see <http://www.gnu.org/licenses/>.
+///////////////////////////////////////////////////////////////////////////
+
+#ifndef CHUNK_HIERARCHY_H
+#define CHUNK_HIERARCHY_H
+
+#include <map>
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+
+#include "chunk.h"
+
+enum FrustumContainment
+{
+    FRUSTUM_OUTSIDE,
+    FRUSTUM_INTERSECTING,
+    FRUSTUM_INSIDE
+};
+
+// This agrees with gmtl::isInVolume() about which boxes are outside of the frustum, but
+// also tells apart the boxes that are entirely inside of it.
+FrustumContainment classify_aabb( const gmtl::Frustumf& frustum, const AABoxf& aabb );
+
+// Returns the index of the cell of the given size that contains the given coordinates,
+// rounding toward negative infinity.
+Vector3i get_cell_index( const Vector3i& coordinates, const int cell_size );
+
+// A ChunkHierarchy holds one value per Chunk position, in a fixed grid hierarchy where each
+// node groups BRANCHING_FACTOR^3 children: Chunks, then groups of Chunks, and so on.  The
+// bounds of each node are those of its grid cell, so adding or removing a Chunk only ever
+// touches the nodes directly above it.  Culling skips the whole subtree of any node that is
+// outside of the frustum, and accepts the whole subtree of any node that is inside of it, so
+// the number of boxes tested depends on the visible Chunks rather than on the loaded ones.
+template <typename T>
+struct ChunkHierarchy
+{
+    typedef std::vector<T> ValueV;
+
+    // The 'position' must be that of a Chunk, i.e. a multiple of Chunk::SIZE.
+    void insert( const Vector3i& position, const T value );
+    void erase( const Vector3i& position );
+
+    // Appends the values of the Chunks that are not outside of the frustum to 'visible',
+    // and returns the number of bounding boxes that were tested.
+    unsigned cull( const gmtl::Frustumf& frustum, ValueV& visible ) const;
+
+    bool empty() const { return roots_.empty(); }
+
+protected:
+
+    static const int
+        BRANCHING_FACTOR = 4,
+        NUM_GROUP_LEVELS = 2;
+
+    struct Node;
+    typedef boost::shared_ptr<Node> NodeSP;
+    typedef std::map<Vector3i, NodeSP, VectorLess<Vector3i> > NodeMap;
+
+    struct Node
+    {
+        Node( const AABoxf& aabb ) : aabb_( aabb ), value_() {}
+
+        AABoxf aabb_;
+
+        // Only the Chunk nodes have no children, and only they have values.
+        NodeMap children_;
+        T value_;
+    };
+
+    static int get_cell_size( const int level );
+    static void cull_node( const Node& node, const gmtl::Frustumf& frustum, ValueV& visible, unsigned& num_tests );
+    static void gather_values( const Node& node, ValueV& values );
+
+    NodeMap roots_;
+};
+
+//////////////////////////////////////////////////////////////////////////////////
+// Function definitions for ChunkHierarchy:
+//////////////////////////////////////////////////////////////////////////////////
+
+template <typename T>
+void ChunkHierarchy<T>::insert( const Vector3i& position, const T value )
+{
+    NodeMap* children = &roots_;
+
+    for ( int level = NUM_GROUP_LEVELS; level >= 0; --level )
+    {
+        const int cell_size = get_cell_size( level );
+        const Vector3i cell_index = get_cell_index( position, cell_size );
+        typename NodeMap::iterator node_it = children->find( cell_index );
+
+        if ( node_it == children->end() )
+        {
+            const Vector3f cell_min = vector_cast<Scalar>( cell_index * cell_size );
+            const Vector3f cell_max = cell_min + Vector3f( cell_size, cell_size, cell_size );
+            const NodeSP node( new Node( AABoxf( cell_min, cell_max ) ) );
+            node_it = children->insert( std::make_pair( cell_index, node ) ).first;
+        }
+
+        if ( level == 0 )
+        {
+            node_it->second->value_ = value;
+        }
+
+        children = &node_it->second->children_;
+    }
+}
+
+template <typename T>
+void ChunkHierarchy<T>::erase( const Vector3i& position )
+{
+    typedef std::pair<NodeMap*, typename NodeMap::iterator> PathEntry;
+    std::vector<PathEntry> path;
+
+    NodeMap* children = &roots_;
+
+    for ( int level = NUM_GROUP_LEVELS; level >= 0; --level )
+    {
+        const typename NodeMap::iterator node_it = children->find( get_cell_index( position, get_cell_size( level ) ) );
+
+        if ( node_it == children->end() )
+        {
+            return;
+        }
+
+        path.push_back( std::make_pair( children, node_it ) );
+        children = &node_it->second->children_;
+    }
+
+    // The Chunk node is always removed, and then any groups that it leaves empty.
+    while ( !path.empty() && path.back().second->second->children_.empty() )
+    {
+        path.back().first->erase( path.back().second );
+        path.pop_back();
+    }
+}
+
+template <typename T>
+unsigned ChunkHierarchy<T>::cull( const gmtl::Frustumf& frustum, ValueV& visible ) const
+{
+    unsigned num_tests = 0;
+
+    for ( typename NodeMap::const_iterator root_it = roots_.begin(); root_it != roots_.end(); ++root_it )
+    {
+        cull_node( *root_it->second, frustum, visible, num_tests );
+    }
+
+    return num_tests;
+}
+
+template <typename T>
+int ChunkHierarchy<T>::get_cell_size( const int level )
+{
+    int cell_size = Chunk::SIZE_X;
+
+    for ( int i = 0; i < level; ++i )
+    {
+        cell_size *= BRANCHING_FACTOR;
+    }
+
+    return cell_size;
+}
+
+template <typename T>
+void ChunkHierarchy<T>::cull_node( const Node& node, const gmtl::Frustumf& frustum, ValueV& visible, unsigned& num_tests )
+{
+    ++num_tests;
+
+    switch ( classify_aabb( frustum, node.aabb_ ) )
+    {
+        case FRUSTUM_OUTSIDE:
+            break;
+
+        case FRUSTUM_INSIDE:
+            gather_values( node, visible );
+            break;
+
+        case FRUSTUM_INTERSECTING:
+            if ( node.children_.empty() )
+            {
+                visible.push_back( node.value_ );
+            }
+            else
+            {
+                for ( typename NodeMap::const_iterator child_it = node.children_.begin(); child_it != node.children_.end(); ++child_it )
+                {
+                    cull_node( *child_it->second, frustum, visible, num_tests );
+                }
+            }
+            break;
+    }
+}
+
+template <typename T>
+void ChunkHierarchy<T>::gather_values( const Node& node, ValueV& values )
+{
+    if ( node.children_.empty() )
+    {
+        values.push_back( node.value_ );
+    }
+    else
+    {
+        for ( typename NodeMap::const_iterator child_it = node.children_.begin(); child_it != node.children_.end(); ++child_it )
+        {
+            gather_values( *child_it->second, values );
+        }
+    }
+}
+
+#endif // CHUNK_HIERARCHY_H
@@ -0,0 +1,590 @@
+///////////////////////////////////////////////////////////////////////////
+// Copyright 2011 Evan Mezeske.
+//
+// This file is part of Digbuild.
+// 
+// Digbuild is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.
+// 
+// Digbuild is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with Digbuild.  If not, see <http://www.gnu.org/licenses/>.
+///////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+
+#include <boost/foreach.hpp>
+#include <boost/random/uniform_int.hpp>
+#include <boost/random/variate_generator.hpp>
+
+#include "log.h"
+#include "timer.h"
+#include "renderer.h"
+#include "culling_benchmark.h"
+
+//////////////////////////////////////////////////////////////////////////////////
+// Local definitions:
+//////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+const char* CAMERA_PATH_NAMES[] =
+{
+    "spin",
+    "walk",
+    "flyover"
+};
+
+// These match the projection that the SDL_GL_Window sets up by default.
+const Scalar
+    FIELD_OF_VIEW = 65.0f,
+    ASPECT_RATIO = 4.0f / 3.0f,
+    NEAR_DISTANCE = 0.1f,
+    FAR_DISTANCE = 250.0f;
+
+const Scalar EYE_HEIGHT = 1.62f;
+
+// This matches the Renderer's default distance for switching to the far material program.
+const Scalar FAR_PROGRAM_DISTANCE = 48.0f;
+
+// Orders pairs by their first members alone.
+struct DistanceLess
+{
+    template <typename Pair>
+    bool operator()( const Pair& a, const Pair& b ) const
+    {
+        return a.first < b.first;
+    }
+};
+
+gmtl::Matrix44f make_identity()
+{
+    gmtl::Matrix44f m;
+
+    for ( int row = 0; row < 4; ++row )
+    {
+        for ( int column = 0; column < 4; ++column )
+        {
+            m( row, column ) = row == column ? 1.0f : 0.0f;
+        }
+    }
+
+    return m;
+}
+
+// The same matrix that gluPerspective() builds.
+gmtl::Matrix44f make_perspective( const Scalar field_of_view, const Scalar aspect_ratio, const Scalar near_distance, const Scalar far_distance )
+{
+    const Scalar f = 1.0f / gmtl::Math::tan( field_of_view * gmtl::Math::PI / 360.0f );
+
+    gmtl::Matrix44f m = make_identity();
+    m( 0, 0 ) = f / aspect_ratio;
+    m( 1, 1 ) = f;
+    m( 2, 2 ) = ( far_distance + near_distance ) / ( near_distance - far_distance );
+    m( 2, 3 ) = 2.0f * far_distance * near_distance / ( near_distance - far_distance );
+    m( 3, 2 ) = -1.0f;
+    m( 3, 3 ) = 0.0f;
+    return m;
+}
+
+// The same matrix that glRotatef() builds for rotations about the X or Y axis.
+gmtl::Matrix44f make_rotation( const Scalar angle, const int axis )
+{
+    const int
+        a = axis == 0 ? 1 : 2,
+        b = axis == 0 ? 2 : 0;
+
+    gmtl::Matrix44f m = make_identity();
+    m( a, a ) = gmtl::Math::cos( angle );
+    m( a, b ) = -gmtl::Math::sin( angle );
+    m( b, a ) = gmtl::Math::sin( angle );
+    m( b, b ) = gmtl::Math::cos( angle );
+    return m;
+}
+
+gmtl::Matrix44f make_translation( const Vector3f& translation )
+{
+    gmtl::Matrix44f m = make_identity();
+
+    for ( int i = 0; i < Vector3f::Size; ++i )
+    {
+        m( i, 3 ) = translation[i];
+    }
+
+    return m;
+}
+
+// The same modelview matrix that Camera::rotate() and Camera::translate() set up.
+gmtl::Matrix44f make_camera_view( const Vector3f& position, const Scalar pitch, const Scalar yaw )
+{
+    gmtl::Matrix44f
+        rotation,
+        view;
+
+    gmtl::mult( rotation, make_rotation( pitch - gmtl::Math::PI_OVER_2, 0 ), make_rotation( gmtl::Math::PI - yaw, 1 ) );
+    gmtl::mult( view, rotation, make_translation( -position ) );
+    return view;
+}
+
+} // anonymous namespace
+
+//////////////////////////////////////////////////////////////////////////////////
+// Function definitions for CullingBenchmark:
+//////////////////////////////////////////////////////////////////////////////////
+
+CullingBenchmark::CullingBenchmark( const uint64_t seed, const Vector3i& region_chunks, const unsigned frames_per_path ) :
+    region_chunks_( region_chunks ),
+    frames_per_path_( frames_per_path ),
+    generator_( seed )
+{
+    for ( int x = 0; x < region_chunks_[0]; ++x )
+    {
+        for ( int y = 0; y < region_chunks_[1]; ++y )
+        {
+            for ( int z = 0; z < region_chunks_[2]; ++z )
+            {
+                // The region is centered on the origin horizontally, like the World is.
+                const Vector3i chunk_index( x - region_chunks_[0] / 2, y, z - region_chunks_[2] / 2 );
+                const Vector3i position = pointwise_product( chunk_index, Chunk::SIZE );
+                const Vector3f chunk_min = vector_cast<Scalar>( position );
+
+                chunks_[position] = AABoxf( chunk_min, chunk_min + vector_cast<Scalar>( Chunk::SIZE ) );
+                chunk_hierarchy_.insert( position, position );
+            }
+        }
+    }
+}
+
+bool CullingBenchmark::run()
+{
+    unsigned
+        total_mismatches = 0,
+        total_render_list_errors = 0;
+
+    for ( int path = 0; path < NUM_CAMERA_PATHS; ++path )
+    {
+        double
+            flat_time = 0.0,
+            hierarchy_time = 0.0;
+
+        unsigned
+            flat_tests = 0,
+            hierarchy_tests = 0,
+            num_visible = 0,
+            mismatches = 0,
+            render_list_errors = 0;
+
+        PositionV
+            flat_visible,
+            hierarchy_visible;
+
+        for ( unsigned frame = 0; frame < frames_per_path_; ++frame )
+        {
+            toggle_random_chunk();
+
+            Vector3f camera_position;
+
+            gmtl::Matrix44f
+                modelview,
+                projection;
+
+            get_camera( CameraPath( path ), Scalar( frame ) / Scalar( frames_per_path_ ), camera_position, modelview, projection );
+
+            const gmtl::Frustumf frustum( modelview, projection );
+
+            flat_visible.clear();
+            hierarchy_visible.clear();
+
+            {
+                HighResolutionTimer flat_timer;
+
+                BOOST_FOREACH( const ChunkBoundsMap::value_type& chunk_it, chunks_ )
+                {
+                    if ( gmtl::isInVolume( frustum, chunk_it.second ) )
+                    {
+                        flat_visible.push_back( chunk_it.first );
+                    }
+                }
+
+                flat_time += flat_timer.get_seconds_elapsed();
+                flat_tests += chunks_.size();
+            }
+
+            {
+                HighResolutionTimer hierarchy_timer;
+                hierarchy_tests += chunk_hierarchy_.cull( frustum, hierarchy_visible );
+                hierarchy_time += hierarchy_timer.get_seconds_elapsed();
+            }
+
+            std::sort( flat_visible.begin(), flat_visible.end(), VectorLess<Vector3i>() );
+            std::sort( hierarchy_visible.begin(), hierarchy_visible.end(), VectorLess<Vector3i>() );
+
+            if ( flat_visible != hierarchy_visible )
+            {
+                ++mismatches;
+            }
+
+            if ( !check_render_list( camera_position, hierarchy_visible ) )
+            {
+                ++render_list_errors;
+            }
+
+            num_visible += flat_visible.size();
+        }
+
+        LOG( "Path " << CAMERA_PATH_NAMES[path] << ": " << num_visible / frames_per_path_ << " of "
+             << chunks_.size() << " chunks visible per frame, flat " << flat_time << "s ("
+             << flat_tests / frames_per_path_ << " tests per frame), hierarchy " << hierarchy_time << "s ("
+             << hierarchy_tests / frames_per_path_ << " tests per frame), " << mismatches << " mismatched frames, "
+             << render_list_errors << " inconsistent render lists" );
+
+        total_mismatches += mismatches;
+        total_render_list_errors += render_list_errors;
+    }
+
+    const bool
+        occlusion_correct = check_occlusion(),
+        opaque_ranges_correct = check_opaque_ranges();
+
+    return total_mismatches == 0 && total_render_list_errors == 0 && occlusion_correct && opaque_ranges_correct;
+}
+
+void CullingBenchmark::get_camera(
+    const CameraPath path,
+    const Scalar t,
+    Vector3f& position,
+    gmtl::Matrix44f& modelview,
+    gmtl::Matrix44f& projection
+) const
+{
+    const Vector3f region_size = vector_cast<Scalar>( pointwise_product( region_chunks_, Chunk::SIZE ) );
+    const Scalar angle = 2.0f * gmtl::Math::PI * t;
+
+    Scalar
+        pitch = gmtl::Math::PI_OVER_2,
+        yaw = 0.0f;
+
+    switch ( path )
+    {
+        // Turning in place near the ground, in the middle of the region.
+        case CAMERA_PATH_SPIN:
+            position = Vector3f( 0.0f, region_size[1] / 2.0f, 0.0f );
+            yaw = 4.0f * angle;
+            break;
+
+        // Walking across the region at eye height and looking around, mostly toward the horizon.
+        case CAMERA_PATH_WALK:
+            position = Vector3f( ( t - 0.5f ) * region_size[0], region_size[1] / 2.0f + EYE_HEIGHT, 0.0f );
+            pitch += 0.4f * gmtl::Math::sin( 3.0f * angle );
+            yaw = gmtl::Math::PI_OVER_2 + gmtl::Math::sin( 2.0f * angle );
+            break;
+
+        // Flying high over the region in a circle, looking down toward the ground.
+        case CAMERA_PATH_FLYOVER:
+            position = Vector3f(
+                region_size[0] / 4.0f * gmtl::Math::cos( angle ),
+                region_size[1] * 1.5f,
+                region_size[2] / 4.0f * gmtl::Math::sin( angle ) );
+            pitch += 0.6f;
+            yaw = -angle;
+            break;
+
+        default:
+            assert( false );
+    }
+
+    modelview = make_camera_view( position, pitch, yaw );
+    projection = make_perspective( FIELD_OF_VIEW, ASPECT_RATIO, NEAR_DISTANCE, FAR_DISTANCE );
+}
+
+bool CullingBenchmark::check_render_list( const Vector3f& camera_position, const PositionV& visible )
+{
+    const Scalar far_distance_squared = FAR_PROGRAM_DISTANCE * FAR_PROGRAM_DISTANCE;
+
+    // The Chunks in the middle layer of the region stand in for the ones with translucent
+    // faces.  There are no ChunkRenderers, since the NullRenderBackend never draws them.
+    const int translucent_height = region_chunks_[1] / 2 * Chunk::SIZE_Y;
+
+    unsigned num_translucent = 0;
+
+    render_list_.clear();
+
+    BOOST_FOREACH( const Vector3i& position, visible )
+    {
+        const Vector3f centroid = vector_cast<Scalar>( position ) + vector_cast<Scalar>( Chunk::SIZE ) / 2.0f;
+        const Scalar distance_squared = gmtl::lengthSquared( Vector3f( centroid - camera_position ) );
+        const RendererMaterialManager::MaterialProgram program = distance_squared < far_distance_squared ?
+            RendererMaterialManager::MATERIAL_PROGRAM_NEAR :
+            RendererMaterialManager::MATERIAL_PROGRAM_FAR;
+
+        render_list_.add( RENDER_PASS_OPAQUE, program, distance_squared, 0 );
+
+        if ( position[1] == translucent_height )
+        {
+            render_list_.add( RENDER_PASS_TRANSLUCENT, program, distance_squared, 0 );
+            ++num_translucent;
+        }
+    }
+
+    NullRenderBackend backend;
+    render_list_.submit( backend );
+
+    // Each material pass must select the near and far programs at most once each.
+    return
+        backend.is_consistent() &&
+        backend.get_num_draws( RENDER_PASS_OPAQUE ) == visible.size() &&
+        backend.get_num_draws( RENDER_PASS_TRANSLUCENT ) == num_translucent &&
+        backend.get_num_program_changes( RENDER_PASS_OPAQUE ) <= 2 &&
+        backend.get_num_program_changes( RENDER_PASS_TRANSLUCENT ) <= 2;
+}
+
+bool CullingBenchmark::check_occlusion()
+{
+    typedef std::pair<Scalar, Vector3i> DistancePositionPair;
+    typedef std::vector<DistancePositionPair> DistancePositionPairV;
+
+    // The lower half of the region is treated as solid, and the camera walks just above
+    // it, so none of the Chunks above the floor can be behind it.
+    const int floor_height = region_chunks_[1] / 2 * Chunk::SIZE_Y;
+
+    double occlusion_time = 0.0;
+
+    unsigned
+        num_visible = 0,
+        num_occluded = 0,
+        num_errors = 0;
+
+    PositionV visible;
+
+    for ( unsigned frame = 0; frame < frames_per_path_; ++frame )
+    {
+        Vector3f camera_position;
+
+        gmtl::Matrix44f
+            modelview,
+            projection,
+            view_projection;
+
+        get_camera( CAMERA_PATH_WALK, Scalar( frame ) / Scalar( frames_per_path_ ), camera_position, modelview, projection );
+        gmtl::mult( view_projection, projection, modelview );
+
+        visible.clear();
+        chunk_hierarchy_.cull( gmtl::Frustumf( modelview, projection ), visible );
+
+        DistancePositionPairV nearest_occluders;
+
+        BOOST_FOREACH( const ChunkBoundsMap::value_type& chunk_it, chunks_ )
+        {
+            if ( chunk_it.first[1] < floor_height )
+            {
+                const Vector3f centroid = chunk_it.second.getMin() + vector_cast<Scalar>( Chunk::SIZE ) / 2.0f;
+                const Scalar distance = gmtl::length( Vector3f( centroid - camera_position ) );
+
+                if ( distance <= OcclusionBuffer::MAX_OCCLUDER_DISTANCE )
+                {
+                    nearest_occluders.push_back( std::make_pair( distance, chunk_it.first ) );
+                }
+            }
+        }
+
+        std::sort( nearest_occluders.begin(), nearest_occluders.end(), DistanceLess() );
+        nearest_occluders.resize( std::min<size_t>( nearest_occluders.size(), OcclusionBuffer::MAX_OCCLUDERS ) );
+
+        HighResolutionTimer occlusion_timer;
+
+        occlusion_buffer_.clear( view_projection );
+
+        BOOST_FOREACH( const DistancePositionPair& occluder, nearest_occluders )
+        {
+            occlusion_buffer_.add_occluder( chunks_[occluder.second] );
+        }
+
+        BOOST_FOREACH( const Vector3i& position, visible )
+        {
+            if ( !occlusion_buffer_.is_visible( chunks_[position] ) )
+            {
+                ++num_occluded;
+
+                if ( position[1] >= floor_height )
+                {
+                    ++num_errors;
+                }
+            }
+        }
+
+        occlusion_time += occlusion_timer.get_seconds_elapsed();
+        num_visible += visible.size();
+    }
+
+    LOG( "Occlusion: " << num_occluded / frames_per_path_ << " of " << num_visible / frames_per_path_
+         << " chunks in the frustum occluded per frame, " << occlusion_time << "s, "
+         << num_errors << " wrongly occluded" );
+
+    return num_errors == 0;
+}
+
+void CullingBenchmark::toggle_random_chunk()
+{
+    boost::variate_generator<boost::rand48&, boost::uniform_int<> >
+        random_x( generator_, boost::uniform_int<>( -region_chunks_[0] / 2, region_chunks_[0] - region_chunks_[0] / 2 - 1 ) ),
+        random_y( generator_, boost::uniform_int<>( 0, region_chunks_[1] - 1 ) ),
+        random_z( generator_, boost::uniform_int<>( -region_chunks_[2] / 2, region_chunks_[2] - region_chunks_[2] / 2 - 1 ) );
+
+    const Vector3i position = pointwise_product( Vector3i( random_x(), random_y(), random_z() ), Chunk::SIZE );
+    const ChunkBoundsMap::iterator chunk_it = chunks_.find( position );
+
+    if ( chunk_it != chunks_.end() )
+    {
+        chunks_.erase( chunk_it );
+        chunk_hierarchy_.erase( position );
+    }
+    else
+    {
+        const Vector3f chunk_min = vector_cast<Scalar>( position );
+        chunks_[position] = AABoxf( chunk_min, chunk_min + vector_cast<Scalar>( Chunk::SIZE ) );
+        chunk_hierarchy_.insert( position, position );
+    }
+}
+
+bool CullingBenchmark::check_opaque_ranges()
+{
+    // The faces are laid out by relation, as the Chunk meshes them.  One relation has no
+    // faces at all, and the ranges on either side of it must still be joined.
+    const GLsizei FACE_COUNTS[NUM_CARDINAL_RELATIONS] = { 3, 0, 5, 1, 4, 2 };
+    const Vector3i section_size( Chunk::SIZE_X, Chunk::SECTION_SIZE_Y, Chunk::SIZE_Z );
+    const Vector3f section_min( 16.0f, 32.0f, -48.0f );
+
+    const GLsizei first_quad = 100;
+    const AABoxf aabb( section_min, section_min + vector_cast<Scalar>( section_size ) );
+    unsigned face_offsets[NUM_CARDINAL_RELATIONS + 1];
+    face_offsets[0] = 0;
+
+    FOREACH_CARDINAL_RELATION( relation )
+    {
+        face_offsets[relation + 1] = face_offsets[relation] + FACE_COUNTS[relation];
+    }
+
+    const GLsizei num_quads = face_offsets[NUM_CARDINAL_RELATIONS];
+
+    // Along each axis, the camera is put beside the box, on its faces, just inside of them,
+    // past the first plane of faces inside of them, and in the middle.
+    const int NUM_CAMERA_OFFSETS = 9;
+
+    unsigned
+        num_cameras = 0,
+        num_culled = 0,
+        num_errors = 0;
+
+    VertexArena::RangeV ranges;
+    std::vector<bool> drawn;
+
+    for ( int x = 0; x < NUM_CAMERA_OFFSETS; ++x )
+    {
+        for ( int y = 0; y < NUM_CAMERA_OFFSETS; ++y )
+        {
+            for ( int z = 0; z < NUM_CAMERA_OFFSETS; ++z )
+            {
+                const int offset_indices[Vector3i::Size] = { x, y, z };
+                Vector3f camera_position;
+
+                for ( int i = 0; i < Vector3i::Size; ++i )
+                {
+                    const Scalar
+                        size = Scalar( section_size[i] ),
+                        offsets[NUM_CAMERA_OFFSETS] =
+                        {
+                            -1.0f, 0.0f, 0.5f, 1.5f,
+                            size / 2.0f,
+                            size - 1.5f, size - 0.5f, size, size + 1.0f
+                        };
+
+                    camera_position[i] = section_min[i] + offsets[offset_indices[i]];
+                }
+
+                // A range that was already in the list must be left alone, even though the
+                // first of the Section's ranges would start right where it ends.
+                const VertexArena::Range previous_range( first_quad, QuadRange( -1, 1 ) );
+
+                ranges.assign( 1, previous_range );
+                get_visible_opaque_ranges( face_offsets, first_quad, aabb, camera_position, ranges );
+
+                bool correct = ranges[0] == previous_range;
+                GLsizei previous_end = -1;
+
+                drawn.assign( num_quads, false );
+
+                for ( size_t i = 1; i < ranges.size() && correct; ++i )
+                {
+                    const QuadRange& range = ranges[i].second;
+
+                    // The ranges must be in order, must not be empty, and must have been
+                    // joined wherever one ends right where the next begins.
+                    correct =
+                        ranges[i].first == first_quad &&
+                        range.second > 0 &&
+                        range.first > previous_end &&
+                        range.first + range.second <= num_quads;
+
+                    for ( GLsizei quad = range.first; quad < range.first + range.second && correct; ++quad )
+                    {
+                        drawn[quad] = true;
+                    }
+
+                    previous_end = range.first + range.second;
+                }
+
+                FOREACH_CARDINAL_RELATION( relation )
+                {
+                    const Vector3i direction = cardinal_relation_vector( relation );
+                    int axis = 0;
+
+                    while ( direction[axis] == 0 )
+                    {
+                        ++axis;
+                    }
+
+                    // The faces pointing along the axis lie on the planes between the Blocks,
+                    // one Block in from the side of the box that they point away from.  They
+                    // must be drawn if the camera is in front of any of those planes, and must
+                    // be culled if it is behind all of the box.
+                    const Scalar
+                        camera = camera_position[axis],
+                        box_min = aabb.getMin()[axis],
+                        box_max = aabb.getMax()[axis];
+
+                    const bool
+                        must_draw = direction[axis] > 0 ? camera > box_min + 1.0f : camera < box_max - 1.0f,
+                        must_cull = direction[axis] > 0 ? camera <= box_min : camera >= box_max;
+
+                    for ( GLsizei quad = face_offsets[relation]; quad < GLsizei( face_offsets[relation + 1] ); ++quad )
+                    {
+                        correct = correct && !( must_draw && !drawn[quad] ) && !( must_cull && drawn[quad] );
+                    }
+
+                    if ( FACE_COUNTS[relation] > 0 && !drawn[face_offsets[relation]] )
+                    {
+                        ++num_culled;
+                    }
+                }
+
+                if ( !correct )
+                {
+                    LOG( "Wrong opaque ranges for a camera at " << camera_position << "." );
+                    ++num_errors;
+                }
+
+                ++num_cameras;
+            }
+        }
+    }
+
+    LOG( "Opaque ranges: " << num_cameras << " camera positions, " << num_culled << " relations culled, "
+         << num_errors << " wrong" );
+
+    return num_errors == 0;
+}
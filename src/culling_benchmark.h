@@ -0,0 +1,92 @@
+///////////////////////////////////////////////////////////////////////////
+// Copyright 2011 Evan Mezeske.
+//
+// This file is part of Digbuild.
+// 
+// Digbuild is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.
+// 
+// Digbuild is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with Digbuild.  If not, see <http://www.gnu.org/licenses/>.
+///////////////////////////////////////////////////////////////////////////
+
+#ifndef CULLING_BENCHMARK_H
+#define CULLING_BENCHMARK_H
+
+#include <map>
+#include <vector>
+
+#include <boost/random/linear_congruential.hpp>
+
+#include "chunk_hierarchy.h"
+#include "occlusion_buffer.h"
+#include "render_list.h"
+
+// The CullingBenchmark is a headless comparison of the Chunk frustum culling.  It fills a
+// synthetic region with Chunk positions, flies cameras along a few synthetic paths, and
+// culls every frame both by testing every Chunk (as the Renderer used to) and through a
+// ChunkHierarchy.  Random Chunks are loaded and unloaded along the way, to exercise the
+// incremental updates.  The time and number of boxes tested by each are reported, and the
+// two must agree on exactly which Chunks are visible.  The visible Chunks are also put into
+// a RenderList each frame, and submitted to a NullRenderBackend to check the draw order.
+// Then the OcclusionBuffer is checked by walking just above a solid floor, from where
+// nothing above the floor may be occluded.  Finally, the ranges of opaque faces that
+// get_visible_opaque_ranges() picks for a Section are checked from camera positions inside,
+// on the faces of, and beside its bounding box.
+struct CullingBenchmark
+{
+    CullingBenchmark( const uint64_t seed, const Vector3i& region_chunks = Vector3i( 48, 8, 48 ), const unsigned frames_per_path = 500 );
+
+    // Returns true if the two culling methods agreed in every frame, if every RenderList was
+    // submitted in a consistent order, if no Chunk was wrongly occluded, and if no Section
+    // drew the wrong ranges of opaque faces.
+    bool run();
+
+protected:
+
+    enum CameraPath
+    {
+        CAMERA_PATH_SPIN,
+        CAMERA_PATH_WALK,
+        CAMERA_PATH_FLYOVER,
+        NUM_CAMERA_PATHS
+    };
+
+    typedef std::vector<Vector3i> PositionV;
+    typedef std::map<Vector3i, AABoxf, VectorLess<Vector3i> > ChunkBoundsMap;
+
+    void get_camera(
+        const CameraPath path,
+        const Scalar t,
+        Vector3f& position,
+        gmtl::Matrix44f& modelview,
+        gmtl::Matrix44f& projection
+    ) const;
+
+    bool check_render_list( const Vector3f& camera_position, const PositionV& visible );
+    bool check_occlusion();
+    bool check_opaque_ranges();
+    void toggle_random_chunk();
+
+    Vector3i region_chunks_;
+
+    unsigned frames_per_path_;
+
+    boost::rand48 generator_;
+
+    ChunkBoundsMap chunks_;
+
+    ChunkHierarchy<Vector3i> chunk_hierarchy_;
+
+    OcclusionBuffer occlusion_buffer_;
+
+    RenderList render_list_;
+};
+
+#endif // CULLING_BENCHMARK_H
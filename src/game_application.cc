@@ -24,12 +24,51 @@
 # include <boost/random/linear_congruential.hpp>
 #endif
 
+#include <queue>
+
 #include <boost/foreach.hpp>
 
 #include "log.h"
 #include "timer.h"
 #include "game_application.h"
 
+//////////////////////////////////////////////////////////////////////////////////
+// Local definitions:
+//////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+// The meshes of the visible Chunks are uploaded first, and the nearest ones first among
+// those and among the rest.
+struct PendingUpload
+{
+    PendingUpload( const bool visible, const Scalar distance_squared, const ChunkMeshSP& mesh ) :
+        visible_( visible ),
+        distance_squared_( distance_squared ),
+        mesh_( mesh )
+    {
+    }
+
+    // The std::priority_queue pops the greatest element first.
+    bool operator<( const PendingUpload& other ) const
+    {
+        if ( visible_ != other.visible_ )
+        {
+            return other.visible_;
+        }
+
+        return distance_squared_ > other.distance_squared_;
+    }
+
+    bool visible_;
+
+    Scalar distance_squared_;
+
+    ChunkMeshSP mesh_;
+};
+
+} // anonymous namespace
+
 //////////////////////////////////////////////////////////////////////////////////
 // Function definitions for GameApplication:
 //////////////////////////////////////////////////////////////////////////////////
@@ -53,7 +92,7 @@ GameApplication::GameApplication( SDL_GL_Window &window ) :
 
     BOOST_FOREACH( const ChunkMap::value_type& chunk_it, world_.get_chunks() )
     {
-        renderer_.note_chunk_changes( *chunk_it.second );
+        renderer_.note_chunk_changes( ChunkMesh( *chunk_it.second ) );
     }
 
     SCOPE_TIMER_END
@@ -76,12 +115,12 @@ void GameApplication::main_loop()
     {
         const double elapsed = frame_timer.get_seconds_elapsed();
         process_events();
-        handle_chunk_changes();
 
         if ( elapsed >= FRAME_INTERVAL )
         {
             do_one_step( elapsed );
             schedule_chunk_update();
+            handle_chunk_changes();
             render();
             frame_timer.reset();
         }
@@ -122,6 +161,11 @@ PlayerInputRouter& GameApplication::get_input_router()
     return input_router_;
 }
 
+Renderer& GameApplication::get_renderer()
+{
+    return renderer_;
+}
+
 void GameApplication::process_events()
 {
     SDL_Event event;
@@ -417,32 +461,117 @@ void GameApplication::schedule_chunk_update()
 
     if ( chunk_guard.try_lock() && chunk_updater_.wait( not_long ) )
     {
-        updated_chunks_ = world_.get_updated_chunks();
-
         if ( world_.chunk_update_needed() )
         {
-            chunk_updater_.schedule( boost::bind( &World::update_chunks, boost::ref( world_ ) ) );
+            chunk_updater_.schedule( boost::bind( &GameApplication::update_chunks, this ) );
+        }
+
+        // The meshes that the Renderer evicted, but needs again, are rebuilt on the Chunk
+        // updater thread as well.
+        Vector3iV restore_positions;
+        renderer_.take_restore_requests( restore_positions );
+
+        if ( !restore_positions.empty() )
+        {
+            chunk_updater_.schedule( boost::bind( &GameApplication::restore_chunks, this, restore_positions ) );
         }
     }
 }
 
-void GameApplication::handle_chunk_changes()
+void GameApplication::update_chunks()
 {
-    if ( !updated_chunks_.empty() )
+    world_.update_chunks();
+
+    ChunkSet updated_chunks;
+
     {
         World::ChunkGuard chunk_guard( world_.get_chunk_lock() );
+        updated_chunks = world_.get_updated_chunks();
+    }
 
-        SCOPE_TIMER_BEGIN( "Updating chunk VBOs" )
+    // The meshes are built here, on the Chunk updater thread, so that the main thread only
+    // has to upload them.  The Chunk lock is taken separately for each Chunk, so that the
+    // main thread is never kept waiting for long.
+    ChunkMeshV meshes;
+    meshes.reserve( updated_chunks.size() );
 
-        BOOST_FOREACH( Chunk* chunk, updated_chunks_ )
+    BOOST_FOREACH( Chunk* chunk, updated_chunks )
+    {
+        World::ChunkGuard chunk_guard( world_.get_chunk_lock() );
+        meshes.push_back( ChunkMeshSP( new ChunkMesh( *chunk ) ) );
+    }
+
+    boost::lock_guard<boost::mutex> mesh_guard( mesh_lock_ );
+    updated_meshes_.insert( updated_meshes_.end(), meshes.begin(), meshes.end() );
+}
+
+void GameApplication::restore_chunks( const Vector3iV& positions )
+{
+    ChunkMeshV meshes;
+    meshes.reserve( positions.size() );
+
+    BOOST_FOREACH( const Vector3i& position, positions )
+    {
+        World::ChunkGuard chunk_guard( world_.get_chunk_lock() );
+        ChunkMap::const_iterator chunk_it = world_.get_chunks().find( position );
+
+        if ( chunk_it != world_.get_chunks().end() )
         {
-            renderer_.note_chunk_changes( *chunk );
+            meshes.push_back( ChunkMeshSP( new ChunkMesh( *chunk_it->second ) ) );
         }
+    }
+
+    boost::lock_guard<boost::mutex> mesh_guard( mesh_lock_ );
+    updated_meshes_.insert( updated_meshes_.end(), meshes.begin(), meshes.end() );
+}
+
+void GameApplication::handle_chunk_changes()
+{
+    ChunkMeshV meshes;
+
+    {
+        boost::lock_guard<boost::mutex> mesh_guard( mesh_lock_ );
+        meshes.swap( updated_meshes_ );
+    }
+
+    // The meshes arrive in the order they were built, so a newer mesh for a Chunk replaces
+    // the one that is still waiting.
+    BOOST_FOREACH( const ChunkMeshSP& mesh, meshes )
+    {
+        pending_meshes_[mesh->position_] = mesh;
+    }
+
+    if ( pending_meshes_.empty() )
+    {
+        return;
+    }
+
+    const Vector3f camera_position = player_.get_eye_position();
+
+    std::priority_queue<PendingUpload> uploads;
+
+    BOOST_FOREACH( const ChunkMeshMap::value_type& mesh_it, pending_meshes_ )
+    {
+        const Vector3f centroid =
+            vector_cast<Scalar>( mesh_it.first ) +
+            vector_cast<Scalar>( Chunk::SIZE ) / 2.0f;
+
+        uploads.push( PendingUpload(
+            renderer_.was_chunk_visible( mesh_it.first ),
+            gmtl::lengthSquared( Vector3f( centroid - camera_position ) ),
+            mesh_it.second ) );
+    }
 
-        updated_chunks_.clear();
+    HighResolutionTimer upload_timer;
 
-        SCOPE_TIMER_END
+    do
+    {
+        const ChunkMeshSP& mesh = uploads.top().mesh_;
+        renderer_.note_chunk_changes( *mesh );
+        pending_meshes_.erase( mesh->position_ );
+        uploads.pop();
     }
+    while ( !uploads.empty() && upload_timer.get_seconds_elapsed() < UPLOAD_BUDGET );
 }
 
 void GameApplication::do_one_step( const float step_time )
@@ -507,7 +636,18 @@ void GameApplication::render()
     renderer_.render( window_, camera, world_ );
 #endif
 
-    debug_info_window.set_engine_chunk_stats( renderer_.get_num_chunks_drawn(), world_.get_chunks().size(), renderer_.get_num_triangles_drawn() );
+    debug_info_window.set_engine_chunk_stats(
+        renderer_.get_num_chunks_drawn(),
+        renderer_.get_num_chunks_near(),
+        renderer_.get_num_chunks_far(),
+        renderer_.get_num_chunks_hidden(),
+        renderer_.get_num_chunks_occluded(),
+        world_.get_chunks().size(),
+        renderer_.get_num_triangles_drawn()
+    );
+#ifdef DEBUG_GL_CALLS
+    debug_info_window.set_engine_gl_calls( renderer_.get_num_gl_calls(), renderer_.get_num_gl_draw_calls() );
+#endif
     debug_info_window.set_current_material( get_block_material_attributes( player_.get_material_selection() ).name_ );
 
     gui_.render();
@@ -19,9 +19,11 @@
 #ifndef GAME_APPLICATION_H
 #define GAME_APPLICATION_H
 
+#include <map>
 #include <vector>
 
 #include <boost/threadpool.hpp>
+#include <boost/thread/mutex.hpp>
 
 #include "sdl_gl_window.h"
 #include "renderer.h"
@@ -41,11 +43,16 @@ struct GameApplication
     void reroute_input( const PlayerInputAction reroute_action );
 
     PlayerInputRouter& get_input_router();
+    Renderer& get_renderer();
 
 protected:
 
     static const double FRAME_INTERVAL = 1.0 / 60.0;
 
+    // At most this much of each frame is spent uploading the changed Chunk meshes, except
+    // that at least one is always uploaded, so that they are all eventually uploaded.
+    static const double UPLOAD_BUDGET = 0.004;
+
     enum InputMode
     {
         INPUT_MODE_GUI,
@@ -67,6 +74,8 @@ protected:
     void toggle_fullscreen();
 
     void schedule_chunk_update();
+    void update_chunks();
+    void restore_chunks( const Vector3iV& positions );
     void handle_chunk_changes();
 
     void do_one_step( const float step_time );
@@ -98,9 +107,19 @@ protected:
 
     bool gui_focused_;
 
-    boost::threadpool::pool chunk_updater_;
+    // The ChunkMeshes are built by the Chunk updater thread, and are uploaded by the main
+    // thread.  The mesh lock must be held while accessing them.
+    ChunkMeshV updated_meshes_;
+
+    boost::mutex mesh_lock_;
 
-    ChunkSet updated_chunks_;
+    // These are the meshes that are waiting for their turn to be uploaded.  Only the newest
+    // mesh for each Chunk is kept, and until it is uploaded, the old one is drawn.
+    typedef std::map<Vector3i, ChunkMeshSP, VectorLess<Vector3i> > ChunkMeshMap;
+    ChunkMeshMap pending_meshes_;
+
+    // This is declared last so that it is destroyed (and thus joined) first.
+    boost::threadpool::pool chunk_updater_;
 };
 
 #endif // GAME_APPLICATION_H
@@ -0,0 +1,111 @@
+///////////////////////////////////////////////////////////////////////////
+// Copyright 2011 Evan Mezeske.
+//
+// This file is part of Digbuild.
+// 
+// Digbuild is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.
+// 
+// Digbuild is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with Digbuild.  If not, see <http://www.gnu.org/licenses/>.
+///////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+
+#include <boost/foreach.hpp>
+#include <boost/random/uniform_int.hpp>
+#include <boost/random/variate_generator.hpp>
+#include <boost/thread.hpp>
+
+#include "world_generator.h"
+#include "chunk_hierarchy.h"
+#include "generated_region.h"
+
+//////////////////////////////////////////////////////////////////////////////////
+// Local definitions:
+//////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+bool chunk_height_order( const Chunk* a, const Chunk* b )
+{
+    return a->get_position()[1] > b->get_position()[1];
+}
+
+} // anonymous namespace
+
+//////////////////////////////////////////////////////////////////////////////////
+// Function definitions for GeneratedRegion:
+//////////////////////////////////////////////////////////////////////////////////
+
+GeneratedRegion::GeneratedRegion( const uint64_t world_seed ) :
+    generator_( world_seed )
+{
+    WorldGenerator world_generator( world_seed );
+    boost::threadpool::pool worker_pool( std::max( boost::thread::hardware_concurrency(), 1u ) );
+    ChunkSPV region = world_generator.generate_region( Vector2i( 0, 0 ), worker_pool );
+
+    BOOST_FOREACH( ChunkSP chunk, region )
+    {
+        chunk_stitch_into_map( chunk, chunks_ );
+        chunks_top_down_.push_back( chunk.get() );
+    }
+
+    std::sort( chunks_top_down_.begin(), chunks_top_down_.end(), chunk_height_order );
+}
+
+void GeneratedRegion::relight()
+{
+    BOOST_FOREACH( Chunk* chunk, chunks_top_down_ )
+    {
+        chunk->reset_lighting();
+    }
+
+    BOOST_FOREACH( Chunk* chunk, chunks_top_down_ )
+    {
+        chunk->apply_lighting_to_self();
+    }
+
+    BOOST_FOREACH( Chunk* chunk, chunks_top_down_ )
+    {
+        chunk->apply_lighting_to_neighbors();
+    }
+}
+
+void GeneratedRegion::make_random_edits( const BlockMaterial* materials, const unsigned num_materials, const unsigned num_edits )
+{
+    boost::variate_generator<boost::rand48&, boost::uniform_int<> >
+        chunk_random( generator_, boost::uniform_int<>( 0, chunks_top_down_.size() - 1 ) ),
+        material_random( generator_, boost::uniform_int<>( 0, num_materials - 1 ) ),
+        x_random( generator_, boost::uniform_int<>( 0, Chunk::SIZE_X - 1 ) ),
+        y_random( generator_, boost::uniform_int<>( 0, Chunk::SIZE_Y - 1 ) ),
+        z_random( generator_, boost::uniform_int<>( 0, Chunk::SIZE_Z - 1 ) );
+
+    for ( unsigned i = 0; i < num_edits; ++i )
+    {
+        Chunk& chunk = *chunks_top_down_[chunk_random()];
+        const Vector3i index( x_random(), y_random(), z_random() );
+        chunk.get_block( index ).set_material( materials[material_random()] );
+    }
+}
+
+Chunk* GeneratedRegion::find_chunk( const Vector3i& position, Vector3i& index ) const
+{
+    // The Chunks are all the same size along each axis, like the cells of the ChunkHierarchy.
+    const Vector3i chunk_position = get_cell_index( position, Chunk::SIZE_X ) * Chunk::SIZE_X;
+    ChunkMap::const_iterator chunk_it = chunks_.find( chunk_position );
+
+    if ( chunk_it == chunks_.end() )
+    {
+        return 0;
+    }
+
+    index = position - chunk_position;
+    return chunk_it->second.get();
+}
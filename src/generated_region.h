@@ -0,0 +1,57 @@
+///////////////////////////////////////////////////////////////////////////
+// Copyright 2011 Evan Mezeske.
+//
+// This file is part of Digbuild.
+// 
+// Digbuild is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.
+// 
+// Digbuild is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with Digbuild.  If not, see <http://www.gnu.org/licenses/>.
+///////////////////////////////////////////////////////////////////////////
+
+#ifndef GENERATED_REGION_H
+#define GENERATED_REGION_H
+
+#include <boost/random/linear_congruential.hpp>
+
+#include "chunk.h"
+
+// A GeneratedRegion is a region of Chunks generated from a world seed and stitched together
+// without a World around them, so that the headless checks can light and edit them directly.
+struct GeneratedRegion
+{
+    GeneratedRegion( const uint64_t world_seed );
+
+    // Relights every Chunk from scratch, in the same stages that the World lights them in.
+    void relight();
+
+    // Sets randomly chosen Blocks throughout the region to randomly chosen materials from
+    // the given list.
+    void make_random_edits( const BlockMaterial* materials, const unsigned num_materials, const unsigned num_edits );
+
+    // Returns the Chunk that contains the given position, or null if it is past the edge of
+    // the region.  The position of the Block within the Chunk is stored in 'index'.
+    Chunk* find_chunk( const Vector3i& position, Vector3i& index ) const;
+
+    const ChunkMap& get_chunks() const { return chunks_; }
+
+    // The sunlight must be reset from the top of each column downward.
+    const ChunkV& get_chunks_top_down() const { return chunks_top_down_; }
+
+protected:
+
+    boost::rand48 generator_;
+
+    ChunkMap chunks_;
+
+    ChunkV chunks_top_down_;
+};
+
+#endif // GENERATED_REGION_H
@@ -0,0 +1,31 @@
+///////////////////////////////////////////////////////////////////////////
+// Copyright 2011 Evan Mezeske.
+//
+// This file is part of Digbuild.
+// 
+// Digbuild is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.
+// 
+// Digbuild is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with Digbuild.  If not, see <http://www.gnu.org/licenses/>.
+///////////////////////////////////////////////////////////////////////////
+
+#ifdef DEBUG_GL_CALLS
+
+#include "gl_call_counter.h"
+
+//////////////////////////////////////////////////////////////////////////////////
+// Static definitions for GLCallCounter:
+//////////////////////////////////////////////////////////////////////////////////
+
+unsigned long
+    GLCallCounter::num_calls_ = 0,
+    GLCallCounter::num_draw_calls_ = 0;
+
+#endif // DEBUG_GL_CALLS
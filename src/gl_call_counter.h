@@ -0,0 +1,78 @@
+///////////////////////////////////////////////////////////////////////////
+// Copyright 2011 Evan Mezeske.
+//
+// This file is part of Digbuild.
+// 
+// Digbuild is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.
+// 
+// Digbuild is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with Digbuild.  If not, see <http://www.gnu.org/licenses/>.
+///////////////////////////////////////////////////////////////////////////
+
+#ifndef GL_CALL_COUNTER_H
+#define GL_CALL_COUNTER_H
+
+#ifdef DEBUG_GL_CALLS
+
+#include <GL/glew.h>
+
+// When DEBUG_GL_CALLS is defined, the GL functions used to draw the Chunks are redirected
+// through the GLCallCounter in each file that includes this header, so that the number of
+// calls made per frame can be reported.  It must be included after all of the other headers.
+struct GLCallCounter
+{
+    static unsigned long
+        num_calls_,
+        num_draw_calls_;
+};
+
+#define COUNT_GL_CALL( function ) ( ++GLCallCounter::num_calls_, function )
+#define COUNT_GL_DRAW_CALL( function ) ( ++GLCallCounter::num_draw_calls_, COUNT_GL_CALL( function ) )
+
+// The OpenGL 1.1 functions are called directly.
+#define glBindTexture COUNT_GL_CALL( glBindTexture )
+#define glDrawElements COUNT_GL_DRAW_CALL( glDrawElements )
+#define glLoadIdentity COUNT_GL_CALL( glLoadIdentity )
+#define glMatrixMode COUNT_GL_CALL( glMatrixMode )
+#define glScalef COUNT_GL_CALL( glScalef )
+#define glTranslatef COUNT_GL_CALL( glTranslatef )
+
+// The rest of them are loaded by GLEW.
+#undef glActiveTexture
+#undef glBindBuffer
+#undef glBindVertexArray
+#undef glBufferData
+#undef glDisableVertexAttribArray
+#undef glEnableVertexAttribArray
+#undef glGetUniformLocation
+#undef glMultiDrawElementsBaseVertex
+#undef glUniform1f
+#undef glUniform1i
+#undef glUniform3f
+#undef glUseProgram
+#undef glVertexAttribPointer
+
+#define glActiveTexture COUNT_GL_CALL( GLEW_GET_FUN( __glewActiveTexture ) )
+#define glBindBuffer COUNT_GL_CALL( GLEW_GET_FUN( __glewBindBuffer ) )
+#define glBindVertexArray COUNT_GL_CALL( GLEW_GET_FUN( __glewBindVertexArray ) )
+#define glBufferData COUNT_GL_CALL( GLEW_GET_FUN( __glewBufferData ) )
+#define glDisableVertexAttribArray COUNT_GL_CALL( GLEW_GET_FUN( __glewDisableVertexAttribArray ) )
+#define glEnableVertexAttribArray COUNT_GL_CALL( GLEW_GET_FUN( __glewEnableVertexAttribArray ) )
+#define glGetUniformLocation COUNT_GL_CALL( GLEW_GET_FUN( __glewGetUniformLocation ) )
+#define glMultiDrawElementsBaseVertex COUNT_GL_DRAW_CALL( GLEW_GET_FUN( __glewMultiDrawElementsBaseVertex ) )
+#define glUniform1f COUNT_GL_CALL( GLEW_GET_FUN( __glewUniform1f ) )
+#define glUniform1i COUNT_GL_CALL( GLEW_GET_FUN( __glewUniform1i ) )
+#define glUniform3f COUNT_GL_CALL( GLEW_GET_FUN( __glewUniform3f ) )
+#define glUseProgram COUNT_GL_CALL( GLEW_GET_FUN( __glewUseProgram ) )
+#define glVertexAttribPointer COUNT_GL_CALL( GLEW_GET_FUN( __glewVertexAttribPointer ) )
+
+#endif // DEBUG_GL_CALLS
+
+#endif // GL_CALL_COUNTER_H
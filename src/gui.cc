@@ -67,19 +67,33 @@ DebugInfoWindow::DebugInfoWindow() :
     AG_ExpandHoriz( fps_label_ );
     AG_WidgetUpdate( fps_label_ );
 
-    chunks_label_ = AG_LabelNewS( window_, 0, "Chunks: 0/0" );
+    chunks_label_ = AG_LabelNewS( window_, 0, "Chunks: 0/0 (Near: 0, Far: 0)" );
     AG_ExpandHoriz( chunks_label_ );
     AG_WidgetUpdate( chunks_label_ );
 
+    culled_chunks_label_ = AG_LabelNewS( window_, 0, "Hidden Chunks: 0, Occluded: 0" );
+    AG_ExpandHoriz( culled_chunks_label_ );
+    AG_WidgetUpdate( culled_chunks_label_ );
+
     triangles_label_ = AG_LabelNewS( window_, 0, "Triangles: 0" );
     AG_ExpandHoriz( triangles_label_ );
     AG_WidgetUpdate( triangles_label_ );
 
+#ifdef DEBUG_GL_CALLS
+    gl_calls_label_ = AG_LabelNewS( window_, 0, "GL Calls: 0, Draw Calls: 0" );
+    AG_ExpandHoriz( gl_calls_label_ );
+    AG_WidgetUpdate( gl_calls_label_ );
+#endif
+
     current_material_label_ = AG_LabelNewS( window_, 0, "Current Material: None" );
     AG_ExpandHoriz( current_material_label_ );
     AG_WidgetUpdate( current_material_label_ );
 
-    AG_WindowSetGeometry( window_, 0, 0, 300, 128 );
+#ifdef DEBUG_GL_CALLS
+    AG_WindowSetGeometry( window_, 0, 0, 300, 180 );
+#else
+    AG_WindowSetGeometry( window_, 0, 0, 300, 160 );
+#endif
     AG_WindowSetPosition( window_, AG_WINDOW_TL, 0 );
     AG_WindowShow( window_ );
 }
@@ -89,12 +103,28 @@ void DebugInfoWindow::set_engine_fps( const unsigned fps )
     AG_LabelText( fps_label_, "FPS: %d", fps );
 }
 
-void DebugInfoWindow::set_engine_chunk_stats( const unsigned chunks_drawn, const unsigned chunks_total, const unsigned triangles_drawn )
+void DebugInfoWindow::set_engine_chunk_stats(
+    const unsigned chunks_drawn,
+    const unsigned chunks_near,
+    const unsigned chunks_far,
+    const unsigned chunks_hidden,
+    const unsigned chunks_occluded,
+    const unsigned chunks_total,
+    const unsigned triangles_drawn
+)
 {
-    AG_LabelText( chunks_label_, "Chunks: %d/%d", chunks_drawn, chunks_total );
+    AG_LabelText( chunks_label_, "Chunks: %d/%d (Near: %d, Far: %d)", chunks_drawn, chunks_total, chunks_near, chunks_far );
+    AG_LabelText( culled_chunks_label_, "Hidden Chunks: %d, Occluded: %d", chunks_hidden, chunks_occluded );
     AG_LabelText( triangles_label_, "Triangles: %d", triangles_drawn );
 }
 
+#ifdef DEBUG_GL_CALLS
+void DebugInfoWindow::set_engine_gl_calls( const unsigned long gl_calls, const unsigned long gl_draw_calls )
+{
+    AG_LabelText( gl_calls_label_, "GL Calls: %lu, Draw Calls: %lu", gl_calls, gl_draw_calls );
+}
+#endif
+
 void DebugInfoWindow::set_current_material( const std::string& current_material )
 {
     AG_LabelText( current_material_label_, "Current Material: %s", current_material.c_str() );
@@ -202,6 +232,17 @@ void GraphicsSettingsWindow::todo( AG_Event* event )
     GameApplication* application = static_cast<GameApplication*>( AG_PTR_NAMED( "application" ) );
 }
 
+void GraphicsSettingsWindow::renderer_settings_changed( AG_Event* event )
+{
+    GameApplication* application = static_cast<GameApplication*>( AG_PTR_NAMED( "application" ) );
+    GraphicsSettingsWindow* graphics_settings_window = static_cast<GraphicsSettingsWindow*>( AG_PTR_NAMED( "graphics_settings_window" ) );
+
+    Renderer& renderer = application->get_renderer();
+    renderer.set_lod_distance( Scalar( graphics_settings_window->lod_distance_ ) );
+    renderer.set_far_distance( Scalar( graphics_settings_window->far_distance_ ) );
+    renderer.set_gpu_memory_budget( size_t( graphics_settings_window->gpu_memory_budget_ ) * 1024 * 1024 );
+}
+
 //////////////////////////////////////////////////////////////////////////////////
 // Member function definitions for GraphicsSettingsWindow:
 //////////////////////////////////////////////////////////////////////////////////
@@ -209,9 +250,9 @@ void GraphicsSettingsWindow::todo( AG_Event* event )
 GraphicsSettingsWindow::GraphicsSettingsWindow( GameApplication& application ) :
     Window( "Graphics Settings", false )
 {
-    AG_WindowSetGeometry( window_, 0, 0, 600, 128 );
+    AG_WindowSetGeometry( window_, 0, 0, 600, 192 );
 
-    AG_Box* rows[2];
+    AG_Box* rows[4];
 
     for ( unsigned i = 0; i < sizeof( rows ) / sizeof( AG_Box* ); ++i )
     {
@@ -244,6 +285,21 @@ GraphicsSettingsWindow::GraphicsSettingsWindow( GameApplication& application ) :
     draw_distance_ = 250;
     AG_SliderNewIntR( rows[1], AG_SLIDER_HORIZ, AG_SLIDER_HFILL, &draw_distance_, 1, 500 );
 
+    add_label( rows[2], "Full Resolution Distance" );
+    lod_distance_ = int( Renderer::DEFAULT_LOD_DISTANCE );
+    AG_SetEvent( AG_SliderNewIntR( rows[2], AG_SLIDER_HORIZ, AG_SLIDER_HFILL, &lod_distance_, 16, 256 ), "slider-changed",
+        &GraphicsSettingsWindow::renderer_settings_changed, "%p(application) %p(graphics_settings_window)", &application, this );
+
+    add_label( rows[2], "Detail Distance" );
+    far_distance_ = int( Renderer::DEFAULT_FAR_DISTANCE );
+    AG_SetEvent( AG_SliderNewIntR( rows[2], AG_SLIDER_HORIZ, AG_SLIDER_HFILL, &far_distance_, 16, 256 ), "slider-changed",
+        &GraphicsSettingsWindow::renderer_settings_changed, "%p(application) %p(graphics_settings_window)", &application, this );
+
+    add_label( rows[3], "GPU Memory (MB)" );
+    gpu_memory_budget_ = int( Renderer::DEFAULT_GPU_MEMORY_BUDGET / ( 1024 * 1024 ) );
+    AG_SetEvent( AG_SliderNewIntR( rows[3], AG_SLIDER_HORIZ, AG_SLIDER_HFILL, &gpu_memory_budget_, 64, 2048 ), "slider-changed",
+        &GraphicsSettingsWindow::renderer_settings_changed, "%p(application) %p(graphics_settings_window)", &application, this );
+
     // AG_SeparatorNew( window_, AG_SEPARATOR_HORIZ );
     // AG_ButtonNewFn( window_, 0, "Apply", &InputSettingsWindow::reset_to_defaults,
     //     "%p(application) %p(input_settings_window)", &application, this );
@@ -52,14 +52,29 @@ struct DebugInfoWindow : public Window
     DebugInfoWindow();
 
     void set_engine_fps( const unsigned fps );
-    void set_engine_chunk_stats( const unsigned chunks_drawn, const unsigned chunks_total, const unsigned triangles_drawn );
+    void set_engine_chunk_stats(
+        const unsigned chunks_drawn,
+        const unsigned chunks_near,
+        const unsigned chunks_far,
+        const unsigned chunks_hidden,
+        const unsigned chunks_occluded,
+        const unsigned chunks_total,
+        const unsigned triangles_drawn
+    );
+#ifdef DEBUG_GL_CALLS
+    void set_engine_gl_calls( const unsigned long gl_calls, const unsigned long gl_draw_calls );
+#endif
     void set_current_material( const std::string& material );
 
 protected:
 
     AG_Label* fps_label_;
     AG_Label* chunks_label_;
+    AG_Label* culled_chunks_label_;
     AG_Label* triangles_label_;
+#ifdef DEBUG_GL_CALLS
+    AG_Label* gl_calls_label_;
+#endif
     AG_Label* current_material_label_;
 };
 
@@ -91,10 +106,19 @@ struct GraphicsSettingsWindow : public Window
 protected:
 
     static void todo( AG_Event* event );
+    static void renderer_settings_changed( AG_Event* event );
 
     void add_label( AG_Box* parent, const std::string& label );
 
     int draw_distance_;
+
+    // These are in meters.
+    int
+        lod_distance_,
+        far_distance_;
+
+    // This is in megabytes.
+    int gpu_memory_budget_;
 };
 
 typedef boost::shared_ptr<GraphicsSettingsWindow> GraphicsSettingsWindowSP;
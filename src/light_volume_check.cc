@@ -0,0 +1,200 @@
+///////////////////////////////////////////////////////////////////////////
+// Copyright 2011 Evan Mezeske.
+//
+// This file is part of Digbuild.
+// 
+// Digbuild is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.
+// 
+// Digbuild is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with Digbuild.  If not, see <http://www.gnu.org/licenses/>.
+///////////////////////////////////////////////////////////////////////////
+
+
+#include <boost/foreach.hpp>
+
+#include "log.h"
+#include "light_volume_check.h"
+
+#ifdef LIGHT_VOLUMES
+
+//////////////////////////////////////////////////////////////////////////////////
+// Local definitions:
+//////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+// LightVolumeTexture::update() hands each array straight to glTexSubImage3D() as tightly
+// packed RGB texels, with X varying fastest, then Y, then Z.
+uint8_t get_texel( const uint8_t* texels, const Vector3i& texel, const int component )
+{
+    const int offset =
+        ( ( texel[2] * Chunk::LightVolume::SIZE_Y + texel[1] ) * Chunk::LightVolume::SIZE_X + texel[0] ) *
+        Chunk::LightVolume::NUM_COMPONENTS + component;
+
+    return texels[offset];
+}
+
+uint8_t scale_level( const int level )
+{
+    return uint8_t( level * Chunk::LightVolume::MAX_LEVEL / Block::MAX_LIGHT_COMPONENT_LEVEL );
+}
+
+} // anonymous namespace
+
+//////////////////////////////////////////////////////////////////////////////////
+// Function definitions for LightVolumeCheck:
+//////////////////////////////////////////////////////////////////////////////////
+
+LightVolumeCheck::LightVolumeCheck( const uint64_t world_seed, const unsigned num_rounds, const unsigned edits_per_round ) :
+    num_rounds_( num_rounds ),
+    edits_per_round_( edits_per_round ),
+    region_( world_seed )
+{
+}
+
+bool LightVolumeCheck::run()
+{
+    // The textures are uploaded without any row padding, so the arrays must not have any.
+    assert( sizeof( volume_.light_ ) == size_t( Chunk::LightVolume::SIZE_X * Chunk::LightVolume::SIZE_Y *
+                                                Chunk::LightVolume::SIZE_Z * Chunk::LightVolume::NUM_COMPONENTS ) );
+    assert( sizeof( volume_.sunlight_ ) == sizeof( volume_.light_ ) );
+
+    // The brightest Block must map onto the brightest texel.
+    if ( scale_level( Block::MAX_LIGHT_COMPONENT_LEVEL ) != Chunk::LightVolume::MAX_LEVEL )
+    {
+        LOG( "The brightest light level does not scale to the brightest texel." );
+        return false;
+    }
+
+    unsigned total_mismatches = 0;
+
+    // Round zero checks the freshly generated region, before any edits are made.
+    for ( unsigned round = 0; round <= num_rounds_; ++round )
+    {
+        if ( round > 0 )
+        {
+            make_random_edits();
+        }
+
+        region_.relight();
+
+        unsigned mismatches = 0;
+
+        BOOST_FOREACH( Chunk* chunk, region_.get_chunks_top_down() )
+        {
+            mismatches += check_chunk( *chunk );
+        }
+
+        LOG( "Round " << round << ": " << mismatches << " mismatched texels" );
+
+        total_mismatches += mismatches;
+    }
+
+    LOG( "Checked the light volumes of " << region_.get_chunks().size() << " chunks " << num_rounds_ + 1 << " times: "
+         << total_mismatches << " mismatched texels" );
+
+    return total_mismatches == 0;
+}
+
+unsigned LightVolumeCheck::check_chunk( const Chunk& chunk )
+{
+    const unsigned MAX_REPORTED_MISMATCHES = 10;
+    unsigned mismatches = 0;
+
+    chunk.get_light_volume( volume_ );
+
+    const uint8_t
+        *light_texels = &volume_.light_[0][0][0][0],
+        *sunlight_texels = &volume_.sunlight_[0][0][0][0];
+
+    for ( int x = 0; x < Chunk::LightVolume::SIZE_X; ++x )
+    {
+        for ( int y = 0; y < Chunk::LightVolume::SIZE_Y; ++y )
+        {
+            for ( int z = 0; z < Chunk::LightVolume::SIZE_Z; ++z )
+            {
+                // The first texel stands for the Block just outside of the Chunk's corner.
+                const Vector3i texel( x, y, z );
+                const Vector3i position = chunk.get_position() + texel -
+                    Vector3i( Chunk::LightVolume::BORDER, Chunk::LightVolume::BORDER, Chunk::LightVolume::BORDER );
+
+                Vector3i
+                    light_level,
+                    sunlight_level;
+
+                get_expected_levels( position, light_level, sunlight_level );
+
+                bool matches = true;
+
+                for ( int i = 0; i < Chunk::LightVolume::NUM_COMPONENTS; ++i )
+                {
+                    matches = matches &&
+                        get_texel( light_texels, texel, i ) == scale_level( light_level[i] ) &&
+                        get_texel( sunlight_texels, texel, i ) == scale_level( sunlight_level[i] );
+                }
+
+                if ( !matches && ++mismatches <= MAX_REPORTED_MISMATCHES )
+                {
+                    LOG( "Mismatch at texel " << texel << " of the chunk at " << chunk.get_position()
+                         << ": expected light " << light_level << ", sunlight " << sunlight_level );
+                }
+            }
+        }
+    }
+
+    return mismatches;
+}
+
+void LightVolumeCheck::get_expected_levels( const Vector3i& position, Vector3i& light_level, Vector3i& sunlight_level ) const
+{
+    Vector3i index;
+    Chunk* chunk = region_.find_chunk( position, index );
+
+    // Past the edge of the region everything is open to the sky, and opaque Blocks let
+    // no light through at all.
+    if ( !chunk )
+    {
+        light_level = Block::MIN_LIGHT_LEVEL;
+        sunlight_level = Block::MAX_LIGHT_LEVEL;
+        return;
+    }
+
+    const Block& block = chunk->get_block( index );
+
+    if ( block.is_translucent() )
+    {
+        light_level = block.get_light_level();
+        sunlight_level = block.get_sunlight_level();
+    }
+    else
+    {
+        light_level = Block::MIN_LIGHT_LEVEL;
+        sunlight_level = Block::MIN_LIGHT_LEVEL;
+    }
+}
+
+void LightVolumeCheck::make_random_edits()
+{
+    // The light sources and colored filters make the levels differ between components.
+    const BlockMaterial EDIT_MATERIALS[] =
+    {
+        BLOCK_MATERIAL_AIR,
+        BLOCK_MATERIAL_STONE,
+        BLOCK_MATERIAL_LAVA,
+        BLOCK_MATERIAL_GLASS_RED,
+        BLOCK_MATERIAL_GLASS_BLUE
+    };
+
+    const int NUM_EDIT_MATERIALS = sizeof( EDIT_MATERIALS ) / sizeof( BlockMaterial );
+
+    region_.make_random_edits( EDIT_MATERIALS, NUM_EDIT_MATERIALS, edits_per_round_ );
+}
+
+#endif
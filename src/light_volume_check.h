@@ -0,0 +1,56 @@
+///////////////////////////////////////////////////////////////////////////
+// Copyright 2011 Evan Mezeske.
+//
+// This file is part of Digbuild.
+// 
+// Digbuild is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.
+// 
+// Digbuild is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with Digbuild.  If not, see <http://www.gnu.org/licenses/>.
+///////////////////////////////////////////////////////////////////////////
+
+
+#ifndef LIGHT_VOLUME_CHECK_H
+#define LIGHT_VOLUME_CHECK_H
+
+#include "generated_region.h"
+
+#ifdef LIGHT_VOLUMES
+// The LightVolumeCheck is a headless check of the LightVolumes that the renderer uploads
+// when LIGHT_VOLUMES is defined.  It lights a generated region, and checks that every
+// texel of every Chunk's LightVolume holds the scaled light levels of the Block that it
+// stands for, including the border texels that come from the neighboring Chunks and the
+// ones past the edge of the region.  The texels are read back in the same memory order
+// that LightVolumeTexture::update() uploads them in.  This is repeated after rounds of
+// random Block edits.
+struct LightVolumeCheck
+{
+    LightVolumeCheck( const uint64_t world_seed, const unsigned num_rounds = 4, const unsigned edits_per_round = 64 );
+
+    // Returns true if every texel held the expected levels in every round.
+    bool run();
+
+protected:
+
+    unsigned check_chunk( const Chunk& chunk );
+    void get_expected_levels( const Vector3i& position, Vector3i& light_level, Vector3i& sunlight_level ) const;
+    void make_random_edits();
+
+    unsigned
+        num_rounds_,
+        edits_per_round_;
+
+    GeneratedRegion region_;
+
+    Chunk::LightVolume volume_;
+};
+#endif
+
+#endif // LIGHT_VOLUME_CHECK_H
@@ -0,0 +1,443 @@
+///////////////////////////////////////////////////////////////////////////
+// Copyright 2011 Evan Mezeske.
+//
+// This file is part of Digbuild.
+// 
+// Digbuild is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.
+// 
+// Digbuild is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with Digbuild.  If not, see <http://www.gnu.org/licenses/>.
+///////////////////////////////////////////////////////////////////////////
+
+#include <boost/foreach.hpp>
+
+#include "log.h"
+#include "timer.h"
+#include "lighting_oracle.h"
+
+//////////////////////////////////////////////////////////////////////////////////
+// Local definitions:
+//////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+//////////////////////////////////////////////////////////////////////////////////
+// The following is the reference implementation of the Chunk lighting.  It is the
+// definition of the lighting rather than a copy of an implementation of it: every
+// translucent Block gets the brightest light that reaches it along any path from any
+// source, which is found by relaxing every Block against its neighbors until nothing
+// changes.  It is slow but obviously right, and it should NOT be changed along with
+// the Chunk lighting -- the whole point is that the real implementation, whatever
+// order it spreads the light in, can be compared against it.
+//////////////////////////////////////////////////////////////////////////////////
+
+bool mix_light( Vector3i& current, const Vector3i& incoming )
+{
+    bool affected = false;
+
+    for ( int i = 0; i < Vector3i::Size; ++i )
+    {
+        if ( current[i] < incoming[i] )
+        {
+            current[i] = incoming[i];
+            affected = true;
+        }
+    }
+
+    return affected;
+}
+
+void filter_light( Vector3i& current, const Block& block )
+{
+    if ( !block.is_color_saturated() )
+    {
+        const Vector3f& filter_color = block.get_color();
+
+        for ( unsigned i = 0; i < Vector3i::Size; ++i )
+        {
+            current[i] = static_cast<int>( roundf( filter_color[i] * current[i] ) );
+        }
+    }
+}
+
+bool attenuate_light( Vector3i& light )
+{
+    bool fully_attenuated = true;
+
+    for ( int i = 0; i < Vector3i::Size; ++i )
+    {
+        light[i] -= 1;
+
+        if ( light[i] > Block::MIN_LIGHT_COMPONENT_LEVEL )
+        {
+            fully_attenuated = false;
+        }
+        else if ( light[i] < Block::MIN_LIGHT_COMPONENT_LEVEL )
+        {
+            light[i] = Block::MIN_LIGHT_COMPONENT_LEVEL;
+        }
+    }
+
+    return fully_attenuated;
+}
+
+bool light_would_be_affected( const Vector3i& current, const Vector3i& incoming )
+{
+    for ( int i = 0; i < Vector3i::Size; ++i )
+    {
+        if ( current[i] < incoming[i] )
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+struct ColorLightStrategy
+{
+    static Vector3i get_light( const Block& block )
+    {
+        return block.get_light_level();
+    }
+
+    static void set_light( Block& block, const Vector3i& light )
+    {
+        block.set_light_level( light );
+    }
+};
+
+struct SunLightStrategy
+{
+    static Vector3i get_light( const Block& block )
+    {
+        return block.get_sunlight_level();
+    }
+
+    static void set_light( Block& block, const Vector3i& light )
+    {
+        block.set_sunlight_level( light );
+    }
+};
+
+void reference_reset_lighting( Chunk& chunk )
+{
+    for ( int x = 0; x < Chunk::SIZE_X; ++x )
+    {
+        for ( int z = 0; z < Chunk::SIZE_Z; ++z )
+        {
+            const int y_max = Chunk::SIZE_Y - 1;
+            const Vector3i top_block_index( x, y_max, z );
+            const Block* block_above = chunk.get_block_neighbor( top_block_index, Vector3i( 0, 1, 0 ) ).block_;
+
+            Vector3i sunlight_level = Block::MIN_LIGHT_LEVEL;
+            bool sunlight_above = false;
+
+            if ( !block_above )
+            {
+                sunlight_above = true;
+                sunlight_level = Block::MAX_LIGHT_LEVEL;
+            }
+            else if ( block_above->is_sunlight_source() )
+            {
+                sunlight_above = true;
+                sunlight_level = block_above->get_sunlight_level();
+            }
+
+            for ( int y = y_max; y >= 0; --y )
+            {
+                Block& block = chunk.get_block( Vector3i( x, y, z ) );
+                block.set_light_level( Block::MIN_LIGHT_LEVEL );
+
+                if ( sunlight_above )
+                {
+                    if ( block.is_translucent() )
+                    {
+                        filter_light( sunlight_level, block );
+                        block.set_sunlight_source( true );
+                        block.set_sunlight_level( sunlight_level );
+                    }
+                    else sunlight_above = false;
+                }
+
+                if ( !sunlight_above )
+                {
+                    block.set_sunlight_source( false );
+                    block.set_sunlight_level( Block::MIN_LIGHT_LEVEL );
+                }
+            }
+        }
+    }
+}
+
+// Raises the light of a translucent Block to what the light of one of its neighbors would
+// make it, and returns true if it changed.
+template <typename LightStrategy>
+bool relax_light( Block& block, const Block& neighbor )
+{
+    Vector3i light_level = LightStrategy::get_light( neighbor );
+
+    if ( attenuate_light( light_level ) )
+    {
+        return false;
+    }
+
+    filter_light( light_level, block );
+
+    Vector3i block_light_level = LightStrategy::get_light( block );
+    if ( !mix_light( block_light_level, light_level ) )
+    {
+        return false;
+    }
+
+    LightStrategy::set_light( block, block_light_level );
+    return true;
+}
+
+void reference_apply_lighting( const ChunkV& chunks )
+{
+    BOOST_FOREACH( Chunk* chunk, chunks )
+    {
+        FOREACH_BLOCK( x, y, z )
+        {
+            Block& block = chunk->get_block( Vector3i( x, y, z ) );
+
+            if ( block.is_light_source() )
+            {
+                Vector3i light_color =
+                    vector_cast<int>(
+                        pointwise_round( Vector3f( block.get_color() * Scalar( Block::MAX_LIGHT_COMPONENT_LEVEL ) ) ) );
+                filter_light( light_color, block );
+
+                Vector3i light_level = block.get_light_level();
+                mix_light( light_level, light_color );
+                block.set_light_level( light_level );
+            }
+        }
+    }
+
+    // Only the Chunks that changed in the last sweep, and their neighbors, can change in
+    // the next one.
+    ChunkSet changed_chunks( chunks.begin(), chunks.end() );
+
+    while ( !changed_chunks.empty() )
+    {
+        ChunkSet sweep_chunks;
+
+        BOOST_FOREACH( Chunk* chunk, changed_chunks )
+        {
+            sweep_chunks.insert( chunk );
+
+            FOREACH_CARDINAL_RELATION( relation )
+            {
+                Chunk* neighbor = chunk->get_neighbor( cardinal_relation_vector( relation ) );
+
+                if ( neighbor )
+                {
+                    sweep_chunks.insert( neighbor );
+                }
+            }
+        }
+
+        changed_chunks.clear();
+
+        BOOST_FOREACH( Chunk* chunk, sweep_chunks )
+        {
+            FOREACH_BLOCK( x, y, z )
+            {
+                const Vector3i index( x, y, z );
+                Block& block = chunk->get_block( index );
+
+                if ( !block.is_translucent() )
+                {
+                    continue;
+                }
+
+                FOREACH_CARDINAL_RELATION( relation )
+                {
+                    const Block* neighbor = chunk->get_block_neighbor( index, cardinal_relation_vector( relation ) ).block_;
+
+                    if ( neighbor &&
+                         ( relax_light<SunLightStrategy>( block, *neighbor ) |
+                           relax_light<ColorLightStrategy>( block, *neighbor ) ) )
+                    {
+                        changed_chunks.insert( chunk );
+                    }
+                }
+            }
+        }
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+// End of the reference implementation.
+//////////////////////////////////////////////////////////////////////////////////
+
+uint32_t pack_lighting( const Block& block )
+{
+    const Vector3i
+        light = block.get_light_level(),
+        sunlight = block.get_sunlight_level();
+
+    return
+        ( light[0]    <<  0 ) | ( light[1]    <<  4 ) | ( light[2]    <<  8 ) |
+        ( sunlight[0] << 12 ) | ( sunlight[1] << 16 ) | ( sunlight[2] << 20 ) |
+        ( block.is_sunlight_source() << 24 );
+}
+
+Vector3i unpack_light( const uint32_t packed, const int shift )
+{
+    return Vector3i( ( packed >> shift ) & 0xf, ( packed >> ( shift + 4 ) ) & 0xf, ( packed >> ( shift + 8 ) ) & 0xf );
+}
+
+} // anonymous namespace
+
+//////////////////////////////////////////////////////////////////////////////////
+// Function definitions for LightingOracle:
+//////////////////////////////////////////////////////////////////////////////////
+
+LightingOracle::LightingOracle( const uint64_t world_seed, const unsigned num_rounds, const unsigned edits_per_round ) :
+    num_rounds_( num_rounds ),
+    edits_per_round_( edits_per_round ),
+    region_( world_seed )
+{
+}
+
+bool LightingOracle::run()
+{
+    LightingSnapshot
+        reference,
+        candidate;
+
+    double
+        reference_time = 0.0,
+        candidate_time = 0.0;
+
+    unsigned total_mismatches = 0;
+
+    // Round zero checks the freshly generated region, before any edits are made.
+    for ( unsigned round = 0; round <= num_rounds_; ++round )
+    {
+        if ( round > 0 )
+        {
+            make_random_edits();
+        }
+
+        // Both implementations relight every Chunk from scratch, so the results of one
+        // do not depend on the results of the other.
+        const double round_reference_time = relight_reference();
+        take_snapshot( reference );
+
+        const double round_candidate_time = relight_candidate();
+        take_snapshot( candidate );
+
+        const unsigned mismatches = compare_snapshots( reference, candidate );
+
+        LOG( "Round " << round << ": reference " << round_reference_time << "s, candidate "
+             << round_candidate_time << "s, " << mismatches << " mismatched blocks" );
+
+        reference_time += round_reference_time;
+        candidate_time += round_candidate_time;
+        total_mismatches += mismatches;
+    }
+
+    LOG( "Lit " << region_.get_chunks().size() << " chunks " << num_rounds_ + 1 << " times: reference "
+         << reference_time << "s, candidate " << candidate_time << "s, "
+         << total_mismatches << " mismatched blocks" );
+
+    return total_mismatches == 0;
+}
+
+double LightingOracle::relight_reference()
+{
+    HighResolutionTimer timer;
+
+    BOOST_FOREACH( Chunk* chunk, region_.get_chunks_top_down() )
+    {
+        reference_reset_lighting( *chunk );
+    }
+
+    reference_apply_lighting( region_.get_chunks_top_down() );
+
+    return timer.get_seconds_elapsed();
+}
+
+double LightingOracle::relight_candidate()
+{
+    HighResolutionTimer timer;
+    region_.relight();
+    return timer.get_seconds_elapsed();
+}
+
+void LightingOracle::take_snapshot( LightingSnapshot& snapshot ) const
+{
+    snapshot.clear();
+    snapshot.reserve( region_.get_chunks().size() * Chunk::SIZE_X * Chunk::SIZE_Y * Chunk::SIZE_Z );
+
+    BOOST_FOREACH( const ChunkMap::value_type& chunk_it, region_.get_chunks() )
+    {
+        FOREACH_BLOCK( x, y, z )
+        {
+            snapshot.push_back( pack_lighting( chunk_it.second->get_block( Vector3i( x, y, z ) ) ) );
+        }
+    }
+}
+
+unsigned LightingOracle::compare_snapshots( const LightingSnapshot& reference, const LightingSnapshot& candidate ) const
+{
+    assert( reference.size() == candidate.size() );
+
+    const unsigned MAX_REPORTED_MISMATCHES = 10;
+    unsigned mismatches = 0;
+    size_t i = 0;
+
+    BOOST_FOREACH( const ChunkMap::value_type& chunk_it, region_.get_chunks() )
+    {
+        FOREACH_BLOCK( x, y, z )
+        {
+            if ( reference[i] != candidate[i] )
+            {
+                if ( ++mismatches <= MAX_REPORTED_MISMATCHES )
+                {
+                    LOG( "Mismatch at " << chunk_it.first + Vector3i( x, y, z )
+                         << ": light " << unpack_light( reference[i], 0 ) << " vs " << unpack_light( candidate[i], 0 )
+                         << ", sunlight " << unpack_light( reference[i], 12 ) << " vs " << unpack_light( candidate[i], 12 ) );
+                }
+            }
+
+            ++i;
+        }
+    }
+
+    return mismatches;
+}
+
+void LightingOracle::make_random_edits()
+{
+    // The edits are biased towards the materials that matter to the lighting: light
+    // sources, colored filters, and the opaque and clear Blocks that shape the light.
+    const BlockMaterial EDIT_MATERIALS[] =
+    {
+        BLOCK_MATERIAL_AIR,
+        BLOCK_MATERIAL_AIR,
+        BLOCK_MATERIAL_STONE,
+        BLOCK_MATERIAL_STONE,
+        BLOCK_MATERIAL_LAVA,
+        BLOCK_MATERIAL_WATER,
+        BLOCK_MATERIAL_GLASS_CLEAR,
+        BLOCK_MATERIAL_GLASS_RED,
+        BLOCK_MATERIAL_GLASS_ORANGE,
+        BLOCK_MATERIAL_GLASS_BLUE
+    };
+
+    const int NUM_EDIT_MATERIALS = sizeof( EDIT_MATERIALS ) / sizeof( BlockMaterial );
+
+    region_.make_random_edits( EDIT_MATERIALS, NUM_EDIT_MATERIALS, edits_per_round_ );
+}
@@ -0,0 +1,56 @@
+///////////////////////////////////////////////////////////////////////////
+// Copyright 2011 Evan Mezeske.
+//
+// This file is part of Digbuild.
+// 
+// Digbuild is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.
+// 
+// Digbuild is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with Digbuild.  If not, see <http://www.gnu.org/licenses/>.
+///////////////////////////////////////////////////////////////////////////
+
+#ifndef LIGHTING_ORACLE_H
+#define LIGHTING_ORACLE_H
+
+#include <vector>
+
+#include "generated_region.h"
+
+// The LightingOracle is a headless differential tester for the Chunk lighting.  It holds
+// a frozen reference implementation of the lighting, and checks that the current
+// implementation produces exactly the same light and sunlight levels for every Block in
+// a generated region, both before and after rounds of random Block edits.  The time taken
+// by each implementation is reported as well, so that lighting optimizations can be
+// measured and verified at the same time.
+struct LightingOracle
+{
+    LightingOracle( const uint64_t world_seed, const unsigned num_rounds = 10, const unsigned edits_per_round = 64 );
+
+    // Returns true if the two implementations agreed on every Block in every round.
+    bool run();
+
+protected:
+
+    typedef std::vector<uint32_t> LightingSnapshot;
+
+    double relight_reference();
+    double relight_candidate();
+    void take_snapshot( LightingSnapshot& snapshot ) const;
+    unsigned compare_snapshots( const LightingSnapshot& reference, const LightingSnapshot& candidate ) const;
+    void make_random_edits();
+
+    unsigned
+        num_rounds_,
+        edits_per_round_;
+
+    GeneratedRegion region_;
+};
+
+#endif // LIGHTING_ORACLE_H
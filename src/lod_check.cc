@@ -0,0 +1,238 @@
+///////////////////////////////////////////////////////////////////////////
+// Copyright 2011 Evan Mezeske.
+//
+// This file is part of Digbuild.
+// 
+// Digbuild is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.
+// 
+// Digbuild is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with Digbuild.  If not, see <http://www.gnu.org/licenses/>.
+///////////////////////////////////////////////////////////////////////////
+
+
+#include <algorithm>
+
+#include <boost/foreach.hpp>
+
+#include "log.h"
+#include "lod_check.h"
+
+//////////////////////////////////////////////////////////////////////////////////
+// Function definitions for LodCheck:
+//////////////////////////////////////////////////////////////////////////////////
+
+bool LodCheck::run()
+{
+    bool correct = check_buried_chunk();
+
+    // The surfaces line up with the cells of every level of detail, with some of them, and
+    // with none of them.
+    const int SURFACE_HEIGHTS[] = { 8, 3, 13 };
+
+    BOOST_FOREACH( const int surface_height, SURFACE_HEIGHTS )
+    {
+        correct &= check_surface( surface_height );
+    }
+
+    return correct;
+}
+
+void LodCheck::build_region( const Vector3i& region_chunks, const int surface_height, ChunkMap& chunks ) const
+{
+    for ( int x = 0; x < region_chunks[0]; ++x )
+    {
+        for ( int y = 0; y < region_chunks[1]; ++y )
+        {
+            for ( int z = 0; z < region_chunks[2]; ++z )
+            {
+                ChunkSP chunk( new Chunk( pointwise_product( Vector3i( x, y, z ), Chunk::SIZE ) ) );
+
+                FOREACH_BLOCK( block_x, block_y, block_z )
+                {
+                    const int height = chunk->get_position()[1] + block_y;
+                    const Vector3i index( block_x, block_y, block_z );
+
+                    if ( height < surface_height - 1 )
+                    {
+                        chunk->get_block( index ).set_material( BLOCK_MATERIAL_STONE );
+                    }
+                    else if ( height == surface_height - 1 )
+                    {
+                        chunk->get_block( index ).set_material( BLOCK_MATERIAL_GRASS );
+                    }
+                }
+
+                chunk_stitch_into_map( chunk, chunks );
+            }
+        }
+    }
+
+    BOOST_FOREACH( ChunkMap::value_type& chunk_it, chunks )
+    {
+        chunk_it.second->update_geometry();
+    }
+}
+
+bool LodCheck::check_buried_chunk()
+{
+    ChunkMap chunks;
+    build_region( Vector3i( 3, 3, 3 ), 3 * Chunk::SIZE_Y, chunks );
+
+    const Chunk& chunk = *chunks[Chunk::SIZE];
+    bool correct = true;
+
+    for ( int lod = 1; lod <= Chunk::NUM_LODS; ++lod )
+    {
+        const unsigned num_faces = chunk.get_lod_section( lod ).get_num_faces();
+
+        if ( num_faces != 0 )
+        {
+            LOG( "Failed: level of detail " << lod << " of a buried chunk has " << num_faces << " faces." );
+            correct = false;
+        }
+    }
+
+    LOG( "Buried chunk: " << ( correct ? "correct" : "wrong" ) );
+
+    return correct;
+}
+
+bool LodCheck::check_surface( const int surface_height )
+{
+    // The Chunk in the middle has neighbors on every side but below, so it has no faces on
+    // its bottom, and only has faces on its sides where the Blocks beside them are not all
+    // opaque.
+    ChunkMap chunks;
+    build_region( Vector3i( 3, 1, 3 ), surface_height, chunks );
+
+    const Chunk& chunk = *chunks[Vector3i( Chunk::SIZE_X, 0, Chunk::SIZE_Z )];
+    bool correct = true;
+
+    for ( int lod = 1; lod <= Chunk::NUM_LODS; ++lod )
+    {
+        const Chunk::Section& section = chunk.get_lod_section( lod );
+        const int scale = 1 << lod;
+
+        // The cells are solid up to the last one that is at least half opaque.
+        int top = 0;
+
+        while ( top < Chunk::SIZE_Y && 2 * std::min( surface_height - top, scale ) >= scale )
+        {
+            top += scale;
+        }
+
+        // The top cell takes the material of its highest opaque Block, which is the grass
+        // only if the grass is in the top cell.
+        const BlockMaterial top_material =
+            surface_height - 1 >= top - scale && surface_height - 1 < top ? BLOCK_MATERIAL_GRASS : BLOCK_MATERIAL_STONE;
+
+        // The sides of the top cell are only covered if it is completely opaque.
+        const int side_area = top > surface_height ? Chunk::SIZE_X * scale : 0;
+
+        bool lod_correct =
+            check_faces( section, scale ) &&
+            get_face_area( section, CARDINAL_RELATION_ABOVE ) == ( top > 0 ? Chunk::SIZE_X * Chunk::SIZE_Z : 0 ) &&
+            get_face_area( section, CARDINAL_RELATION_BELOW ) == 0;
+
+        FOREACH_CARDINAL_RELATION( relation )
+        {
+            if ( relation != CARDINAL_RELATION_ABOVE && relation != CARDINAL_RELATION_BELOW )
+            {
+                lod_correct = lod_correct && get_face_area( section, relation ) == side_area;
+            }
+        }
+
+        for ( unsigned f = section.opaque_face_offsets_[CARDINAL_RELATION_ABOVE];
+              f < section.opaque_face_offsets_[CARDINAL_RELATION_ABOVE + 1] && lod_correct;
+              ++f )
+        {
+            const BlockVertex& vertex = section.opaque_vertices_[f * BlockVertex::VERTICES_PER_FACE];
+            lod_correct = vertex.get_position()[1] == top && vertex.get_material() == top_material;
+        }
+
+        if ( !lod_correct )
+        {
+            LOG( "Failed: level of detail " << lod << " of a surface at height " << surface_height << " is wrong." );
+            correct = false;
+        }
+    }
+
+    LOG( "Surface at height " << surface_height << ": " << ( correct ? "correct" : "wrong" ) );
+
+    return correct;
+}
+
+bool LodCheck::check_faces( const Chunk::Section& section, const int scale ) const
+{
+    if ( !section.translucent_vertices_.empty() ||
+         section.opaque_vertices_.size() != section.opaque_face_offsets_[NUM_CARDINAL_RELATIONS] * BlockVertex::VERTICES_PER_FACE )
+    {
+        return false;
+    }
+
+    FOREACH_CARDINAL_RELATION( relation )
+    {
+        const Vector3i relation_vector = cardinal_relation_vector( relation );
+
+        for ( unsigned f = section.opaque_face_offsets_[relation]; f < section.opaque_face_offsets_[relation + 1]; ++f )
+        {
+            const BlockVertex* face_vertices = &section.opaque_vertices_[f * BlockVertex::VERTICES_PER_FACE];
+
+            for ( int i = 0; i < BlockVertex::VERTICES_PER_FACE; ++i )
+            {
+                const Vector3i position = face_vertices[i].get_position();
+
+                if ( face_vertices[i].get_relation() != relation )
+                {
+                    return false;
+                }
+
+                for ( int j = 0; j < Vector3i::Size; ++j )
+                {
+                    // The corners must lie on the cell boundaries, and the face must be flat
+                    // along its normal.
+                    if ( position[j] < 0 || position[j] > Chunk::SIZE[j] || position[j] % scale != 0 ||
+                         ( relation_vector[j] != 0 && position[j] != face_vertices[0].get_position()[j] ) )
+                    {
+                        return false;
+                    }
+                }
+            }
+        }
+    }
+
+    return true;
+}
+
+int LodCheck::get_face_area( const Chunk::Section& section, const CardinalRelation relation ) const
+{
+    int area = 0;
+
+    for ( unsigned f = section.opaque_face_offsets_[relation]; f < section.opaque_face_offsets_[relation + 1]; ++f )
+    {
+        const BlockVertex* face_vertices = &section.opaque_vertices_[f * BlockVertex::VERTICES_PER_FACE];
+
+        // The first and third corners are opposite each other.
+        const Vector3i diagonal = face_vertices[2].get_position() - face_vertices[0].get_position();
+        int face_area = 1;
+
+        for ( int i = 0; i < Vector3i::Size; ++i )
+        {
+            if ( diagonal[i] != 0 )
+            {
+                face_area *= std::abs( diagonal[i] );
+            }
+        }
+
+        area += face_area;
+    }
+
+    return area;
+}
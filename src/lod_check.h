@@ -0,0 +1,53 @@
+///////////////////////////////////////////////////////////////////////////
+// Copyright 2011 Evan Mezeske.
+//
+// This file is part of Digbuild.
+// 
+// Digbuild is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.
+// 
+// Digbuild is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with Digbuild.  If not, see <http://www.gnu.org/licenses/>.
+///////////////////////////////////////////////////////////////////////////
+
+
+#ifndef LOD_CHECK_H
+#define LOD_CHECK_H
+
+#include "chunk.h"
+
+// The LodCheck is a headless check of the Chunks' coarser levels of detail, which are
+// downsampled and meshed on the CPU.  It builds small regions of synthetic terrain, and
+// checks the level of detail meshes of the Chunk in the middle: every face must be a flat
+// face on the cell boundaries inside the Chunk, the cells must be solid exactly where they
+// are at least half opaque, and a Chunk that is buried in opaque Blocks on every side must
+// have no faces at all.
+struct LodCheck
+{
+    // Returns true if every level of detail mesh was as expected.
+    bool run();
+
+protected:
+
+    // Fills a region of Chunks with opaque Blocks up to 'surface_height', covered by a layer
+    // of grass, and meshes them.
+    void build_region( const Vector3i& region_chunks, const int surface_height, ChunkMap& chunks ) const;
+
+    bool check_buried_chunk();
+    bool check_surface( const int surface_height );
+
+    // Returns true if each face in the Section is a flat face on the boundaries of the cells
+    // 'scale' Blocks wide inside of the Chunk, pointing in the direction it is grouped under.
+    bool check_faces( const Chunk::Section& section, const int scale ) const;
+
+    // Returns the total area of the faces in the Section pointing in the given direction.
+    int get_face_area( const Chunk::Section& section, const CardinalRelation relation ) const;
+};
+
+#endif // LOD_CHECK_H
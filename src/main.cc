@@ -17,7 +17,22 @@
 ///////////////////////////////////////////////////////////////////////////
 
 #include "log.h"
+#if defined( DEBUG_LIGHTING_ORACLE )
+#include "lighting_oracle.h"
+#elif defined( DEBUG_CULLING_BENCHMARK )
+#include "culling_benchmark.h"
+#elif defined( DEBUG_LIGHT_VOLUME_CHECK )
+#ifndef LIGHT_VOLUMES
+#error DEBUG_LIGHT_VOLUME_CHECK requires LIGHT_VOLUMES to be defined as well.
+#endif
+#include "light_volume_check.h"
+#elif defined( DEBUG_ARENA_ALLOCATOR_CHECK )
+#include "arena_allocator_check.h"
+#elif defined( DEBUG_LOD_CHECK )
+#include "lod_check.h"
+#else
 #include "game_application.h"
+#endif
 
 int main( int argc, char **argv )
 {
@@ -25,10 +40,42 @@ int main( int argc, char **argv )
 
     try
     {
+#if defined( DEBUG_LIGHTING_ORACLE )
+        // The differences tend to show up only where the random edits happen to place
+        // colored glass or lava, so more than one world is checked.
+        const uint64_t ORACLE_SEEDS[] = { 0, 1, 7, 12345 };
+        const size_t NUM_ORACLE_SEEDS = sizeof( ORACLE_SEEDS ) / sizeof( uint64_t );
+
+        result = 0;
+
+        for ( size_t i = 0; i < NUM_ORACLE_SEEDS; ++i )
+        {
+            LOG( "World seed " << ORACLE_SEEDS[i] << ":" );
+            LightingOracle oracle( ORACLE_SEEDS[i] );
+
+            if ( !oracle.run() )
+            {
+                result = 1;
+            }
+        }
+#elif defined( DEBUG_CULLING_BENCHMARK )
+        CullingBenchmark benchmark( 0 );
+        result = benchmark.run() ? 0 : 1;
+#elif defined( DEBUG_LIGHT_VOLUME_CHECK )
+        LightVolumeCheck check( 0 );
+        result = check.run() ? 0 : 1;
+#elif defined( DEBUG_ARENA_ALLOCATOR_CHECK )
+        ArenaAllocatorCheck check( 0 );
+        result = check.run() ? 0 : 1;
+#elif defined( DEBUG_LOD_CHECK )
+        LodCheck check;
+        result = check.run() ? 0 : 1;
+#else
         SDL_GL_Window window( "Digbuild" );
         GameApplication game( window );
         game.main_loop();
         result =  0;
+#endif
     }
     catch ( const std::exception& e ) { LOG( "Error: " << e.what() << "." ); }
 
@@ -21,6 +21,10 @@
 
 #include <gmtl/gmtl.h>
 #include <algorithm>
+#include <cassert>
+#include <cstring>
+
+#include <boost/static_assert.hpp>
 
 typedef float Scalar;
 
@@ -33,6 +37,8 @@ typedef gmtl::Vec<int32_t, 2> Vector2i;
 typedef gmtl::Vec<int32_t, 3> Vector3i;
 typedef gmtl::Vec<int32_t, 4> Vector4i;
 
+typedef gmtl::Vec<uint8_t, 3> Vector3ub;
+
 typedef gmtl::AABoxf AABoxf;
 typedef gmtl::AABox<int> AABoxi;
 
@@ -183,6 +189,17 @@ inline Vector3f spherical_to_cartesian( const Vector3f& spherical )
     );
 }
 
+// Returns a key that sorts in the same order as 'value', which must not be negative.
+inline uint32_t get_sort_key( const float value )
+{
+    BOOST_STATIC_ASSERT( sizeof( float ) == sizeof( uint32_t ) );
+    assert( value >= 0.0f );
+
+    uint32_t key;
+    memcpy( &key, &value, sizeof( key ) );
+    return key;
+}
+
 template <typename T>
 struct VectorLess : public std::binary_function <T, T, bool>
 {
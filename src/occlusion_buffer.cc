@@ -0,0 +1,280 @@
+///////////////////////////////////////////////////////////////////////////
+// Copyright 2011 Evan Mezeske.
+//
+// This file is part of Digbuild.
+// 
+// Digbuild is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.
+// 
+// Digbuild is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with Digbuild.  If not, see <http://www.gnu.org/licenses/>.
+///////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <cfloat>
+
+#include <xmmintrin.h>
+
+#include <boost/static_assert.hpp>
+
+#include "occlusion_buffer.h"
+
+//////////////////////////////////////////////////////////////////////////////////
+// Local definitions:
+//////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+// Corners nearer to the camera than the near plane cannot be projected safely.
+const Scalar MIN_CLIP_W = 0.1f;
+
+const int SSE_WIDTH = 4;
+
+Scalar cross( const Vector2f& origin, const Vector2f& a, const Vector2f& b )
+{
+    return ( a[0] - origin[0] ) * ( b[1] - origin[1] ) - ( a[1] - origin[1] ) * ( b[0] - origin[0] );
+}
+
+// Sets 'hull' to the convex hull of the points (which are reordered), counter-clockwise
+// and with the first point repeated at the end, and returns the number of edges in it.
+// The 'hull' must have room for twice as many points as there are 'points'.
+int find_convex_hull( Vector2f* points, const int num_points, Vector2f* hull )
+{
+    std::sort( points, points + num_points, VectorLess<Vector2f>() );
+
+    int size = 0;
+
+    for ( int i = 0; i < num_points; ++i )
+    {
+        while ( size >= 2 && cross( hull[size - 2], hull[size - 1], points[i] ) <= 0.0f )
+        {
+            --size;
+        }
+
+        hull[size++] = points[i];
+    }
+
+    const int lower_size = size + 1;
+
+    for ( int i = num_points - 2; i >= 0; --i )
+    {
+        while ( size >= lower_size && cross( hull[size - 2], hull[size - 1], points[i] ) <= 0.0f )
+        {
+            --size;
+        }
+
+        hull[size++] = points[i];
+    }
+
+    return size - 1;
+}
+
+} // anonymous namespace
+
+//////////////////////////////////////////////////////////////////////////////////
+// Static constant definitions for OcclusionBuffer:
+//////////////////////////////////////////////////////////////////////////////////
+
+const int
+    OcclusionBuffer::WIDTH,
+    OcclusionBuffer::HEIGHT,
+    OcclusionBuffer::NUM_CORNERS;
+
+const unsigned OcclusionBuffer::MAX_OCCLUDERS;
+
+const Scalar OcclusionBuffer::MAX_OCCLUDER_DISTANCE = 96.0f;
+
+//////////////////////////////////////////////////////////////////////////////////
+// Function definitions for OcclusionBuffer:
+//////////////////////////////////////////////////////////////////////////////////
+
+OcclusionBuffer::OcclusionBuffer()
+{
+    BOOST_STATIC_ASSERT( WIDTH % SSE_WIDTH == 0 );
+    clear( view_projection_ );
+}
+
+void OcclusionBuffer::clear( const gmtl::Matrix44f& view_projection )
+{
+    view_projection_ = view_projection;
+    std::fill( &depths_[0][0], &depths_[0][0] + WIDTH * HEIGHT, FLT_MAX );
+}
+
+void OcclusionBuffer::add_occluder( const AABoxf& aabb )
+{
+    ScreenBox screen_box;
+
+    if ( !project( aabb, screen_box ) )
+    {
+        return;
+    }
+
+    Vector2f hull[2 * NUM_CORNERS];
+    const int num_edges = find_convex_hull( screen_box.corners_, NUM_CORNERS, hull );
+
+    if ( num_edges < 3 )
+    {
+        return;
+    }
+
+    // Each edge is the half-plane a * x + b * y + c >= 0.  The offset of c makes the test
+    // pass only for the pixels that are entirely inside of the edge, rather than for those
+    // whose centers are.
+    Scalar
+        edge_a[2 * NUM_CORNERS],
+        edge_b[2 * NUM_CORNERS],
+        edge_c[2 * NUM_CORNERS];
+
+    for ( int i = 0; i < num_edges; ++i )
+    {
+        edge_a[i] = hull[i][1] - hull[i + 1][1];
+        edge_b[i] = hull[i + 1][0] - hull[i][0];
+        edge_c[i] =
+            -( edge_a[i] * hull[i][0] + edge_b[i] * hull[i][1] ) -
+            0.5f * ( gmtl::Math::abs( edge_a[i] ) + gmtl::Math::abs( edge_b[i] ) );
+    }
+
+    const int
+        x_begin = std::max( 0, int( gmtl::Math::floor( screen_box.min_[0] ) ) ) & ~( SSE_WIDTH - 1 ),
+        x_end = std::min( WIDTH, int( gmtl::Math::ceil( screen_box.max_[0] ) ) ),
+        y_begin = std::max( 0, int( gmtl::Math::floor( screen_box.min_[1] ) ) ),
+        y_end = std::min( HEIGHT, int( gmtl::Math::ceil( screen_box.max_[1] ) ) );
+
+    const __m128
+        zero = _mm_setzero_ps(),
+        depth = _mm_set1_ps( screen_box.max_depth_ ),
+        no_depth = _mm_set1_ps( FLT_MAX ),
+        pixel_centers = _mm_set_ps( 3.5f, 2.5f, 1.5f, 0.5f );
+
+    for ( int y = y_begin; y < y_end; ++y )
+    {
+        Scalar edge_rows[2 * NUM_CORNERS];
+
+        for ( int i = 0; i < num_edges; ++i )
+        {
+            edge_rows[i] = edge_b[i] * ( Scalar( y ) + 0.5f ) + edge_c[i];
+        }
+
+        for ( int x = x_begin; x < x_end; x += SSE_WIDTH )
+        {
+            const __m128 pixel_x = _mm_add_ps( _mm_set1_ps( Scalar( x ) ), pixel_centers );
+
+            __m128 inside = _mm_cmpeq_ps( zero, zero );
+
+            for ( int i = 0; i < num_edges; ++i )
+            {
+                const __m128 edge = _mm_add_ps( _mm_mul_ps( _mm_set1_ps( edge_a[i] ), pixel_x ), _mm_set1_ps( edge_rows[i] ) );
+                inside = _mm_and_ps( inside, _mm_cmpge_ps( edge, zero ) );
+            }
+
+            if ( _mm_movemask_ps( inside ) )
+            {
+                const __m128 occluder_depth = _mm_or_ps( _mm_and_ps( inside, depth ), _mm_andnot_ps( inside, no_depth ) );
+                _mm_storeu_ps( &depths_[y][x], _mm_min_ps( _mm_loadu_ps( &depths_[y][x] ), occluder_depth ) );
+            }
+        }
+    }
+}
+
+bool OcclusionBuffer::is_visible( const AABoxf& aabb ) const
+{
+    ScreenBox screen_box;
+
+    if ( !project( aabb, screen_box ) )
+    {
+        return true;
+    }
+
+    // Every pixel that the box could touch is tested, plus a few more on either side to
+    // line the rows up with the SSE registers.
+    const int
+        x_begin = std::max( 0, int( gmtl::Math::floor( screen_box.min_[0] ) ) ) & ~( SSE_WIDTH - 1 ),
+        x_end = std::min( WIDTH, int( gmtl::Math::ceil( screen_box.max_[0] ) ) ),
+        y_begin = std::max( 0, int( gmtl::Math::floor( screen_box.min_[1] ) ) ),
+        y_end = std::min( HEIGHT, int( gmtl::Math::ceil( screen_box.max_[1] ) ) );
+
+    if ( x_begin >= x_end || y_begin >= y_end )
+    {
+        return true;
+    }
+
+    const __m128 min_depth = _mm_set1_ps( screen_box.min_depth_ );
+
+    for ( int y = y_begin; y < y_end; ++y )
+    {
+        for ( int x = x_begin; x < x_end; x += SSE_WIDTH )
+        {
+            if ( _mm_movemask_ps( _mm_cmpge_ps( _mm_loadu_ps( &depths_[y][x] ), min_depth ) ) )
+            {
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+bool OcclusionBuffer::project( const AABoxf& aabb, ScreenBox& screen_box ) const
+{
+    const Vector3f& min = aabb.getMin();
+    const Vector3f& max = aabb.getMax();
+
+    for ( int i = 0; i < NUM_CORNERS; ++i )
+    {
+        const Vector3f corner(
+            ( i & 1 ) ? max[0] : min[0],
+            ( i & 2 ) ? max[1] : min[1],
+            ( i & 4 ) ? max[2] : min[2]
+        );
+
+        Vector4f clip;
+
+        for ( int row = 0; row < Vector4f::Size; ++row )
+        {
+            clip[row] =
+                view_projection_( row, 0 ) * corner[0] +
+                view_projection_( row, 1 ) * corner[1] +
+                view_projection_( row, 2 ) * corner[2] +
+                view_projection_( row, 3 );
+        }
+
+        if ( clip[3] < MIN_CLIP_W )
+        {
+            return false;
+        }
+
+        const Vector2f screen_corner(
+            ( clip[0] / clip[3] + 1.0f ) * 0.5f * Scalar( WIDTH ),
+            ( clip[1] / clip[3] + 1.0f ) * 0.5f * Scalar( HEIGHT )
+        );
+
+        const Scalar depth = clip[2] / clip[3];
+
+        screen_box.corners_[i] = screen_corner;
+
+        if ( i == 0 )
+        {
+            screen_box.min_ = screen_box.max_ = screen_corner;
+            screen_box.min_depth_ = screen_box.max_depth_ = depth;
+        }
+        else
+        {
+            for ( int j = 0; j < Vector2f::Size; ++j )
+            {
+                screen_box.min_[j] = std::min( screen_box.min_[j], screen_corner[j] );
+                screen_box.max_[j] = std::max( screen_box.max_[j], screen_corner[j] );
+            }
+
+            screen_box.min_depth_ = std::min( screen_box.min_depth_, depth );
+            screen_box.max_depth_ = std::max( screen_box.max_depth_, depth );
+        }
+    }
+
+    return true;
+}
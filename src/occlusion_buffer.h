@@ -0,0 +1,78 @@
+///////////////////////////////////////////////////////////////////////////
+// Copyright 2011 Evan Mezeske.
+//
+// This file is part of Digbuild.
+// 
+// Digbuild is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.
+// 
+// Digbuild is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with Digbuild.  If not, see <http://www.gnu.org/licenses/>.
+///////////////////////////////////////////////////////////////////////////
+
+#ifndef OCCLUSION_BUFFER_H
+#define OCCLUSION_BUFFER_H
+
+#include "math.h"
+
+// An OcclusionBuffer is a small depth buffer that is rasterized on the CPU (with SSE, four
+// pixels at a time), for culling Chunks that are hidden behind nearby terrain before they
+// are drawn.  Occluders are boxes that are known to be completely opaque; each is drawn as
+// the outline of its projection, at the depth of its farthest corner, and only into the
+// pixels that it covers completely.  A box is only reported as hidden if every pixel that
+// it touches has an occluder in front of its nearest corner, so the culling never removes
+// anything that could be seen.  It does not touch GL, so it can be used headlessly.
+struct OcclusionBuffer
+{
+    static const int
+        WIDTH = 128,
+        HEIGHT = 96;
+
+    // Only the nearest occluders are worth drawing: up to this many, out to this distance.
+    static const unsigned MAX_OCCLUDERS = 256;
+    static const Scalar MAX_OCCLUDER_DISTANCE;
+
+    OcclusionBuffer();
+
+    // Empties the buffer, and sets the matrix that takes world coordinates to clip
+    // coordinates (i.e. the projection matrix times the modelview matrix).
+    void clear( const gmtl::Matrix44f& view_projection );
+
+    void add_occluder( const AABoxf& aabb );
+
+    bool is_visible( const AABoxf& aabb ) const;
+
+protected:
+
+    static const int NUM_CORNERS = 8;
+
+    // The corners of a box in screen coordinates, with the range of their depths.
+    struct ScreenBox
+    {
+        Vector2f corners_[NUM_CORNERS];
+
+        Vector2f
+            min_,
+            max_;
+
+        Scalar
+            min_depth_,
+            max_depth_;
+    };
+
+    // Returns false if any corner of the box is behind (or too near to) the camera, in
+    // which case its projection cannot be bounded by that of its corners.
+    bool project( const AABoxf& aabb, ScreenBox& screen_box ) const;
+
+    gmtl::Matrix44f view_projection_;
+
+    float depths_[HEIGHT][WIDTH];
+};
+
+#endif // OCCLUSION_BUFFER_H
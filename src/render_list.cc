@@ -0,0 +1,195 @@
+///////////////////////////////////////////////////////////////////////////
+// Copyright 2011 Evan Mezeske.
+//
+// This file is part of Digbuild.
+// 
+// Digbuild is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.
+// 
+// Digbuild is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with Digbuild.  If not, see <http://www.gnu.org/licenses/>.
+///////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <cassert>
+#include <limits>
+
+#include "render_list.h"
+
+//////////////////////////////////////////////////////////////////////////////////
+// Local definitions:
+//////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+const int
+    PASS_SHIFT = 40,
+    PROGRAM_SHIFT = 32;
+
+bool is_front_to_back( const RenderPass pass )
+{
+    return pass == RENDER_PASS_OPAQUE;
+}
+
+} // anonymous namespace
+
+//////////////////////////////////////////////////////////////////////////////////
+// Function definitions for RenderItem:
+//////////////////////////////////////////////////////////////////////////////////
+
+RenderItem::RenderItem(
+    const RenderPass pass,
+    const RendererMaterialManager::MaterialProgram program,
+    const Scalar distance_squared,
+    ChunkRenderer* chunk,
+    const int lod
+) :
+    pass_( pass ),
+    program_( program ),
+    distance_squared_( distance_squared ),
+    chunk_( chunk ),
+    lod_( lod ),
+    sort_key_( uint64_t( pass ) << PASS_SHIFT )
+{
+    const uint32_t depth_key = get_sort_key( distance_squared );
+
+    // In the front to back passes, the items are grouped by program, so that it only has
+    // to change once.  The Chunks are split between the programs by distance, so in the
+    // back to front passes it only changes once anyway.
+    if ( is_front_to_back( pass ) )
+    {
+        sort_key_ |= uint64_t( program ) << PROGRAM_SHIFT;
+        sort_key_ |= depth_key;
+    }
+    else sort_key_ |= ~depth_key;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+// Function definitions for RenderList:
+//////////////////////////////////////////////////////////////////////////////////
+
+void RenderList::add(
+    const RenderPass pass,
+    const RendererMaterialManager::MaterialProgram program,
+    const Scalar distance_squared,
+    ChunkRenderer* chunk,
+    const int lod
+)
+{
+    items_.push_back( RenderItem( pass, program, distance_squared, chunk, lod ) );
+}
+
+void RenderList::submit( RenderBackend& backend )
+{
+    std::sort( items_.begin(), items_.end() );
+
+    RenderItemV::const_iterator item_it = items_.begin();
+
+    for ( int pass = 0; pass < NUM_RENDER_PASSES; ++pass )
+    {
+        backend.begin_pass( RenderPass( pass ) );
+
+        bool program_selected = false;
+        RendererMaterialManager::MaterialProgram program = RendererMaterialManager::MATERIAL_PROGRAM_NEAR;
+
+        for ( ; item_it != items_.end() && item_it->pass_ == pass; ++item_it )
+        {
+            if ( !program_selected || item_it->program_ != program )
+            {
+                program = item_it->program_;
+                program_selected = true;
+                backend.select_program( program );
+            }
+
+            backend.draw( *item_it );
+        }
+
+        backend.end_pass( RenderPass( pass ) );
+    }
+
+    assert( item_it == items_.end() );
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+// Function definitions for NullRenderBackend:
+//////////////////////////////////////////////////////////////////////////////////
+
+NullRenderBackend::NullRenderBackend() :
+    pass_( -1 ),
+    in_pass_( false ),
+    program_selected_( false ),
+    program_( RendererMaterialManager::MATERIAL_PROGRAM_NEAR ),
+    last_distance_squared_( 0.0f ),
+    consistent_( true )
+{
+    std::fill( num_program_changes_, num_program_changes_ + NUM_RENDER_PASSES, 0 );
+    std::fill( num_draws_, num_draws_ + NUM_RENDER_PASSES, 0 );
+}
+
+void NullRenderBackend::begin_pass( const RenderPass pass )
+{
+    if ( in_pass_ || pass != pass_ + 1 )
+    {
+        consistent_ = false;
+    }
+
+    pass_ = pass;
+    in_pass_ = true;
+    program_selected_ = false;
+    last_distance_squared_ = is_front_to_back( pass ) ? 0.0f : std::numeric_limits<Scalar>::max();
+}
+
+void NullRenderBackend::end_pass( const RenderPass pass )
+{
+    if ( !in_pass_ || pass != pass_ )
+    {
+        consistent_ = false;
+    }
+
+    in_pass_ = false;
+}
+
+void NullRenderBackend::select_program( const RendererMaterialManager::MaterialProgram program )
+{
+    if ( !in_pass_ || ( program_selected_ && program == program_ ) )
+    {
+        consistent_ = false;
+    }
+    else ++num_program_changes_[pass_];
+
+    program_selected_ = true;
+    program_ = program;
+
+    // The front to back order starts over for each program.
+    if ( is_front_to_back( RenderPass( pass_ ) ) )
+    {
+        last_distance_squared_ = 0.0f;
+    }
+}
+
+void NullRenderBackend::draw( const RenderItem& item )
+{
+    if ( !in_pass_ || item.pass_ != pass_ || !program_selected_ || item.program_ != program_ )
+    {
+        consistent_ = false;
+        return;
+    }
+
+    const bool in_order = is_front_to_back( item.pass_ ) ?
+        item.distance_squared_ >= last_distance_squared_ :
+        item.distance_squared_ <= last_distance_squared_;
+
+    if ( !in_order )
+    {
+        consistent_ = false;
+    }
+
+    last_distance_squared_ = item.distance_squared_;
+    ++num_draws_[pass_];
+}
@@ -0,0 +1,147 @@
+///////////////////////////////////////////////////////////////////////////
+// Copyright 2011 Evan Mezeske.
+//
+// This file is part of Digbuild.
+// 
+// Digbuild is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.
+// 
+// Digbuild is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with Digbuild.  If not, see <http://www.gnu.org/licenses/>.
+///////////////////////////////////////////////////////////////////////////
+
+#ifndef RENDER_LIST_H
+#define RENDER_LIST_H
+
+#include <vector>
+
+#include "math.h"
+#include "renderer_material.h"
+
+struct ChunkRenderer;
+
+// The passes are submitted in this order.
+enum RenderPass
+{
+    // Front to back, so that the nearest Chunks hide as many fragments as possible.
+    RENDER_PASS_OPAQUE,
+    // Back to front, so that the blending is correct.
+    RENDER_PASS_TRANSLUCENT,
+    // Back to front; only used to outline the Chunks when DEBUG_CHUNKS is defined.
+    RENDER_PASS_CHUNK_BOUNDS,
+    NUM_RENDER_PASSES
+};
+
+struct RenderItem
+{
+    RenderItem(
+        const RenderPass pass,
+        const RendererMaterialManager::MaterialProgram program,
+        const Scalar distance_squared,
+        ChunkRenderer* chunk,
+        const int lod
+    );
+
+    bool operator<( const RenderItem& other ) const { return sort_key_ < other.sort_key_; }
+
+    RenderPass pass_;
+
+    RendererMaterialManager::MaterialProgram program_;
+
+    Scalar distance_squared_;
+
+    ChunkRenderer* chunk_;
+
+    int lod_;
+
+    // From the most significant bits down, this holds the pass, the program and the depth.
+    // The program is left out in the back to front passes, where the depth alone decides
+    // the order.
+    uint64_t sort_key_;
+};
+
+typedef std::vector<RenderItem> RenderItemV;
+
+// A RenderBackend carries out the commands that a RenderList submits to it.
+struct RenderBackend
+{
+    virtual ~RenderBackend() {}
+
+    virtual void begin_pass( const RenderPass pass ) = 0;
+    virtual void end_pass( const RenderPass pass ) = 0;
+    virtual void select_program( const RendererMaterialManager::MaterialProgram program ) = 0;
+    virtual void draw( const RenderItem& item ) = 0;
+};
+
+// The RenderList holds everything that will be drawn in a frame.  The Renderer decides
+// what goes into it, and the RenderList decides the order, so that the GL backend only
+// has to carry out the commands.
+struct RenderList
+{
+    void clear() { items_.clear(); }
+
+    void add(
+        const RenderPass pass,
+        const RendererMaterialManager::MaterialProgram program,
+        const Scalar distance_squared,
+        ChunkRenderer* chunk,
+        const int lod = 0
+    );
+
+    // Sorts the items and passes them to the backend.  Every pass is begun and ended, even
+    // if it is empty, and each pass starts with the program of its first item selected.
+    // After that, the program is only selected again when it changes.
+    void submit( RenderBackend& backend );
+
+    const RenderItemV& get_items() const { return items_; }
+
+protected:
+
+    RenderItemV items_;
+};
+
+// The NullRenderBackend records the commands instead of drawing anything, so that the
+// render decisions can be checked headlessly.
+struct NullRenderBackend : public RenderBackend
+{
+    NullRenderBackend();
+
+    virtual void begin_pass( const RenderPass pass );
+    virtual void end_pass( const RenderPass pass );
+    virtual void select_program( const RendererMaterialManager::MaterialProgram program );
+    virtual void draw( const RenderItem& item );
+
+    // Returns true if the passes were begun and ended in order, if each item was drawn
+    // inside of its own pass with its own program selected, and if the items in each
+    // pass were drawn in the right order by distance.
+    bool is_consistent() const { return consistent_; }
+
+    unsigned get_num_program_changes( const RenderPass pass ) const { return num_program_changes_[pass]; }
+    unsigned get_num_draws( const RenderPass pass ) const { return num_draws_[pass]; }
+
+protected:
+
+    int pass_;
+
+    bool in_pass_;
+
+    bool program_selected_;
+
+    RendererMaterialManager::MaterialProgram program_;
+
+    Scalar last_distance_squared_;
+
+    bool consistent_;
+
+    unsigned
+        num_program_changes_[NUM_RENDER_PASSES],
+        num_draws_[NUM_RENDER_PASSES];
+};
+
+#endif // RENDER_LIST_H
@@ -20,10 +20,16 @@
 
 #include <GL/glew.h>
 
+#include <algorithm>
+#include <queue>
+
 #include <boost/numeric/conversion/cast.hpp>
 #include <boost/foreach.hpp>
+#include <boost/bind.hpp>
 
+#include "log.h"
 #include "renderer.h"
+#include "gl_call_counter.h"
 
 //////////////////////////////////////////////////////////////////////////////////
 // Local definitions:
@@ -49,16 +55,135 @@ struct SimplePositionVertex
 
 typedef std::vector<SimplePositionVertex> SimplePositionVertexV;
 
+// Returns true if a face pointing in the given direction, anywhere inside 'aabb', could be
+// facing towards 'position'.  Faces that point away from the viewer are always culled, so
+// the rest of them need not be drawn at all.
+bool faces_may_be_visible( const CardinalRelation relation, const AABoxf& aabb, const Vector3f& position )
+{
+    const Vector3i direction = cardinal_relation_vector( relation );
+
+    for ( int i = 0; i < Vector3i::Size; ++i )
+    {
+        if ( direction[i] > 0 )
+        {
+            return position[i] > aabb.getMin()[i];
+        }
+        else if ( direction[i] < 0 )
+        {
+            return position[i] < aabb.getMax()[i];
+        }
+    }
+
+    return true;
+}
+
+// The BlockVertexLayout describes the block vertex attributes to GL.  It is only used when
+// a vertex array object is set up; the object then keeps the attributes, so that drawing
+// from its buffers only takes a bind and a draw call.
+struct BlockVertexLayout
+{
+    struct Attribute
+    {
+        GLuint index_;
+        GLint size_;
+        GLboolean normalized_;
+        size_t offset_;
+    };
+
+    // Enables the attributes of the bound vertex array object, and points them at the
+    // BlockVertices in the bound GL_ARRAY_BUFFER.
+    static void configure()
+    {
+        for ( size_t i = 0; i < NUM_ATTRIBUTES; ++i )
+        {
+            const Attribute& attribute = ATTRIBUTES[i];
+            glEnableVertexAttribArray( attribute.index_ );
+            glVertexAttribPointer(
+                attribute.index_,
+                attribute.size_,
+                GL_UNSIGNED_BYTE,
+                attribute.normalized_,
+                sizeof( BlockVertex ),
+                reinterpret_cast<void*>( attribute.offset_ )
+            );
+        }
+    }
+
+    static const Attribute ATTRIBUTES[];
+
+    static const size_t NUM_ATTRIBUTES;
+};
+
+const BlockVertexLayout::Attribute BlockVertexLayout::ATTRIBUTES[] =
+{
+    { RendererMaterialManager::POSITION_ATTRIBUTE, 3, GL_FALSE, 0 },
+    { RendererMaterialManager::FACE_ATTRIBUTE, 1, GL_FALSE, 3 },
+    { RendererMaterialManager::TEXTURE_COORDINATES_ATTRIBUTE, 3, GL_FALSE, 4 },
+#ifndef LIGHT_VOLUMES
+    { RendererMaterialManager::LIGHTING_ATTRIBUTE, 3, GL_TRUE, 8 },
+    { RendererMaterialManager::SUNLIGHTING_ATTRIBUTE, 3, GL_TRUE, 12 }
+#endif
+};
+
+const size_t BlockVertexLayout::NUM_ATTRIBUTES =
+    sizeof( BlockVertexLayout::ATTRIBUTES ) / sizeof( BlockVertexLayout::Attribute );
+
+// Sorts the (key, value) pairs by key, one byte of the key at a time, starting with the
+// least significant.  Each pass is stable, so the pairs with equal keys keep their order.
+// The passes for the bytes that are the same in every key are skipped.
+template <typename PairV>
+void radix_sort( PairV& pairs )
+{
+    const int RADIX_BITS = 8;
+    const size_t RADIX = 1 << RADIX_BITS;
+
+    PairV sorted( pairs.size() );
+
+    for ( int shift = 0; shift < 32; shift += RADIX_BITS )
+    {
+        size_t offsets[RADIX + 1];
+        std::fill( offsets, offsets + RADIX + 1, 0 );
+
+        BOOST_FOREACH( const typename PairV::value_type& pair, pairs )
+        {
+            ++offsets[( ( pair.first >> shift ) & ( RADIX - 1 ) ) + 1];
+        }
+
+        if ( std::find( offsets + 1, offsets + RADIX + 1, pairs.size() ) != offsets + RADIX + 1 )
+        {
+            continue;
+        }
+
+        for ( size_t i = 1; i <= RADIX; ++i )
+        {
+            offsets[i] += offsets[i - 1];
+        }
+
+        BOOST_FOREACH( const typename PairV::value_type& pair, pairs )
+        {
+            sorted[offsets[( pair.first >> shift ) & ( RADIX - 1 )]++] = pair;
+        }
+
+        pairs.swap( sorted );
+    }
+}
+
 template <typename T>
 void set_buffer_data( const GLenum target, const std::vector<T>& vertices, const GLenum usage )
 {
     glBufferData( target, vertices.size() * sizeof( T ), &vertices[0], usage );
 }
 
-bool face_material_order( const BlockFace& a, const BlockFace& b )
+// A step of the flood that finds the Chunks which are not hidden by terrain.  The entry
+// face is the face of the Chunk that the flood came in through (NUM_CARDINAL_RELATIONS for
+// the Chunk that holds the camera), and the directions are a mask of the CardinalRelations
+// that the flood has moved in to get there.
+struct VisibilityFloodStep
 {
-    return a.material_ < b.material_;
-}
+    Vector3i position_;
+    CardinalRelation entry_face_;
+    uint8_t directions_;
+};
 
 } // anonymous namespace
 
@@ -139,67 +264,362 @@ void VertexBuffer::unbind()
     glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, 0 );
 }
 
-void VertexBuffer::draw_elements()
+void VertexBuffer::draw_elements( const GLenum index_type )
 {
-    glDrawElements( GL_TRIANGLES, num_elements_, GL_UNSIGNED_INT, 0 );
+    glDrawElements( GL_TRIANGLES, num_elements_, index_type, 0 );
 }
 
 //////////////////////////////////////////////////////////////////////////////////
-// Function definitions for ChunkVertexBuffer:
+// Static constant definitions for QuadIndexBuffer:
+//////////////////////////////////////////////////////////////////////////////////
+
+const GLsizei
+    QuadIndexBuffer::VERTICES_PER_QUAD,
+    QuadIndexBuffer::INDICES_PER_QUAD,
+    QuadIndexBuffer::MIN_QUADS,
+    QuadIndexBuffer::MAX_SHORT_QUADS;
+
+//////////////////////////////////////////////////////////////////////////////////
+// Function definitions for QuadIndexBuffer:
+//////////////////////////////////////////////////////////////////////////////////
+
+QuadIndexBuffer::QuadIndexBuffer() :
+    num_quads_( 0 ),
+    index_type_( GL_UNSIGNED_SHORT )
+{
+    glGenBuffers( 1, &ibo_id_ );
+    reserve( MIN_QUADS );
+}
+
+QuadIndexBuffer::~QuadIndexBuffer()
+{
+    glDeleteBuffers( 1, &ibo_id_ );
+}
+
+void QuadIndexBuffer::reserve( const GLsizei num_quads )
+{
+    if ( num_quads <= num_quads_ )
+    {
+        return;
+    }
+
+    GLsizei capacity = std::max( num_quads_, MIN_QUADS );
+
+    while ( capacity < num_quads )
+    {
+        capacity *= 2;
+    }
+
+    if ( capacity <= MAX_SHORT_QUADS )
+    {
+        upload<GLushort>( capacity );
+        index_type_ = GL_UNSIGNED_SHORT;
+    }
+    else
+    {
+        upload<GLuint>( capacity );
+        index_type_ = GL_UNSIGNED_INT;
+    }
+
+    num_quads_ = capacity;
+}
+
+void QuadIndexBuffer::bind()
+{
+    glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, ibo_id_ );
+}
+
+template <typename IndexT>
+void QuadIndexBuffer::upload( const GLsizei num_quads )
+{
+    std::vector<IndexT> indices;
+    indices.reserve( num_quads * INDICES_PER_QUAD );
+
+    for ( GLsizei i = 0; i < num_quads * VERTICES_PER_QUAD; i += VERTICES_PER_QUAD )
+    {
+        indices.push_back( IndexT( i + 0 ) );
+        indices.push_back( IndexT( i + 3 ) );
+        indices.push_back( IndexT( i + 2 ) );
+
+        indices.push_back( IndexT( i + 0 ) );
+        indices.push_back( IndexT( i + 2 ) );
+        indices.push_back( IndexT( i + 1 ) );
+    }
+
+    bind();
+    set_buffer_data( GL_ELEMENT_ARRAY_BUFFER, indices, GL_STATIC_DRAW );
+    glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, 0 );
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+// Static constant definitions for VertexArena:
 //////////////////////////////////////////////////////////////////////////////////
 
-ChunkVertexBuffer::ChunkVertexBuffer( const BlockVertexV& vertices, const GLenum vertex_usage, const GLenum index_usage )
+const GLsizei VertexArena::MIN_QUADS;
+
+const size_t VertexArena::QUAD_SIZE;
+
+//////////////////////////////////////////////////////////////////////////////////
+// Function definitions for VertexArena:
+//////////////////////////////////////////////////////////////////////////////////
+
+VertexArena::VertexArena() :
+    vbo_id_( 0 ),
+    layout_vbo_id_( 0 )
+{
+    glGenVertexArrays( 1, &vao_id_ );
+    resize( MIN_QUADS );
+}
+
+VertexArena::~VertexArena()
+{
+    glDeleteVertexArrays( 1, &vao_id_ );
+    glDeleteBuffers( 1, &vbo_id_ );
+}
+
+GLsizei VertexArena::allocate( const BlockVertexV& vertices )
 {
     assert( vertices.size() > 0 );
+    assert( vertices.size() % QuadIndexBuffer::VERTICES_PER_QUAD == 0 );
 
-    std::vector<VertexBuffer::Index> indices;
-    indices.reserve( vertices.size() + vertices.size() / 2 );
+    const unsigned num_quads = vertices.size() / QuadIndexBuffer::VERTICES_PER_QUAD;
+    unsigned first_quad;
 
-    for ( int i = 0; i < int( vertices.size() ); i += 4 )
+    while ( !allocator_.allocate( num_quads, first_quad ) )
     {
-        indices.push_back( i + 0 );
-        indices.push_back( i + 3 );
-        indices.push_back( i + 2 );
+        resize( allocator_.get_size() * 2 );
+    }
 
-        indices.push_back( i + 0 );
-        indices.push_back( i + 2 );
-        indices.push_back( i + 1 );
+    update( first_quad, vertices );
+    return first_quad;
+}
+
+void VertexArena::free( const GLsizei first_quad )
+{
+    allocator_.free( first_quad );
+}
+
+void VertexArena::update( const GLsizei first_quad, const BlockVertexV& vertices )
+{
+    glBindBuffer( GL_ARRAY_BUFFER, vbo_id_ );
+    glBufferSubData( GL_ARRAY_BUFFER, first_quad * QUAD_SIZE, vertices.size() * sizeof( BlockVertex ), &vertices[0] );
+    glBindBuffer( GL_ARRAY_BUFFER, 0 );
+}
+
+void VertexArena::bind( QuadIndexBuffer& quad_indices )
+{
+    glBindVertexArray( vao_id_ );
+
+    // The attributes point into the vertex buffer itself, so they are set up again whenever
+    // resize() has replaced it.
+    if ( layout_vbo_id_ != vbo_id_ )
+    {
+        glBindBuffer( GL_ARRAY_BUFFER, vbo_id_ );
+        BlockVertexLayout::configure();
+        glBindBuffer( GL_ARRAY_BUFFER, 0 );
+        quad_indices.bind();
+        layout_vbo_id_ = vbo_id_;
     }
+}
 
-    BindGuard bind_guard( *this );
+void VertexArena::unbind()
+{
+    glBindVertexArray( 0 );
+}
+
+void VertexArena::render( const GLenum index_type, const RangeV& ranges ) const
+{
+    const GLsizei index_size = index_type == GL_UNSIGNED_SHORT ? sizeof( GLushort ) : sizeof( GLuint );
+
+    std::vector<GLsizei> counts;
+    std::vector<GLvoid*> indices;
+    std::vector<GLint> base_vertices;
+
+    counts.reserve( ranges.size() );
+    indices.reserve( ranges.size() );
+    base_vertices.reserve( ranges.size() );
+
+    // Every allocation uses the same quad indices, which are offset by its first vertex.
+    BOOST_FOREACH( const Range& range, ranges )
+    {
+        const QuadRange& quads = range.second;
+        counts.push_back( quads.second * QuadIndexBuffer::INDICES_PER_QUAD );
+        indices.push_back( reinterpret_cast<GLvoid*>( quads.first * QuadIndexBuffer::INDICES_PER_QUAD * index_size ) );
+        base_vertices.push_back( range.first * QuadIndexBuffer::VERTICES_PER_QUAD );
+    }
+
+    glMultiDrawElementsBaseVertex( GL_TRIANGLES, &counts[0], index_type, &indices[0], counts.size(), &base_vertices[0] );
+}
+
+void VertexArena::shrink()
+{
+    GLsizei num_quads = allocator_.get_size();
+
+    while ( num_quads / 2 >= MIN_QUADS && num_quads / 2 >= GLsizei( allocator_.get_used_size() ) )
+    {
+        num_quads /= 2;
+    }
+
+    if ( num_quads < GLsizei( allocator_.get_size() ) )
+    {
+        resize( num_quads );
+    }
+}
+
+void VertexArena::resize( const GLsizei num_quads )
+{
+    assert( num_quads >= GLsizei( allocator_.get_used_size() ) );
+
+    GLuint new_vbo_id;
+    glGenBuffers( 1, &new_vbo_id );
+    glBindBuffer( GL_COPY_WRITE_BUFFER, new_vbo_id );
+    glBufferData( GL_COPY_WRITE_BUFFER, num_quads * QUAD_SIZE, 0, GL_DYNAMIC_DRAW );
+
+    // The existing allocations stay where they are, so the old contents are copied over
+    // as they are, without a round trip through system memory.  Only the part that holds
+    // allocations needs to be copied.
+    if ( vbo_id_ )
+    {
+        glBindBuffer( GL_COPY_READ_BUFFER, vbo_id_ );
+        glCopyBufferSubData( GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, allocator_.get_used_size() * QUAD_SIZE );
+        glBindBuffer( GL_COPY_READ_BUFFER, 0 );
+        glDeleteBuffers( 1, &vbo_id_ );
+    }
+
+    glBindBuffer( GL_COPY_WRITE_BUFFER, 0 );
+
+    vbo_id_ = new_vbo_id;
+
+    if ( num_quads > GLsizei( allocator_.get_size() ) )
+    {
+        allocator_.grow( num_quads );
+    }
+    else allocator_.shrink( num_quads );
+
+    LOG( "Resized the vertex arena to " << num_quads << " quads." );
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+// Function definitions:
+//////////////////////////////////////////////////////////////////////////////////
+
+void get_visible_opaque_ranges(
+    const unsigned face_offsets[NUM_CARDINAL_RELATIONS + 1],
+    const GLsizei first_quad,
+    const AABoxf& aabb,
+    const Vector3f& camera_position,
+    VertexArena::RangeV& ranges
+)
+{
+    const size_t first_range = ranges.size();
+
+    FOREACH_CARDINAL_RELATION( relation )
+    {
+        const GLsizei
+            first = face_offsets[relation],
+            count = face_offsets[relation + 1] - first;
+
+        if ( count == 0 || !faces_may_be_visible( relation, aabb, camera_position ) )
+        {
+            continue;
+        }
+
+        if ( ranges.size() > first_range && ranges.back().second.first + ranges.back().second.second == first )
+        {
+            ranges.back().second.second += count;
+        }
+        else ranges.push_back( VertexArena::Range( first_quad, QuadRange( first, count ) ) );
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+// Function definitions for ChunkVertexBuffer:
+//////////////////////////////////////////////////////////////////////////////////
+
+ChunkVertexBuffer::ChunkVertexBuffer( const BlockVertexV& vertices, const GLenum vertex_usage ) :
+    VertexBuffer( vertices.size() / QuadIndexBuffer::VERTICES_PER_QUAD * QuadIndexBuffer::INDICES_PER_QUAD ),
+    num_vertices_( vertices.size() )
+{
+    assert( vertices.size() > 0 );
+    assert( vertices.size() % QuadIndexBuffer::VERTICES_PER_QUAD == 0 );
+
+    // Only the vertices are uploaded here; the indices are left to the derived class.
+    glGenVertexArrays( 1, &vao_id_ );
+    glBindVertexArray( vao_id_ );
+
+    glBindBuffer( GL_ARRAY_BUFFER, vbo_id_ );
     set_buffer_data( GL_ARRAY_BUFFER, vertices, vertex_usage );
-    set_buffer_data( GL_ELEMENT_ARRAY_BUFFER, indices, index_usage );
-    num_elements_ = indices.size();
+    BlockVertexLayout::configure();
+    glBindBuffer( GL_ARRAY_BUFFER, 0 );
+
+    glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, ibo_id_ );
+
+    glBindVertexArray( 0 );
 }
 
-void ChunkVertexBuffer::render()
+ChunkVertexBuffer::~ChunkVertexBuffer()
 {
-    BindGuard bind_guard( *this );
-    render_no_bind();
+    glDeleteVertexArrays( 1, &vao_id_ );
 }
 
-void ChunkVertexBuffer::render_no_bind()
+void ChunkVertexBuffer::bind_vertex_array()
 {
-    ClientStateGuard vertex_array_guard( GL_VERTEX_ARRAY );
-    glVertexPointer( 3, GL_FLOAT, sizeof( BlockVertex ), reinterpret_cast<void*>( 0 ) );
+    glBindVertexArray( vao_id_ );
+}
 
-    ClientStateGuard normal_array_guard( GL_NORMAL_ARRAY );
-    glNormalPointer( GL_FLOAT, sizeof( BlockVertex ), reinterpret_cast<void*>( 12 ) );
+void ChunkVertexBuffer::render_no_bind( const GLenum index_type, const QuadRangeV& ranges )
+{
+    const GLsizei index_size = index_type == GL_UNSIGNED_SHORT ? sizeof( GLushort ) : sizeof( GLuint );
 
-    TextureStateGuard texture_coord_array_guard0( GL_TEXTURE0, GL_TEXTURE_COORD_ARRAY );
-    glTexCoordPointer( 3, GL_FLOAT, sizeof( BlockVertex ), reinterpret_cast<void*>( 24 ) );
+    BOOST_FOREACH( const QuadRange& range, ranges )
+    {
+        assert( ( range.first + range.second ) * QuadIndexBuffer::INDICES_PER_QUAD <= num_elements_ );
+
+        glDrawElements(
+            GL_TRIANGLES,
+            range.second * QuadIndexBuffer::INDICES_PER_QUAD,
+            index_type,
+            reinterpret_cast<void*>( range.first * QuadIndexBuffer::INDICES_PER_QUAD * index_size )
+        );
+    }
+}
 
-    TextureStateGuard texture_coord_array_guard1( GL_TEXTURE1, GL_TEXTURE_COORD_ARRAY );
-    glTexCoordPointer( 3, GL_FLOAT, sizeof( BlockVertex ), reinterpret_cast<void*>( 36 ) );
+#ifndef LIGHT_VOLUMES
+void ChunkVertexBuffer::update_lighting( const BlockVertexV& vertices )
+{
+    assert( GLsizei( vertices.size() ) == num_vertices_ );
 
-    TextureStateGuard texture_coord_array_guard2( GL_TEXTURE2, GL_TEXTURE_COORD_ARRAY );
-    glTexCoordPointer( 3, GL_FLOAT, sizeof( BlockVertex ), reinterpret_cast<void*>( 48 ) );
+    glBindBuffer( GL_ARRAY_BUFFER, vbo_id_ );
+    BlockVertex* mapped_vertices = static_cast<BlockVertex*>( glMapBuffer( GL_ARRAY_BUFFER, GL_WRITE_ONLY ) );
 
-    TextureStateGuard texture_coord_array_guard3( GL_TEXTURE3, GL_TEXTURE_COORD_ARRAY );
-    glTexCoordPointer( 3, GL_FLOAT, sizeof( BlockVertex ), reinterpret_cast<void*>( 60 ) );
+    if ( mapped_vertices )
+    {
+        // Only the lighting fields are written, so the rest of each vertex is left as is.
+        for ( GLsizei i = 0; i < num_vertices_; ++i )
+        {
+            const BlockVertex& v = vertices[i];
+            BlockVertex& mapped = mapped_vertices[i];
 
-    draw_elements();
+            mapped.lr_ = v.lr_;
+            mapped.lg_ = v.lg_;
+            mapped.lb_ = v.lb_;
+
+            mapped.slr_ = v.slr_;
+            mapped.slg_ = v.slg_;
+            mapped.slb_ = v.slb_;
+        }
+
+        if ( !glUnmapBuffer( GL_ARRAY_BUFFER ) )
+        {
+            // The buffer contents were lost, so they must be replaced completely.
+            glBufferSubData( GL_ARRAY_BUFFER, 0, vertices.size() * sizeof( BlockVertex ), &vertices[0] );
+        }
+    }
+    else glBufferSubData( GL_ARRAY_BUFFER, 0, vertices.size() * sizeof( BlockVertex ), &vertices[0] );
+
+    glBindBuffer( GL_ARRAY_BUFFER, 0 );
 }
+#endif
 
 //////////////////////////////////////////////////////////////////////////////////
 // Static constant definitions for SortableChunkVertexBuffer:
@@ -207,16 +627,30 @@ void ChunkVertexBuffer::render_no_bind()
 
 const unsigned SortableChunkVertexBuffer::VERTICES_PER_FACE;
 
+//////////////////////////////////////////////////////////////////////////////////
+// Function definitions for SortableChunkVertexBuffer::Sort:
+//////////////////////////////////////////////////////////////////////////////////
+
+SortableChunkVertexBuffer::Sort::Sort( const Vector3fV& centroids ) :
+    centroids_( centroids ),
+    finished_( false )
+{
+}
+
 //////////////////////////////////////////////////////////////////////////////////
 // Function definitions for SortableChunkVertexBuffer:
 //////////////////////////////////////////////////////////////////////////////////
 
-SortableChunkVertexBuffer::SortableChunkVertexBuffer( const BlockVertexV& vertices ) :
-    ChunkVertexBuffer( vertices, GL_STATIC_DRAW, GL_DYNAMIC_DRAW )
+SortableChunkVertexBuffer::SortableChunkVertexBuffer( const BlockVertexV& vertices, const Vector3i& origin ) :
+    ChunkVertexBuffer( vertices ),
+    sorted_( false ),
+    sort_pending_( false )
 {
     assert( vertices.size() > 0 );
     assert( vertices.size() % VERTICES_PER_FACE == 0 );
 
+    Vector3fV centroids;
+
     for ( size_t i = 0; i < vertices.size(); i += VERTICES_PER_FACE )
     {
         Vector3f centroid;
@@ -228,186 +662,753 @@ SortableChunkVertexBuffer::SortableChunkVertexBuffer( const BlockVertexV& vertic
         }
 
         centroid /= VERTICES_PER_FACE;
+        centroid += vector_cast<Scalar>( origin );
 
         // Nudge the centroid slightly toward the center of the Block, so that
         // neighboring Blocks with different translucent materials won't Z fight.
         const BlockVertex& v = vertices[i];
-        centroid -= 0.1f * Vector3f( v.nx_, v.ny_, v.nz_ );
-        centroids_.push_back( centroid );
+        centroid -= 0.1f * vector_cast<Scalar>( cardinal_relation_vector( CardinalRelation( v.face_ ) ) );
+        centroids.push_back( centroid );
+    }
+
+    sort_.reset( new Sort( centroids ) );
+
+    glGenBuffers( 1, &back_ibo_id_ );
+}
+
+SortableChunkVertexBuffer::~SortableChunkVertexBuffer()
+{
+    glDeleteBuffers( 1, &back_ibo_id_ );
+}
+
+void SortableChunkVertexBuffer::schedule_sort( boost::threadpool::pool& sort_pool, const Vector3f& camera_position )
+{
+    const Vector3i camera_block = vector_cast<int>( pointwise_floor( camera_position ) );
+
+    // A buffer that has not been sorted yet is sorted in place by render(), and only one
+    // sort is run at a time, since a newer one would have to wait for the older one anyway.
+    if ( !sorted_ || sort_pending_ || camera_block == sorted_camera_block_ )
+    {
+        return;
     }
+
+    sort_pool.schedule( boost::bind( &SortableChunkVertexBuffer::run_sort, sort_, camera_position ) );
+    sort_pending_ = true;
+    sorted_camera_block_ = camera_block;
 }
 
 void SortableChunkVertexBuffer::render( const Camera& camera )
+{
+    // The index buffer is part of the vertex array object, so the object must be bound before
+    // any new indices are uploaded.
+    bind_vertex_array();
+
+    if ( sort_pending_ )
+    {
+        IndexV indices;
+
+        {
+            boost::lock_guard<boost::mutex> sort_guard( sort_->lock_ );
+
+            if ( sort_->finished_ )
+            {
+                indices.swap( sort_->indices_ );
+                sort_->finished_ = false;
+                sort_pending_ = false;
+            }
+        }
+
+        if ( !sort_pending_ )
+        {
+            upload_indices( indices );
+        }
+    }
+
+    if ( !sorted_ )
+    {
+        IndexV indices;
+        sort_faces( sort_->centroids_, camera.get_position(), indices );
+        upload_indices( indices );
+        sorted_ = true;
+        sorted_camera_block_ = vector_cast<int>( pointwise_floor( camera.get_position() ) );
+    }
+
+    render_no_bind( GL_UNSIGNED_INT, QuadRangeV( 1, QuadRange( 0, sort_->centroids_.size() ) ) );
+}
+
+size_t SortableChunkVertexBuffer::get_gpu_memory_used() const
+{
+    const size_t num_quads = num_vertices_ / VERTICES_PER_FACE;
+
+    return
+        num_vertices_ * sizeof( BlockVertex ) +
+        2 * num_quads * QuadIndexBuffer::INDICES_PER_QUAD * sizeof( VertexBuffer::Index );
+}
+
+void SortableChunkVertexBuffer::sort_faces( const Vector3fV& centroids, const Vector3f& camera_position, IndexV& indices )
 {
     DistanceIndexV distance_indices;
-    distance_indices.reserve( centroids_.size() );
+    distance_indices.reserve( centroids.size() );
 
     // Since these faces are translucent, they must be rendered strictly in back to front order.
 
-    for ( unsigned i = 0; i < centroids_.size(); ++i )
+    for ( unsigned i = 0; i < centroids.size(); ++i )
     {
-        const Vector3f camera_to_centroid = camera.get_position() - centroids_[i];
+        const Vector3f camera_to_centroid = camera_position - centroids[i];
         const Scalar distance_squared = gmtl::lengthSquared( camera_to_centroid );
-        distance_indices.push_back( std::make_pair( distance_squared, i ) );
+        distance_indices.push_back( std::make_pair( get_sort_key( distance_squared ), i ) );
+    }
+
+    radix_sort( distance_indices );
+
+    indices.clear();
+    indices.reserve( distance_indices.size() * 6 );
+
+    BOOST_REVERSE_FOREACH( const DistanceIndex& distance_index, distance_indices )
+    {
+        const unsigned face_index = distance_index.second;
+        const VertexBuffer::Index vertex_index = face_index * VERTICES_PER_FACE;
+
+        indices.push_back( vertex_index + 0 );
+        indices.push_back( vertex_index + 3 );
+        indices.push_back( vertex_index + 2 );
+
+        indices.push_back( vertex_index + 0 );
+        indices.push_back( vertex_index + 2 );
+        indices.push_back( vertex_index + 1 );
+    }
+}
+
+void SortableChunkVertexBuffer::run_sort( const SortSP& sort, const Vector3f& camera_position )
+{
+    IndexV indices;
+    sort_faces( sort->centroids_, camera_position, indices );
+
+    boost::lock_guard<boost::mutex> sort_guard( sort->lock_ );
+    sort->indices_.swap( indices );
+    sort->finished_ = true;
+}
+
+void SortableChunkVertexBuffer::upload_indices( const IndexV& indices )
+{
+    // This leaves the new indices bound to the vertex array object, in place of the old ones.
+    glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, back_ibo_id_ );
+    set_buffer_data( GL_ELEMENT_ARRAY_BUFFER, indices, GL_DYNAMIC_DRAW );
+
+    std::swap( ibo_id_, back_ibo_id_ );
+    num_elements_ = indices.size();
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+// Function definitions for AABoxVertexBuffer:
+//////////////////////////////////////////////////////////////////////////////////
+
+AABoxVertexBuffer::AABoxVertexBuffer( const AABoxf& aabb )
+{
+    const Vector3f& min = aabb.getMin();
+    const Vector3f& max = aabb.getMax();
+
+    const SimplePositionVertex vertices[] =
+    {
+        SimplePositionVertex( Vector3f( min[0], min[1], min[2] ) ),
+        SimplePositionVertex( Vector3f( max[0], min[1], min[2] ) ),
+        SimplePositionVertex( Vector3f( max[0], max[1], min[2] ) ),
+        SimplePositionVertex( Vector3f( min[0], max[1], min[2] ) ),
+        SimplePositionVertex( Vector3f( min[0], min[1], max[2] ) ),
+        SimplePositionVertex( Vector3f( max[0], min[1], max[2] ) ),
+        SimplePositionVertex( Vector3f( max[0], max[1], max[2] ) ),
+        SimplePositionVertex( Vector3f( min[0], max[1], max[2] ) )
+    };
+
+    const VertexBuffer::Index indices[] =
+    {
+        0, 2, 1, 0, 3, 2,
+        5, 7, 4, 5, 6, 7,
+        1, 6, 5, 1, 2, 6,
+        4, 3, 0, 4, 7, 3,
+        3, 6, 2, 3, 7, 6,
+        4, 1, 5, 4, 0, 1
+    };
+
+    BindGuard bind_guard( *this );
+    glBufferData( GL_ARRAY_BUFFER, sizeof( vertices ), vertices, GL_STATIC_DRAW );
+    glBufferData( GL_ELEMENT_ARRAY_BUFFER, sizeof( indices ), indices, GL_STATIC_DRAW );
+    num_elements_ = sizeof( indices ) / sizeof( VertexBuffer::Index );
+}
+
+void AABoxVertexBuffer::render()
+{
+    BindGuard bind_guard( *this );
+    ClientStateGuard vertex_array_guard( GL_VERTEX_ARRAY );
+    SimplePositionVertex::configure_vertex_pointer();
+    draw_elements();
+}
+
+#ifdef LIGHT_VOLUMES
+
+//////////////////////////////////////////////////////////////////////////////////
+// Function definitions for LightVolumeTexture:
+//////////////////////////////////////////////////////////////////////////////////
+
+LightVolumeTexture::LightVolumeTexture() :
+    origin_( 0, 0, 0 )
+{
+    GLuint* texture_ids[] = { &light_texture_id_, &sunlight_texture_id_ };
+
+    BOOST_FOREACH( GLuint* texture_id, texture_ids )
+    {
+        glGenTextures( 1, texture_id );
+        glBindTexture( GL_TEXTURE_3D, *texture_id );
+
+        glTexParameteri( GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE );
+        glTexParameteri( GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE );
+        glTexParameteri( GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE );
+        glTexParameteri( GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR );
+        glTexParameteri( GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
+
+        glTexImage3D(
+            GL_TEXTURE_3D, 0, GL_RGB8,
+            Chunk::LightVolume::SIZE_X, Chunk::LightVolume::SIZE_Y, Chunk::LightVolume::SIZE_Z,
+            0, GL_RGB, GL_UNSIGNED_BYTE, 0
+        );
+    }
+
+    glBindTexture( GL_TEXTURE_3D, 0 );
+}
+
+LightVolumeTexture::~LightVolumeTexture()
+{
+    glDeleteTextures( 1, &sunlight_texture_id_ );
+    glDeleteTextures( 1, &light_texture_id_ );
+}
+
+void LightVolumeTexture::update( const Vector3i& origin, const Chunk::LightVolume& volume )
+{
+    origin_ = origin;
+    upload( light_texture_id_, volume.light_ );
+    upload( sunlight_texture_id_, volume.sunlight_ );
+}
+
+void LightVolumeTexture::bind() const
+{
+    glActiveTexture( RendererMaterialManager::SUNLIGHT_VOLUME_TEXTURE_UNIT );
+    glBindTexture( GL_TEXTURE_3D, sunlight_texture_id_ );
+
+    glActiveTexture( RendererMaterialManager::LIGHT_VOLUME_TEXTURE_UNIT );
+    glBindTexture( GL_TEXTURE_3D, light_texture_id_ );
+
+    // The center of each Block must map onto the center of its texel.
+    const Vector3f volume_origin = vector_cast<Scalar>( origin_ ) -
+        vector_cast<Scalar>( Vector3i( Chunk::LightVolume::BORDER, Chunk::LightVolume::BORDER, Chunk::LightVolume::BORDER ) );
+
+    glMatrixMode( GL_TEXTURE );
+    glLoadIdentity();
+    glScalef(
+        1.0f / Chunk::LightVolume::SIZE_X,
+        1.0f / Chunk::LightVolume::SIZE_Y,
+        1.0f / Chunk::LightVolume::SIZE_Z
+    );
+    glTranslatef( -volume_origin[0], -volume_origin[1], -volume_origin[2] );
+    glMatrixMode( GL_MODELVIEW );
+}
+
+size_t LightVolumeTexture::get_gpu_memory_used() const
+{
+    // There are two RGB8 textures: one for the light, and one for the sunlight.
+    return 2 * 3 * Chunk::LightVolume::SIZE_X * Chunk::LightVolume::SIZE_Y * Chunk::LightVolume::SIZE_Z;
+}
+
+void LightVolumeTexture::upload( const GLuint texture_id, const void* data )
+{
+    glBindTexture( GL_TEXTURE_3D, texture_id );
+    glPixelStorei( GL_UNPACK_ALIGNMENT, 1 );
+    glTexSubImage3D(
+        GL_TEXTURE_3D, 0, 0, 0, 0,
+        Chunk::LightVolume::SIZE_X, Chunk::LightVolume::SIZE_Y, Chunk::LightVolume::SIZE_Z,
+        GL_RGB, GL_UNSIGNED_BYTE, data
+    );
+    glPixelStorei( GL_UNPACK_ALIGNMENT, 4 );
+    glBindTexture( GL_TEXTURE_3D, 0 );
+}
+
+#endif
+
+//////////////////////////////////////////////////////////////////////////////////
+// Function definitions for ChunkRenderer::Section:
+//////////////////////////////////////////////////////////////////////////////////
+
+ChunkRenderer::Section::Section() :
+    opaque_first_quad_( 0 ),
+    geometry_version_( 0 ),
+    lighting_version_( 0 )
+{
+    std::fill( opaque_face_offsets_, opaque_face_offsets_ + NUM_CARDINAL_RELATIONS + 1, 0 );
+}
+
+void ChunkRenderer::Section::release( VertexArena& opaque_arena )
+{
+    if ( get_num_opaque_quads() > 0 )
+    {
+        opaque_arena.free( opaque_first_quad_ );
+    }
+
+    std::fill( opaque_face_offsets_, opaque_face_offsets_ + NUM_CARDINAL_RELATIONS + 1, 0 );
+    geometry_version_ = 0;
+    lighting_version_ = 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+// Function definitions for ChunkRenderer:
+//////////////////////////////////////////////////////////////////////////////////
+
+ChunkRenderer::ChunkRenderer( VertexArena& opaque_arena, const Vector3f& centroid, const AABoxf& aabb ) :
+    opaque_arena_( opaque_arena ),
+    centroid_( centroid ),
+    aabb_( aabb ),
+    num_triangles_( 0 ),
+    num_translucent_triangles_( 0 ),
+    last_visible_frame_( 0 ),
+    gpu_memory_used_( 0 ),
+    evicted_( false ),
+    restore_requested_( false )
+{
+    for ( int i = 0; i < Chunk::NUM_SECTIONS; ++i )
+    {
+        Vector3f
+            section_min = aabb.getMin(),
+            section_max = aabb.getMax();
+
+        section_min[1] += Scalar( i * Chunk::SECTION_SIZE_Y );
+        section_max[1] = section_min[1] + Scalar( Chunk::SECTION_SIZE_Y );
+        sections_[i].aabb_ = AABoxf( section_min, section_max );
+    }
+
+    BOOST_FOREACH( Section& section, lod_sections_ )
+    {
+        section.aabb_ = aabb;
+    }
+}
+
+ChunkRenderer::~ChunkRenderer()
+{
+    release_sections();
+}
+
+void ChunkRenderer::render_opaque( const GLenum index_type, const Vector3f& camera_position, const int lod )
+{
+    assert( lod >= 0 && lod <= Chunk::NUM_LODS );
+
+    VertexArena::RangeV ranges;
+
+    if ( lod == 0 )
+    {
+        BOOST_FOREACH( const Section& section, sections_ )
+        {
+            if ( section.get_num_opaque_quads() > 0 )
+            {
+                section.get_visible_opaque_ranges( camera_position, ranges );
+            }
+        }
+    }
+    else
+    {
+        const Section& section = lod_sections_[lod - 1];
+
+        if ( section.get_num_opaque_quads() > 0 )
+        {
+            section.get_visible_opaque_ranges( camera_position, ranges );
+        }
+    }
+
+    if ( ranges.empty() )
+    {
+        return;
+    }
+
+#ifdef LIGHT_VOLUMES
+    light_volume_->bind();
+#endif
+    opaque_arena_.render( index_type, ranges );
+}
+
+void ChunkRenderer::render_translucent( const Camera& camera )
+{
+    if ( translucent_vbo_ )
+    {
+#ifdef LIGHT_VOLUMES
+        light_volume_->bind();
+#endif
+        translucent_vbo_->render( camera );
+    }
+}
+
+void ChunkRenderer::render_aabb()
+{
+    if ( !aabb_vbo_ )
+    {
+        aabb_vbo_.reset( new AABoxVertexBuffer( aabb_ ) );
+    }
+
+    aabb_vbo_->render();
+}
+
+void ChunkRenderer::schedule_translucent_sort( boost::threadpool::pool& sort_pool, const Vector3f& camera_position )
+{
+    if ( translucent_vbo_ )
+    {
+        translucent_vbo_->schedule_sort( sort_pool, camera_position );
+    }
+}
+
+unsigned ChunkRenderer::get_num_triangles( const int lod ) const
+{
+    assert( lod >= 0 && lod <= Chunk::NUM_LODS );
+
+    if ( lod == 0 )
+    {
+        return num_triangles_;
+    }
+
+    // The translucent faces are always drawn at full resolution.
+    return lod_sections_[lod - 1].get_num_opaque_quads() * 2 + num_translucent_triangles_;
+}
+
+void ChunkRenderer::update( const ChunkMesh& mesh )
+{
+    assert( mesh.sections_.size() == Chunk::NUM_SECTIONS );
+    assert( mesh.lod_sections_.size() == Chunk::NUM_LODS );
+
+    num_triangles_ = mesh.num_triangles_;
+    num_translucent_triangles_ = mesh.translucent_vertices_.size() / BlockVertex::VERTICES_PER_FACE * 2;
+    origin_ = mesh.position_;
+    evicted_ = false;
+    restore_requested_ = false;
+
+    bool
+        geometry_changed = false,
+        lighting_changed = false;
+
+    for ( int i = 0; i < Chunk::NUM_SECTIONS; ++i )
+    {
+        Section& section = sections_[i];
+        const ChunkMesh::Section& mesh_section = mesh.sections_[i];
+
+        if ( mesh_section.geometry_version_ != section.geometry_version_ )
+        {
+            geometry_changed = true;
+        }
+        else if ( mesh_section.lighting_version_ != section.lighting_version_ )
+        {
+            lighting_changed = true;
+        }
+
+        update_section( section, mesh_section );
+    }
+
+    for ( int i = 0; i < Chunk::NUM_LODS; ++i )
+    {
+        update_section( lod_sections_[i], mesh.lod_sections_[i] );
+    }
+
+    // The translucent faces are sorted together for the whole Chunk, so they are rebuilt if
+    // any Section's geometry has changed.
+    if ( geometry_changed )
+    {
+        if ( !mesh.translucent_vertices_.empty() )
+        {
+            translucent_vbo_.reset( new SortableChunkVertexBuffer( mesh.translucent_vertices_, origin_ ) );
+        }
+        else translucent_vbo_.reset();
+    }
+#ifndef LIGHT_VOLUMES
+    else if ( lighting_changed && translucent_vbo_ )
+    {
+        translucent_vbo_->update_lighting( mesh.translucent_vertices_ );
+    }
+#else
+    if ( geometry_changed || lighting_changed )
+    {
+        if ( !light_volume_ )
+        {
+            light_volume_.reset( new LightVolumeTexture );
+        }
+
+        light_volume_->update( mesh.position_, *mesh.light_volume_ );
+    }
+#endif
+
+    // Only the quads that this Chunk's Sections take up in the VertexArena are counted here,
+    // since that is all that evicting it would free.  The Renderer counts the free space in
+    // the arena separately.
+    gpu_memory_used_ = 0;
+
+    BOOST_FOREACH( const Section& section, sections_ )
+    {
+        gpu_memory_used_ += section.get_num_opaque_quads() * VertexArena::QUAD_SIZE;
+    }
+
+    BOOST_FOREACH( const Section& section, lod_sections_ )
+    {
+        gpu_memory_used_ += section.get_num_opaque_quads() * VertexArena::QUAD_SIZE;
+    }
+
+    if ( translucent_vbo_ )
+    {
+        gpu_memory_used_ += translucent_vbo_->get_gpu_memory_used();
+    }
+
+#ifdef LIGHT_VOLUMES
+    if ( light_volume_ )
+    {
+        gpu_memory_used_ += light_volume_->get_gpu_memory_used();
+    }
+#endif
+}
+
+void ChunkRenderer::evict()
+{
+    release_sections();
+
+    translucent_vbo_.reset();
+    aabb_vbo_.reset();
+#ifdef LIGHT_VOLUMES
+    light_volume_.reset();
+#endif
+
+    gpu_memory_used_ = 0;
+    evicted_ = true;
+    restore_requested_ = false;
+}
+
+void ChunkRenderer::update_section( Section& section, const ChunkMesh::Section& mesh_section )
+{
+    if ( mesh_section.geometry_version_ != section.geometry_version_ )
+    {
+        section.release( opaque_arena_ );
+
+        std::copy(
+            mesh_section.opaque_face_offsets_,
+            mesh_section.opaque_face_offsets_ + NUM_CARDINAL_RELATIONS + 1,
+            section.opaque_face_offsets_
+        );
+
+        if ( section.get_num_opaque_quads() > 0 )
+        {
+            section.opaque_first_quad_ = opaque_arena_.allocate( mesh_section.opaque_vertices_ );
+        }
+    }
+#ifndef LIGHT_VOLUMES
+    else if ( mesh_section.lighting_version_ != section.lighting_version_ )
+    {
+        // Only the lighting has changed, so the existing allocation is overwritten in place.
+        if ( section.get_num_opaque_quads() > 0 )
+        {
+            opaque_arena_.update( section.opaque_first_quad_, mesh_section.opaque_vertices_ );
+        }
     }
+#endif
 
-    std::sort( distance_indices.begin(), distance_indices.end() );
-    render_sorted( distance_indices );
+    section.geometry_version_ = mesh_section.geometry_version_;
+    section.lighting_version_ = mesh_section.lighting_version_;
 }
 
-void SortableChunkVertexBuffer::render_sorted( const DistanceIndexV distance_indices )
+void ChunkRenderer::release_sections()
 {
-    BindGuard bind_guard( *this );
-    IndexV indices;
-    indices.reserve( distance_indices.size() * 6 );
-
-    BOOST_REVERSE_FOREACH( const DistanceIndex& distance_index, distance_indices )
+    BOOST_FOREACH( Section& section, sections_ )
     {
-        const unsigned face_index = distance_index.second;
-        const VertexBuffer::Index vertex_index = face_index * VERTICES_PER_FACE;
-
-        indices.push_back( vertex_index + 0 );
-        indices.push_back( vertex_index + 3 );
-        indices.push_back( vertex_index + 2 );
+        section.release( opaque_arena_ );
+    }
 
-        indices.push_back( vertex_index + 0 );
-        indices.push_back( vertex_index + 2 );
-        indices.push_back( vertex_index + 1 );
+    BOOST_FOREACH( Section& section, lod_sections_ )
+    {
+        section.release( opaque_arena_ );
     }
+}
 
-    set_buffer_data( GL_ELEMENT_ARRAY_BUFFER, indices, GL_DYNAMIC_DRAW );
-    num_elements_ = indices.size();
-    render_no_bind();
+//////////////////////////////////////////////////////////////////////////////////
+// Function definitions for ChunkMesh::Section:
+//////////////////////////////////////////////////////////////////////////////////
+
+ChunkMesh::Section::Section( const Chunk::Section& section ) :
+    geometry_version_( section.geometry_version_ ),
+    lighting_version_( section.lighting_version_ ),
+    opaque_vertices_( section.opaque_vertices_ )
+{
+    std::copy(
+        section.opaque_face_offsets_,
+        section.opaque_face_offsets_ + NUM_CARDINAL_RELATIONS + 1,
+        opaque_face_offsets_
+    );
 }
 
 //////////////////////////////////////////////////////////////////////////////////
-// Function definitions for AABoxVertexBuffer:
+// Function definitions for ChunkMesh:
 //////////////////////////////////////////////////////////////////////////////////
 
-AABoxVertexBuffer::AABoxVertexBuffer( const AABoxf& aabb )
+ChunkMesh::ChunkMesh( const Chunk& chunk ) :
+    position_( chunk.get_position() ),
+    num_triangles_( chunk.get_num_faces() * 2 ), // Two triangles per (square) face.
+    face_connectivity_( chunk.get_face_connectivity() ),
+    occluder_height_( chunk.get_occluder_height() )
 {
-    const Vector3f& min = aabb.getMin();
-    const Vector3f& max = aabb.getMax();
+    sections_.reserve( Chunk::NUM_SECTIONS );
 
-    const SimplePositionVertex vertices[] =
+    for ( int i = 0; i < Chunk::NUM_SECTIONS; ++i )
     {
-        SimplePositionVertex( Vector3f( min[0], min[1], min[2] ) ),
-        SimplePositionVertex( Vector3f( max[0], min[1], min[2] ) ),
-        SimplePositionVertex( Vector3f( max[0], max[1], min[2] ) ),
-        SimplePositionVertex( Vector3f( min[0], max[1], min[2] ) ),
-        SimplePositionVertex( Vector3f( min[0], min[1], max[2] ) ),
-        SimplePositionVertex( Vector3f( max[0], min[1], max[2] ) ),
-        SimplePositionVertex( Vector3f( max[0], max[1], max[2] ) ),
-        SimplePositionVertex( Vector3f( min[0], max[1], max[2] ) )
-    };
+        const Chunk::Section& section = chunk.get_section( i );
+        sections_.push_back( Section( section ) );
+        translucent_vertices_.insert( translucent_vertices_.end(), section.translucent_vertices_.begin(), section.translucent_vertices_.end() );
+    }
 
-    const VertexBuffer::Index indices[] =
+    lod_sections_.reserve( Chunk::NUM_LODS );
+
+    for ( int lod = 1; lod <= Chunk::NUM_LODS; ++lod )
     {
-        0, 2, 1, 0, 3, 2,
-        5, 7, 4, 5, 6, 7,
-        1, 6, 5, 1, 2, 6,
-        4, 3, 0, 4, 7, 3,
-        3, 6, 2, 3, 7, 6,
-        4, 1, 5, 4, 0, 1
-    };
+        lod_sections_.push_back( Section( chunk.get_lod_section( lod ) ) );
+    }
 
-    BindGuard bind_guard( *this );
-    glBufferData( GL_ARRAY_BUFFER, sizeof( vertices ), vertices, GL_STATIC_DRAW );
-    glBufferData( GL_ELEMENT_ARRAY_BUFFER, sizeof( indices ), indices, GL_STATIC_DRAW );
-    num_elements_ = sizeof( indices ) / sizeof( VertexBuffer::Index );
+#ifdef LIGHT_VOLUMES
+    if ( !empty() )
+    {
+        light_volume_.reset( new Chunk::LightVolume );
+        chunk.get_light_volume( *light_volume_ );
+    }
+#endif
 }
 
-void AABoxVertexBuffer::render()
+bool ChunkMesh::empty() const
 {
-    BindGuard bind_guard( *this );
-    ClientStateGuard vertex_array_guard( GL_VERTEX_ARRAY );
-    SimplePositionVertex::configure_vertex_pointer();
-    draw_elements();
+    BOOST_FOREACH( const Section& section, sections_ )
+    {
+        if ( !section.opaque_vertices_.empty() )
+        {
+            return false;
+        }
+    }
+
+    return translucent_vertices_.empty();
 }
 
 //////////////////////////////////////////////////////////////////////////////////
-// Function definitions for ChunkRenderer:
+// Function definitions for ChunkRenderBackend:
 //////////////////////////////////////////////////////////////////////////////////
 
-ChunkRenderer::ChunkRenderer( const Vector3f& centroid, const AABoxf& aabb ) :
-    aabb_vbo_( aabb ),
-    centroid_( centroid ),
-    aabb_( aabb ),
-    num_triangles_( 0 )
+ChunkRenderBackend::ChunkRenderBackend(
+    RendererMaterialManager& material_manager,
+    VertexArena& opaque_arena,
+    QuadIndexBuffer& quad_indices,
+    const Camera& camera,
+    const Sky& sky
+) :
+    material_manager_( material_manager ),
+    opaque_arena_( opaque_arena ),
+    quad_indices_( quad_indices ),
+    camera_( camera ),
+    sky_( sky ),
+    pass_( RENDER_PASS_OPAQUE )
 {
 }
 
-void ChunkRenderer::render_opaque()
+void ChunkRenderBackend::begin_pass( const RenderPass pass )
 {
-    if ( opaque_vbo_ )
-    {
-        opaque_vbo_->render();
-    }
-}
+    pass_ = pass;
 
-void ChunkRenderer::render_translucent( const Camera& camera )
-{
-    if ( translucent_vbo_ )
+    switch ( pass )
     {
-        translucent_vbo_->render( camera );
-    }
-}
+        case RENDER_PASS_OPAQUE:
+            material_manager_.configure_materials( camera_, sky_ );
 
-void ChunkRenderer::render_aabb()
-{
-    aabb_vbo_.render();
-}
+            glEnable( GL_CULL_FACE );
+            glEnable( GL_DEPTH_TEST );
+            glDepthFunc( GL_LEQUAL );
 
-void ChunkRenderer::rebuild( const Chunk& chunk )
-{
-    BlockFaceV faces = chunk.get_external_faces();
-    num_triangles_ = faces.size() * 2; // Two triangles per (square) face.
+            // All of the opaque vertices are in the VertexArena, so its vertex array object
+            // is only bound once for all of the Chunks.
+            opaque_arena_.bind( quad_indices_ );
+            break;
 
-    BlockVertexV
-        opaque_vertices,
-        translucent_vertices;
+        case RENDER_PASS_TRANSLUCENT:
+            glDisable( GL_CULL_FACE );
+            glDepthMask( GL_FALSE );
+            break;
 
-    // Although each vertex specifies its own texture ID, and thus the faces can be drawn in
-    // any order, it makes sense to group them together by texture, under the assumption that
-    // this will be more friendly to the GPU's texture cache.
+        case RENDER_PASS_CHUNK_BOUNDS:
+#ifdef DEBUG_CHUNKS
+            glEnable( GL_BLEND );
+            glEnable( GL_CULL_FACE );
+            glEnable( GL_POLYGON_OFFSET_FILL );
+            glPolygonOffset( 1.0f, 3.0f );
+            glColor4f( 1.0f, 0.0f, 0.0f, 0.3f );
+#endif
+            break;
 
-    std::sort( faces.begin(), faces.end(), face_material_order );
+        default:
+            assert( false );
+    }
+}
 
-    BOOST_FOREACH( const BlockFace& face, faces )
+void ChunkRenderBackend::end_pass( const RenderPass pass )
+{
+    switch ( pass )
     {
-        const BlockMaterial material = face.material_;
+        case RENDER_PASS_OPAQUE:
+            opaque_arena_.unbind();
+            break;
 
-        if ( get_block_material_attributes( material ).translucent_ )
-        {
-            get_vertices_for_face( face, translucent_vertices );
-        }
-        else get_vertices_for_face( face, opaque_vertices );
-    }
+        case RENDER_PASS_TRANSLUCENT:
+            // Each of the translucent buffers binds its own vertex array object.
+            glBindVertexArray( 0 );
 
-    if ( !opaque_vertices.empty() )
-    {
-        opaque_vbo_.reset( new ChunkVertexBuffer( opaque_vertices ) );
+            material_manager_.deconfigure_materials();
+            break;
+
+        case RENDER_PASS_CHUNK_BOUNDS:
+#ifdef DEBUG_CHUNKS
+            glColor4f( 1.0f, 1.0f, 1.0f, 1.0f );
+            glDisable( GL_POLYGON_OFFSET_FILL );
+            glDisable( GL_CULL_FACE );
+            glDisable( GL_BLEND );
+#endif
+            // This is the last pass, so the depth state is restored here.
+            glDepthMask( GL_TRUE );
+            glDisable( GL_DEPTH_TEST );
+            break;
+
+        default:
+            assert( false );
     }
-    else opaque_vbo_.reset();
+}
 
-    if ( !translucent_vertices.empty() )
+void ChunkRenderBackend::select_program( const RendererMaterialManager::MaterialProgram program )
+{
+    // The Chunk bounds are drawn without the materials.
+    if ( pass_ != RENDER_PASS_CHUNK_BOUNDS )
     {
-        translucent_vbo_.reset( new SortableChunkVertexBuffer( translucent_vertices ) );
+        material_manager_.select_program( program );
     }
-    else translucent_vbo_.reset();
 }
 
-void ChunkRenderer::get_vertices_for_face( const BlockFace& face, BlockVertexV& vertices ) const
+void ChunkRenderBackend::draw( const RenderItem& item )
 {
-    const BlockFace::Vertex* v = face.vertices_;
-    const Vector3f& n = face.normal_;
-    const Vector3f& t = face.tangent_;
-    const Scalar m = face.material_;
-
-    vertices.push_back( BlockVertex( v[0].position_, n, t, Vector3f( 0.0f, 0.0f, m ), v[0].lighting_, v[0].sunlighting_ ) );
-    vertices.push_back( BlockVertex( v[1].position_, n, t, Vector3f( 1.0f, 0.0f, m ), v[1].lighting_, v[1].sunlighting_ ) );
-    vertices.push_back( BlockVertex( v[2].position_, n, t, Vector3f( 1.0f, 1.0f, m ), v[2].lighting_, v[2].sunlighting_ ) );
-    vertices.push_back( BlockVertex( v[3].position_, n, t, Vector3f( 0.0f, 1.0f, m ), v[3].lighting_, v[3].sunlighting_ ) );
+    switch ( item.pass_ )
+    {
+        case RENDER_PASS_OPAQUE:
+            material_manager_.set_chunk_origin( item.chunk_->get_origin() );
+            item.chunk_->render_opaque( quad_indices_.get_index_type(), camera_.get_position(), item.lod_ );
+            break;
+
+        case RENDER_PASS_TRANSLUCENT:
+            material_manager_.set_chunk_origin( item.chunk_->get_origin() );
+            item.chunk_->render_translucent( camera_ );
+            break;
+
+        case RENDER_PASS_CHUNK_BOUNDS:
+            item.chunk_->render_aabb();
+            break;
+
+        default:
+            assert( false );
+    }
 }
 
 //////////////////////////////////////////////////////////////////////////////////
@@ -614,42 +1615,89 @@ void SkyRenderer::render_celestial_body( const GLuint texture_id, const Vector3f
     glBindTexture( GL_TEXTURE_2D, 0 );
 }
 
+//////////////////////////////////////////////////////////////////////////////////
+// Static constant definitions for Renderer:
+//////////////////////////////////////////////////////////////////////////////////
+
+const size_t Renderer::DEFAULT_GPU_MEMORY_BUDGET;
+
+const Scalar
+    Renderer::DEFAULT_LOD_DISTANCE,
+    Renderer::DEFAULT_FAR_DISTANCE;
+
 //////////////////////////////////////////////////////////////////////////////////
 // Function definitions for Renderer:
 //////////////////////////////////////////////////////////////////////////////////
 
 Renderer::Renderer() :
     num_chunks_drawn_( 0 ),
-    num_triangles_drawn_( 0 )
+    num_chunks_near_( 0 ),
+    num_chunks_far_( 0 ),
+    num_chunks_hidden_( 0 ),
+    num_chunks_occluded_( 0 ),
+    num_triangles_drawn_( 0 ),
+#ifdef DEBUG_GL_CALLS
+    num_gl_calls_( 0 ),
+    num_gl_draw_calls_( 0 ),
+#endif
+    frame_number_( 0 ),
+    gpu_memory_budget_( DEFAULT_GPU_MEMORY_BUDGET ),
+    gpu_memory_used_( 0 ),
+    lod_distance_( DEFAULT_LOD_DISTANCE ),
+    far_distance_( DEFAULT_FAR_DISTANCE ),
+    sort_pool_( std::max( boost::thread::hardware_concurrency(), 1u ) )
 {
+    // No Section can have more faces than this, so the quad indices never need to grow.
+    quad_indices_.reserve( Chunk::SIZE_X * Chunk::SECTION_SIZE_Y * Chunk::SIZE_Z * NUM_CARDINAL_RELATIONS );
 }
 
-void Renderer::note_chunk_changes( const Chunk& chunk )
+void Renderer::note_chunk_changes( const ChunkMesh& mesh )
 {
-    ChunkRendererMap::iterator chunk_renderer_it = chunk_renderers_.find( chunk.get_position() );
+    ChunkOcclusion& occlusion = chunk_occlusion_[mesh.position_];
+    occlusion.face_connectivity_ = mesh.face_connectivity_;
+    occlusion.occluder_height_ = mesh.occluder_height_;
+
+    ChunkRendererMap::iterator chunk_renderer_it = chunk_renderers_.find( mesh.position_ );
 
     if ( chunk_renderer_it == chunk_renderers_.end() )
     {
-        if ( !chunk.get_external_faces().empty() )
+        if ( !mesh.empty() )
         {
             const Vector3f centroid =
-                vector_cast<Scalar>( chunk.get_position() ) +
+                vector_cast<Scalar>( mesh.position_ ) +
                 vector_cast<Scalar>( Chunk::SIZE ) / 2.0f;
 
-            const Vector3f chunk_min = vector_cast<Scalar>( chunk.get_position() );
+            const Vector3f chunk_min = vector_cast<Scalar>( mesh.position_ );
             const Vector3f chunk_max = chunk_min + vector_cast<Scalar>( Chunk::SIZE );
             const AABoxf aabb( chunk_min, chunk_max );
 
-            ChunkRendererSP renderer( new ChunkRenderer( centroid, aabb ) );
-            renderer->rebuild( chunk );
-            chunk_renderers_.insert( std::make_pair( chunk.get_position(), renderer ) );
+            ChunkRendererSP renderer( new ChunkRenderer( opaque_arena_, centroid, aabb ) );
+            renderer->update( mesh );
+            chunk_renderers_.insert( std::make_pair( mesh.position_, renderer ) );
+            chunk_hierarchy_.insert( mesh.position_, renderer.get() );
         }
     }
-    else if ( chunk.get_external_faces().empty() )
+    else if ( mesh.empty() )
     {
+        chunk_hierarchy_.erase( mesh.position_ );
         chunk_renderers_.erase( chunk_renderer_it );
     }
-    else chunk_renderer_it->second->rebuild( chunk );
+    else chunk_renderer_it->second->update( mesh );
+}
+
+void Renderer::take_restore_requests( Vector3iV& positions )
+{
+    positions.swap( restore_requests_ );
+    restore_requests_.clear();
+}
+
+bool Renderer::was_chunk_visible( const Vector3i& position ) const
+{
+    ChunkRendererMap::const_iterator chunk_renderer_it = chunk_renderers_.find( position );
+
+    return
+        chunk_renderer_it != chunk_renderers_.end() &&
+        chunk_renderer_it->second->get_last_visible_frame() == frame_number_;
 }
 
 #ifdef DEBUG_COLLISIONS
@@ -672,6 +1720,8 @@ void Renderer::render( const SDL_GL_Window& window, const Camera& camera, const
     glPopMatrix();
 
     render_crosshairs( window );
+
+    enforce_gpu_memory_budget();
 }
 
 void Renderer::render_sky( const Sky& sky )
@@ -681,106 +1731,119 @@ void Renderer::render_sky( const Sky& sky )
 
 void Renderer::render_chunks( const Camera& camera, const Sky& sky )
 {
-    // TODO: Decompose this function.
-
-    gmtl::Frustumf view_frustum(
-        get_opengl_matrix( GL_MODELVIEW_MATRIX ),
-        get_opengl_matrix( GL_PROJECTION_MATRIX )
-    );
+#ifdef DEBUG_GL_CALLS
+    const unsigned long
+        first_gl_call = GLCallCounter::num_calls_,
+        first_gl_draw_call = GLCallCounter::num_draw_calls_;
+#endif
 
-    typedef std::pair<Scalar, ChunkRenderer*> DistanceChunkPair;
-    typedef std::vector<DistanceChunkPair> DistanceChunkPairV;
+    build_render_list( camera );
 
-    DistanceChunkPairV
-        opaque_chunks,
-        translucent_chunks;
+    ChunkRenderBackend backend( material_manager_, opaque_arena_, quad_indices_, camera, sky );
+    render_list_.submit( backend );
 
-#ifdef DEBUG_CHUNKS
-    DistanceChunkPairV debug_chunks;
+#ifdef DEBUG_GL_CALLS
+    num_gl_calls_ = GLCallCounter::num_calls_ - first_gl_call;
+    num_gl_draw_calls_ = GLCallCounter::num_draw_calls_ - first_gl_draw_call;
 #endif
+}
 
-    num_chunks_drawn_ = 0;
-    num_triangles_drawn_ = 0;
-
-    BOOST_FOREACH( const ChunkRendererMap::value_type& chunk_renderer_it, chunk_renderers_ )
-    {
-        ChunkRenderer& chunk_renderer = *chunk_renderer_it.second.get();
+void Renderer::build_render_list( const Camera& camera )
+{
+    const gmtl::Matrix44f
+        modelview = get_opengl_matrix( GL_MODELVIEW_MATRIX ),
+        projection = get_opengl_matrix( GL_PROJECTION_MATRIX );
 
-        // TODO: Arrange the chunks into some kind of hierarchy and cull based on that.
-        if ( gmtl::isInVolume( view_frustum, chunk_renderer.get_aabb() ) )
-        {
-            const Vector3f camera_to_centroid = camera.get_position() - chunk_renderer.get_centroid();
-            const Scalar distance_squared = gmtl::lengthSquared( camera_to_centroid );
-            const DistanceChunkPair distance_chunk = std::make_pair( distance_squared, &chunk_renderer );
+    gmtl::Frustumf view_frustum( modelview, projection );
 
-            opaque_chunks.push_back( distance_chunk );
+    gmtl::Matrix44f view_projection;
+    gmtl::mult( view_projection, projection, modelview );
 
-            if ( chunk_renderer.has_translucent_materials() )
-            {
-                translucent_chunks.push_back( distance_chunk );
-            }
+    const Scalar far_distance_squared = far_distance_ * far_distance_;
 
-#ifdef DEBUG_CHUNKS
-            debug_chunks.push_back( distance_chunk );
-#endif
-            ++num_chunks_drawn_;
-            num_triangles_drawn_ += chunk_renderer.get_num_triangles();
-        }
-    }
+    render_list_.clear();
 
-    material_manager_.configure_materials( camera, sky );
+    num_chunks_drawn_ = 0;
+    num_chunks_near_ = 0;
+    num_chunks_far_ = 0;
+    num_chunks_hidden_ = 0;
+    num_chunks_occluded_ = 0;
+    num_triangles_drawn_ = 0;
+    ++frame_number_;
 
-    glEnable( GL_CULL_FACE );
-    glEnable( GL_DEPTH_TEST );
-    glDepthFunc( GL_LEQUAL );
+    ChunkRendererV visible_chunks;
+    chunk_hierarchy_.cull( view_frustum, visible_chunks );
 
-    // The opaque materials are rendered first, in front-to-back order.  This results in
-    // many of the farthest chunks being fully occluded, and thus their fragments will be
-    // rejected without running any expensive fragment shaders.
+    find_reachable_chunks( camera, view_frustum );
 
-    std::sort( opaque_chunks.begin(), opaque_chunks.end() );
+    occlusion_buffer_.clear( view_projection );
+    draw_occluders( camera );
 
-    BOOST_FOREACH( const DistanceChunkPair& it, opaque_chunks )
+    BOOST_FOREACH( ChunkRenderer* chunk_renderer, visible_chunks )
     {
-        it.second->render_opaque();
-    }
+        const Vector3i chunk_position = vector_cast<int>( chunk_renderer->get_aabb().getMin() );
 
-    glDisable( GL_CULL_FACE );
-    glDepthMask( GL_FALSE );
+        // Chunks that are inside the frustum may still be hidden behind terrain.
+        if ( reachable_chunks_.find( chunk_position ) == reachable_chunks_.end() )
+        {
+            ++num_chunks_hidden_;
+            continue;
+        }
 
-    // Now draw the translucent parts of the Chunks from back to front.
+        if ( !occlusion_buffer_.is_visible( chunk_renderer->get_aabb() ) )
+        {
+            ++num_chunks_occluded_;
+            continue;
+        }
 
-    std::sort( translucent_chunks.begin(), translucent_chunks.end() );
+        chunk_renderer->note_visible( frame_number_ );
 
-    BOOST_REVERSE_FOREACH( const DistanceChunkPair& it, translucent_chunks )
-    {
-        it.second->render_translucent( camera );
-    }
+        // An evicted Chunk has nothing to draw until its mesh is restored.
+        if ( chunk_renderer->is_evicted() )
+        {
+            if ( !chunk_renderer->is_restore_requested() )
+            {
+                restore_requests_.push_back( chunk_position );
+                chunk_renderer->note_restore_requested();
+            }
 
-    material_manager_.deconfigure_materials();
+            continue;
+        }
 
-#ifdef DEBUG_CHUNKS
-    glEnable( GL_BLEND );
-    glEnable( GL_CULL_FACE );
-    glEnable( GL_POLYGON_OFFSET_FILL );
-    glPolygonOffset( 1.0f, 3.0f );
-    glColor4f( 1.0f, 0.0f, 0.0f, 0.3f );
+        const Vector3f camera_to_centroid = camera.get_position() - chunk_renderer->get_centroid();
+        const Scalar distance_squared = gmtl::lengthSquared( camera_to_centroid );
+        const int lod = get_lod( distance_squared );
 
-    std::sort( debug_chunks.begin(), debug_chunks.end() );
+        // The Chunks near enough for the bump and specular mapping to matter are drawn with
+        // the near program, and the rest with the cheaper far program.
+        RendererMaterialManager::MaterialProgram program;
 
-    BOOST_REVERSE_FOREACH( const DistanceChunkPair& it, debug_chunks )
-    {
-        it.second->render_aabb();
-    }
+        if ( distance_squared < far_distance_squared )
+        {
+            program = RendererMaterialManager::MATERIAL_PROGRAM_NEAR;
+            ++num_chunks_near_;
+        }
+        else
+        {
+            program = RendererMaterialManager::MATERIAL_PROGRAM_FAR;
+            ++num_chunks_far_;
+        }
 
-    glColor4f( 1.0f, 1.0f, 1.0f, 1.0f );
-    glDisable( GL_POLYGON_OFFSET_FILL );
-    glDisable( GL_CULL_FACE );
-    glDisable( GL_BLEND );
-#endif
+        render_list_.add( RENDER_PASS_OPAQUE, program, distance_squared, chunk_renderer, lod );
 
-    glDepthMask( GL_TRUE );
-    glDisable( GL_DEPTH_TEST );
+        if ( chunk_renderer->has_translucent_materials() )
+        {
+            // The translucent faces are sorted in the background while the opaque faces are drawn.
+            chunk_renderer->schedule_translucent_sort( sort_pool_, camera.get_position() );
+            render_list_.add( RENDER_PASS_TRANSLUCENT, program, distance_squared, chunk_renderer );
+        }
+
+#ifdef DEBUG_CHUNKS
+        render_list_.add( RENDER_PASS_CHUNK_BOUNDS, program, distance_squared, chunk_renderer );
+#endif
+        ++num_chunks_drawn_;
+        num_triangles_drawn_ += chunk_renderer->get_num_triangles( lod );
+    }
 }
 
 #ifdef DEBUG_COLLISIONS
@@ -874,6 +1937,195 @@ void Renderer::render_crosshairs( const SDL_GL_Window& window )
     glDisable( GL_COLOR_LOGIC_OP );
 }
 
+void Renderer::find_reachable_chunks( const Camera& camera, const gmtl::Frustumf& view_frustum )
+{
+    // This is a breadth-first flood outward from the Chunk that holds the camera.  It only
+    // passes through a Chunk from the face it entered by to faces connected to that one,
+    // and never turns back toward the camera, so that the Chunks it reaches are those that
+    // could be seen through the translucent Blocks in between.  Chunks that are not loaded
+    // are treated as open, so the flood is bounded by the frustum and the draw distance.
+    const Vector3f& camera_position = camera.get_position();
+    const Scalar max_distance_squared = camera.get_draw_distance() * camera.get_draw_distance();
+    const VisibilityFloodStep start =
+    {
+        pointwise_product( get_cell_index( vector_cast<int>( pointwise_floor( camera_position ) ), Chunk::SIZE_X ), Chunk::SIZE ),
+        NUM_CARDINAL_RELATIONS,
+        0
+    };
+
+    std::queue<VisibilityFloodStep> flood_queue;
+    flood_queue.push( start );
+
+    reachable_chunks_.clear();
+    reachable_chunks_.insert( start.position_ );
+
+    while ( !flood_queue.empty() )
+    {
+        const VisibilityFloodStep step = flood_queue.front();
+        flood_queue.pop();
+
+        ChunkOcclusionMap::const_iterator occlusion_it = chunk_occlusion_.find( step.position_ );
+
+        FOREACH_CARDINAL_RELATION( relation )
+        {
+            if ( step.directions_ & ( 1 << cardinal_relation_reverse( relation ) ) )
+            {
+                continue;
+            }
+
+            if ( step.entry_face_ != NUM_CARDINAL_RELATIONS &&
+                 occlusion_it != chunk_occlusion_.end() &&
+                 !occlusion_it->second.face_connectivity_.are_connected( step.entry_face_, relation ) )
+            {
+                continue;
+            }
+
+            const VisibilityFloodStep next =
+            {
+                step.position_ + pointwise_product( cardinal_relation_vector( relation ), Chunk::SIZE ),
+                cardinal_relation_reverse( relation ),
+                uint8_t( step.directions_ | ( 1 << relation ) )
+            };
+
+            if ( reachable_chunks_.find( next.position_ ) != reachable_chunks_.end() )
+            {
+                continue;
+            }
+
+            const Vector3f chunk_min = vector_cast<Scalar>( next.position_ );
+            const AABoxf aabb( chunk_min, chunk_min + vector_cast<Scalar>( Chunk::SIZE ) );
+
+            // The distance is measured to the closest point of the Chunk to the camera.
+            Vector3f closest_point;
+
+            for ( int i = 0; i < Vector3f::Size; ++i )
+            {
+                closest_point[i] = std::max( aabb.getMin()[i], std::min( camera_position[i], aabb.getMax()[i] ) );
+            }
+
+            if ( gmtl::lengthSquared( Vector3f( closest_point - camera_position ) ) > max_distance_squared ||
+                 classify_aabb( view_frustum, aabb ) == FRUSTUM_OUTSIDE )
+            {
+                continue;
+            }
+
+            reachable_chunks_.insert( next.position_ );
+            flood_queue.push( next );
+        }
+    }
+}
+
+void Renderer::draw_occluders( const Camera& camera )
+{
+    typedef std::pair<Scalar, unsigned> DistanceOccluderPair;
+    typedef std::vector<DistanceOccluderPair> DistanceOccluderPairV;
+
+    std::vector<AABoxf> occluders;
+    DistanceOccluderPairV nearest_occluders;
+
+    const Scalar max_distance_squared = OcclusionBuffer::MAX_OCCLUDER_DISTANCE * OcclusionBuffer::MAX_OCCLUDER_DISTANCE;
+
+    // Only the Chunks that the camera could see into can be in front of anything visible.
+    BOOST_FOREACH( const Vector3i& position, reachable_chunks_ )
+    {
+        const ChunkOcclusionMap::const_iterator occlusion_it = chunk_occlusion_.find( position );
+
+        if ( occlusion_it == chunk_occlusion_.end() || occlusion_it->second.occluder_height_ == 0 )
+        {
+            continue;
+        }
+
+        const Vector3f occluder_min = vector_cast<Scalar>( position );
+        const Vector3f occluder_size( Chunk::SIZE_X, occlusion_it->second.occluder_height_, Chunk::SIZE_Z );
+        const Vector3f camera_to_centroid = camera.get_position() - ( occluder_min + occluder_size / 2.0f );
+        const Scalar distance_squared = gmtl::lengthSquared( camera_to_centroid );
+
+        if ( distance_squared <= max_distance_squared )
+        {
+            nearest_occluders.push_back( std::make_pair( distance_squared, occluders.size() ) );
+            occluders.push_back( AABoxf( occluder_min, occluder_min + occluder_size ) );
+        }
+    }
+
+    std::sort( nearest_occluders.begin(), nearest_occluders.end() );
+
+    if ( nearest_occluders.size() > OcclusionBuffer::MAX_OCCLUDERS )
+    {
+        nearest_occluders.resize( OcclusionBuffer::MAX_OCCLUDERS );
+    }
+
+    BOOST_FOREACH( const DistanceOccluderPair& it, nearest_occluders )
+    {
+        occlusion_buffer_.add_occluder( occluders[it.second] );
+    }
+}
+
+void Renderer::enforce_gpu_memory_budget()
+{
+    typedef std::pair<unsigned, ChunkRenderer*> FrameChunkPair;
+    typedef std::vector<FrameChunkPair> FrameChunkPairV;
+
+    FrameChunkPairV eviction_candidates;
+
+    size_t chunk_memory_used = 0;
+
+    BOOST_FOREACH( const ChunkRendererMap::value_type& chunk_renderer_it, chunk_renderers_ )
+    {
+        ChunkRenderer& chunk_renderer = *chunk_renderer_it.second.get();
+        chunk_memory_used += chunk_renderer.get_gpu_memory_used();
+
+        // The Chunks that were visible in this frame are never evicted, since they would
+        // only have to be restored again right away.
+        if ( !chunk_renderer.is_evicted() && chunk_renderer.get_last_visible_frame() != frame_number_ )
+        {
+            eviction_candidates.push_back( std::make_pair( chunk_renderer.get_last_visible_frame(), &chunk_renderer ) );
+        }
+    }
+
+    // The free space in the vertex arena takes up GPU memory just the same.
+    gpu_memory_used_ = chunk_memory_used + opaque_arena_.get_free_gpu_memory();
+
+    if ( gpu_memory_used_ <= gpu_memory_budget_ )
+    {
+        return;
+    }
+
+    // The least recently visible Chunks are evicted first.  Evicting a Chunk only frees its
+    // space in the vertex arena, which is not given back until the arena is shrunk, so they
+    // are evicted until what they use would fit in the budget, and then the arena is shrunk.
+    // The arena may not shrink all the way if the remaining allocations are spread out.
+    std::sort( eviction_candidates.begin(), eviction_candidates.end() );
+
+    BOOST_FOREACH( const FrameChunkPair& it, eviction_candidates )
+    {
+        if ( chunk_memory_used <= gpu_memory_budget_ )
+        {
+            break;
+        }
+
+        chunk_memory_used -= it.second->get_gpu_memory_used();
+        it.second->evict();
+    }
+
+    opaque_arena_.shrink();
+
+    gpu_memory_used_ = chunk_memory_used + opaque_arena_.get_free_gpu_memory();
+}
+
+int Renderer::get_lod( const Scalar distance_squared ) const
+{
+    int lod = 0;
+    Scalar lod_distance = lod_distance_;
+
+    while ( lod < Chunk::NUM_LODS && distance_squared >= lod_distance * lod_distance )
+    {
+        ++lod;
+        lod_distance *= 2.0f;
+    }
+
+    return lod;
+}
+
 gmtl::Matrix44f Renderer::get_opengl_matrix( const GLenum matrix )
 {
     GLfloat m_data[16];
@@ -23,11 +23,19 @@
 
 #include <set>
 
+#include <boost/static_assert.hpp>
+#include <boost/threadpool.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include "arena_allocator.h"
+#include "chunk_hierarchy.h"
+#include "occlusion_buffer.h"
 #include "camera.h"
 #include "sdl_gl_window.h"
 #include "world.h"
 #include "player.h"
 #include "renderer_material.h"
+#include "render_list.h"
 
 struct VertexBuffer : public boost::noncopyable
 {
@@ -38,7 +46,7 @@ struct VertexBuffer : public boost::noncopyable
 
     void bind();
     void unbind();
-    void draw_elements();
+    void draw_elements( const GLenum index_type = GL_UNSIGNED_INT );
 
 protected:
 
@@ -81,72 +89,207 @@ protected:
     GLsizei num_elements_;
 };
 
-struct BlockVertex
+// All of the Chunk faces are quads whose vertices are listed in the same order, so
+// one index buffer serves every opaque ChunkVertexBuffer.  It grows as necessary to
+// fit the largest Chunk, and uses 16-bit indices for as long as it can.
+struct QuadIndexBuffer : public boost::noncopyable
 {
-    BlockVertex()
-    {
-    }
-
-    BlockVertex(
-        const Vector3f& position,
-        const Vector3f& normal,
-        const Vector3f& tangent,
-        const Vector3f& texcoords,
-        const Vector3f& lighting,
-        const Vector3f& sunlighting
-    ) :
-        x_( position[0] ), y_( position[1] ), z_( position[2] ),
-        nx_( normal[0] ), ny_( normal[1] ), nz_( normal[2] ),
-        tx_( tangent[0] ), ty_( tangent[1] ), tz_( tangent[2] ),
-        s_( texcoords[0] ), t_( texcoords[1] ), p_( texcoords[2] ),
-        lr_( lighting[0] ), lg_( lighting[1] ), lb_( lighting[2] ),
-        slr_( sunlighting[0] ), slg_( sunlighting[1] ), slb_( sunlighting[2] )
-    {
-    }
+    static const GLsizei
+        VERTICES_PER_QUAD = 4,
+        INDICES_PER_QUAD  = 6,
+        MIN_QUADS         = 1024,
+        MAX_SHORT_QUADS   = 0x10000 / VERTICES_PER_QUAD;
+
+    QuadIndexBuffer();
+    ~QuadIndexBuffer();
+
+    void reserve( const GLsizei num_quads );
+    void bind();
+
+    GLenum get_index_type() const { return index_type_; }
+
+protected:
+
+    template <typename IndexT>
+    void upload( const GLsizei num_quads );
+
+    GLuint ibo_id_;
+
+    GLsizei num_quads_;
+
+    GLenum index_type_;
+};
+
+// The block vertex attribute offsets depend on this layout.
+BOOST_STATIC_ASSERT( sizeof( BlockVertex ) == 16 );
+
+// A QuadRange is a run of consecutive quads in a vertex buffer, given as the index of
+// its first quad and the number of quads in it.
+typedef std::pair<GLsizei, GLsizei> QuadRange;
+typedef std::vector<QuadRange> QuadRangeV;
+
+// A VertexArena holds the opaque vertices of all of the Chunks in one large vertex buffer,
+// which an ArenaAllocator divides up between them in whole quads.  This way, a single vertex
+// array object holds the buffers and vertex attributes for drawing every Chunk.  When the
+// arena runs out of room, it is grown by copying it into a new buffer twice as large, and
+// it can be shrunk the same way once the space at its end has been freed.
+struct VertexArena : public boost::noncopyable
+{
+    static const GLsizei MIN_QUADS = 0x10000;
+
+    static const size_t QUAD_SIZE = QuadIndexBuffer::VERTICES_PER_QUAD * sizeof( BlockVertex );
+
+    // A Range is a QuadRange within the allocation that starts at the given quad.
+    typedef std::pair<GLsizei, QuadRange> Range;
+    typedef std::vector<Range> RangeV;
 
-    GLfloat x_, y_, z_;       // Position
-    GLfloat nx_, ny_, nz_;    // Normal
-    GLfloat tx_, ty_, tz_;    // Tangent
-    GLfloat s_, t_, p_;       // Texture coordinates
-    GLfloat lr_, lg_, lb_;    // Light color
-    GLfloat slr_, slg_, slb_; // Sunlight color
+    VertexArena();
+    ~VertexArena();
 
-} __attribute__( ( packed ) );
+    // Returns the index of the first quad of the new allocation that holds the vertices.
+    GLsizei allocate( const BlockVertexV& vertices );
+    void free( const GLsizei first_quad );
 
-typedef std::vector<BlockVertex> BlockVertexV;
+    // Overwrites the vertices of an existing allocation, which must have the same size.
+    void update( const GLsizei first_quad, const BlockVertexV& vertices );
 
+    // This binds the arena's vertex array object, which draws with the given QuadIndexBuffer.
+    // It must hold enough quads for the largest of the allocations.
+    void bind( QuadIndexBuffer& quad_indices );
+    void unbind();
+
+    // Draws all of the ranges with a single call.  The arena must be bound.
+    void render( const GLenum index_type, const RangeV& ranges ) const;
+
+    // Halves the arena for as long as all of its allocations still fit, but never makes
+    // it smaller than MIN_QUADS.
+    void shrink();
+
+    // This is the space in the arena that is not allocated to any Chunk.
+    size_t get_free_gpu_memory() const { return ( allocator_.get_size() - allocator_.get_num_allocated() ) * QUAD_SIZE; }
+
+protected:
+
+    // Copies the arena into a new buffer of the given size, which all of the allocations
+    // must fit in.
+    void resize( const GLsizei num_quads );
+
+    GLuint
+        vbo_id_,
+        vao_id_;
+
+    // This is the vertex buffer that the vertex array object was last set up with.
+    GLuint layout_vbo_id_;
+
+    ArenaAllocator allocator_;
+};
+
+// Adds the ranges of opaque faces that point towards 'camera_position' from at least some
+// part of 'aabb', out of an allocation starting at 'first_quad' whose faces are grouped by
+// the direction they point in, starting at the given offsets.  Adjacent ranges are joined,
+// so that they can be drawn at once, but the ranges already in the list are left alone.
+void get_visible_opaque_ranges(
+    const unsigned face_offsets[NUM_CARDINAL_RELATIONS + 1],
+    const GLsizei first_quad,
+    const AABoxf& aabb,
+    const Vector3f& camera_position,
+    VertexArena::RangeV& ranges
+);
+
+// A ChunkVertexBuffer keeps its vertex attributes and its index buffer in a vertex array
+// object of its own, so drawing it only takes binding that object.  Whoever binds it must
+// bind vertex array object 0 again when they are done drawing.
 struct ChunkVertexBuffer : public VertexBuffer
 {
-    ChunkVertexBuffer(
-        const BlockVertexV& vertices,
-        const GLenum vertex_usage = GL_STATIC_DRAW,
-        const GLenum index_usage = GL_STATIC_DRAW
-    );
+    ChunkVertexBuffer( const BlockVertexV& vertices, const GLenum vertex_usage = GL_STATIC_DRAW );
+    ~ChunkVertexBuffer();
 
-    void render();
-    void render_no_bind();
+    void bind_vertex_array();
+
+    // The vertex array object must already be bound.
+    void render_no_bind( const GLenum index_type, const QuadRangeV& ranges );
+
+#ifndef LIGHT_VOLUMES
+    // Overwrites the lighting of the existing vertices with that of the given vertices,
+    // which must otherwise be identical to the ones the buffer was created with.
+    void update_lighting( const BlockVertexV& vertices );
+#endif
+
+protected:
+
+    GLuint vao_id_;
+
+    GLsizei num_vertices_;
 };
 
-typedef boost::shared_ptr<ChunkVertexBuffer> ChunkVertexBufferSP;
 typedef std::vector<Vector3f> Vector3fV;
+typedef std::vector<Vector3i> Vector3iV;
+typedef std::set<Vector3i, VectorLess<Vector3i> > Vector3iSet;
 
 struct SortableChunkVertexBuffer : public ChunkVertexBuffer
 {
-    SortableChunkVertexBuffer( const BlockVertexV& vertices );
+    SortableChunkVertexBuffer( const BlockVertexV& vertices, const Vector3i& origin );
+    ~SortableChunkVertexBuffer();
 
+    // The faces are only sorted again when the camera has moved into a different Block
+    // since the last sort was requested, as their order hardly ever changes within one.
+    // The sort runs on 'sort_pool', and until it finishes the faces are drawn in their
+    // last order, so the caller never waits for it.
+    void schedule_sort( boost::threadpool::pool& sort_pool, const Vector3f& camera_position );
+
+    // This swaps in the indices from the last sort, if it has finished since the last call,
+    // and draws the faces.  Only a new buffer, which has no order yet, is sorted in place.
     void render( const Camera& camera );
 
+    // This includes both of the index buffers.
+    size_t get_gpu_memory_used() const;
+
 private:
 
     static const unsigned VERTICES_PER_FACE = 4;
 
-    typedef std::pair<Scalar, unsigned> DistanceIndex;
+    // The faces are sorted by their squared distances from the camera.  These are never
+    // negative, so their IEEE 754 bit patterns compare in the same order as their values,
+    // and can be radix sorted as plain unsigned integers.
+    typedef std::pair<uint32_t, unsigned> DistanceIndex;
     typedef std::vector<DistanceIndex> DistanceIndexV;
     typedef std::vector<VertexBuffer::Index> IndexV;
 
-    void render_sorted( const DistanceIndexV distance_indices );
+    // The Sort is shared with the worker thread that is sorting the faces, if there is
+    // one, so that the buffer can be destroyed without waiting for the sort to finish.
+    // The lock must be held while accessing the finished flag and the indices.
+    struct Sort : public boost::noncopyable
+    {
+        Sort( const Vector3fV& centroids );
+
+        const Vector3fV centroids_;
+
+        boost::mutex lock_;
+
+        bool finished_;
+
+        IndexV indices_;
+    };
+
+    typedef boost::shared_ptr<Sort> SortSP;
+
+    static void sort_faces( const Vector3fV& centroids, const Vector3f& camera_position, IndexV& indices );
+    static void run_sort( const SortSP& sort, const Vector3f& camera_position );
+
+    // The indices are double buffered: each new order is uploaded into the back buffer,
+    // which is then swapped with the front one, so the upload never has to wait for the
+    // GPU to finish drawing with the previous order.
+    void upload_indices( const IndexV& indices );
+
+    SortSP sort_;
 
-    Vector3fV centroids_;
+    bool
+        sorted_,
+        sort_pending_;
+
+    Vector3i sorted_camera_block_;
+
+    GLuint back_ibo_id_;
 };
 
 typedef boost::shared_ptr<SortableChunkVertexBuffer> SortableChunkVertexBufferSP;
@@ -159,38 +302,224 @@ struct AABoxVertexBuffer : public VertexBuffer
     void render();
 };
 
-struct ChunkRenderer
+typedef boost::shared_ptr<AABoxVertexBuffer> AABoxVertexBufferSP;
+
+// A ChunkMesh holds the vertices for a Chunk, ready to be uploaded.  Building one does
+// not touch GL, so it can be done on a worker thread, leaving only the upload for the
+// thread that owns the GL context.  The opaque vertices are kept per Chunk::Section, along
+// with the Section versions, so that only the Sections that changed need to be uploaded.
+// The coarser levels of detail each have a Section of their own.
+struct ChunkMesh
+{
+    struct Section
+    {
+        Section( const Chunk::Section& section );
+
+        unsigned
+            geometry_version_,
+            lighting_version_;
+
+        BlockVertexV opaque_vertices_;
+
+        unsigned opaque_face_offsets_[NUM_CARDINAL_RELATIONS + 1];
+    };
+
+    typedef std::vector<Section> SectionV;
+
+    ChunkMesh( const Chunk& chunk );
+
+    bool empty() const;
+
+    Vector3i position_;
+
+    unsigned num_triangles_;
+
+    SectionV
+        sections_,
+        lod_sections_;
+
+    BlockVertexV translucent_vertices_;
+
+    Chunk::FaceConnectivity face_connectivity_;
+
+    int occluder_height_;
+
+#ifdef LIGHT_VOLUMES
+    boost::shared_ptr<Chunk::LightVolume> light_volume_;
+#endif
+};
+
+typedef boost::shared_ptr<ChunkMesh> ChunkMeshSP;
+typedef std::vector<ChunkMeshSP> ChunkMeshV;
+
+#ifdef LIGHT_VOLUMES
+// A LightVolumeTexture holds a Chunk's LightVolume on the GPU, as a pair of 3D textures
+// that the block shader samples to light each vertex.  When it is bound, the texture
+// matrix for its unit is set up to map world coordinates into the volume.
+struct LightVolumeTexture : public boost::noncopyable
+{
+    LightVolumeTexture();
+    ~LightVolumeTexture();
+
+    void update( const Vector3i& origin, const Chunk::LightVolume& volume );
+    void bind() const;
+
+    size_t get_gpu_memory_used() const;
+
+protected:
+
+    void upload( const GLuint texture_id, const void* data );
+
+    GLuint
+        light_texture_id_,
+        sunlight_texture_id_;
+
+    Vector3i origin_;
+};
+
+typedef boost::shared_ptr<LightVolumeTexture> LightVolumeTextureSP;
+#endif
+
+struct ChunkRenderer : public boost::noncopyable
 {
-    ChunkRenderer( const Vector3f& centroid = Vector3f(), const AABoxf& aabb = AABoxf() );
+    ChunkRenderer( VertexArena& opaque_arena, const Vector3f& centroid, const AABoxf& aabb );
+    ~ChunkRenderer();
 
-    void render_opaque();
+    // The VertexArena must already be set up for drawing, as described in VertexArena::render().
+    // Level of detail 0 is the full resolution geometry; see Chunk::NUM_LODS.
+    void render_opaque( const GLenum index_type, const Vector3f& camera_position, const int lod );
     void render_translucent( const Camera& camera );
     void render_aabb();
-    void rebuild( const Chunk& chunk );
+    void schedule_translucent_sort( boost::threadpool::pool& sort_pool, const Vector3f& camera_position );
+
+    // Uploads the parts of the ChunkMesh that have changed since the last update.  Sections
+    // whose geometry is unchanged only have their lighting patched, if even that.  After the
+    // ChunkRenderer has been evicted, everything is uploaded again.
+    void update( const ChunkMesh& mesh );
+
+    // Releases all of the GPU memory used by the Chunk.  Only its bounds are kept, so that
+    // the Renderer can tell when it becomes visible again and must be restored by update().
+    void evict();
+
+    void note_visible( const unsigned frame ) { last_visible_frame_ = frame; }
+    void note_restore_requested() { restore_requested_ = true; }
 
     bool has_translucent_materials() const { return translucent_vbo_; }
+    bool is_evicted() const { return evicted_; }
+    bool is_restore_requested() const { return restore_requested_; }
     const Vector3f& get_centroid() const { return centroid_; }
     const AABoxf& get_aabb() const { return aabb_; }
-    unsigned get_num_triangles() const { return num_triangles_; }
+    const Vector3i& get_origin() const { return origin_; }
+    unsigned get_num_triangles( const int lod ) const;
+    unsigned get_last_visible_frame() const { return last_visible_frame_; }
+    size_t get_gpu_memory_used() const { return gpu_memory_used_; }
 
 protected:
 
-    void get_vertices_for_face( const BlockFace& face, BlockVertexV& vertices ) const;
+    // Each Section of the Chunk has its own allocation in the VertexArena, so that an edit
+    // only requires the Section it touched to be uploaded again.
+    struct Section
+    {
+        Section();
+
+        GLsizei get_num_opaque_quads() const { return opaque_face_offsets_[NUM_CARDINAL_RELATIONS]; }
+
+        // Frees the Section's allocation, if it has one, and forgets its versions, so that
+        // the next update uploads it again.
+        void release( VertexArena& opaque_arena );
+
+        // Adds the ranges of the Section's opaque faces that may be visible from 'camera_position'.
+        void get_visible_opaque_ranges( const Vector3f& camera_position, VertexArena::RangeV& ranges ) const
+        {
+            ::get_visible_opaque_ranges( opaque_face_offsets_, opaque_first_quad_, aabb_, camera_position, ranges );
+        }
 
-    ChunkVertexBufferSP opaque_vbo_;
+        GLsizei opaque_first_quad_;
+
+        AABoxf aabb_;
+
+        unsigned
+            geometry_version_,
+            lighting_version_;
+
+        unsigned opaque_face_offsets_[NUM_CARDINAL_RELATIONS + 1];
+    };
+
+    // Uploads the Section's vertices if its geometry version differs from the mesh's, or
+    // patches their lighting if only its lighting version does.
+    void update_section( Section& section, const ChunkMesh::Section& mesh_section );
+
+    void release_sections();
+
+    Section sections_[Chunk::NUM_SECTIONS];
+
+    // These cover the whole Chunk, one per coarser level of detail.
+    Section lod_sections_[Chunk::NUM_LODS];
+
+    VertexArena& opaque_arena_;
 
     SortableChunkVertexBufferSP translucent_vbo_;
 
-    AABoxVertexBuffer aabb_vbo_;
+    // This is only created if the bounding box is actually drawn.
+    AABoxVertexBufferSP aabb_vbo_;
+
+#ifdef LIGHT_VOLUMES
+    LightVolumeTextureSP light_volume_;
+#endif
 
     Vector3f centroid_;
 
     AABoxf aabb_;
 
-    unsigned num_triangles_;
+    Vector3i origin_;
+
+    unsigned
+        num_triangles_,
+        num_translucent_triangles_;
+
+    unsigned last_visible_frame_;
+
+    size_t gpu_memory_used_;
+
+    bool
+        evicted_,
+        restore_requested_;
 };
 
 typedef boost::shared_ptr<ChunkRenderer> ChunkRendererSP;
+typedef std::vector<ChunkRenderer*> ChunkRendererV;
+
+// The ChunkRenderBackend draws the ChunkRenderers in a RenderList with GL.  Each pass sets
+// up its own GL state when it begins, and restores it when it ends.
+struct ChunkRenderBackend : public RenderBackend
+{
+    ChunkRenderBackend(
+        RendererMaterialManager& material_manager,
+        VertexArena& opaque_arena,
+        QuadIndexBuffer& quad_indices,
+        const Camera& camera,
+        const Sky& sky
+    );
+
+    virtual void begin_pass( const RenderPass pass );
+    virtual void end_pass( const RenderPass pass );
+    virtual void select_program( const RendererMaterialManager::MaterialProgram program );
+    virtual void draw( const RenderItem& item );
+
+protected:
+
+    RendererMaterialManager& material_manager_;
+
+    VertexArena& opaque_arena_;
+
+    QuadIndexBuffer& quad_indices_;
+
+    const Camera& camera_;
+
+    const Sky& sky_;
+
+    RenderPass pass_;
+};
 
 struct SkydomeVertexBuffer : public VertexBuffer
 {
@@ -236,9 +565,35 @@ protected:
 
 struct Renderer
 {
+    static const size_t DEFAULT_GPU_MEMORY_BUDGET = 256 * 1024 * 1024;
+
+    static const Scalar
+        DEFAULT_LOD_DISTANCE = 64.0f,
+        DEFAULT_FAR_DISTANCE = 48.0f;
+
     Renderer();
 
-    void note_chunk_changes( const Chunk& chunk );
+    // A Chunk keeps being drawn with its old mesh until its new one is passed in here.
+    void note_chunk_changes( const ChunkMesh& mesh );
+
+    // Returns true if the Chunk at 'position' was inside of the frustum, and not hidden or
+    // occluded, in the last frame.
+    bool was_chunk_visible( const Vector3i& position ) const;
+
+    // When the Chunk meshes take up more GPU memory than the budget allows, the ones that
+    // have gone the longest without being visible are evicted.  Their meshes are restored
+    // when they are visible again; take_restore_requests() returns the positions of the
+    // Chunks whose meshes must be passed to note_chunk_changes() for that.
+    void set_gpu_memory_budget( const size_t budget ) { gpu_memory_budget_ = budget; }
+    void take_restore_requests( Vector3iV& positions );
+
+    // The Chunks closer than the LOD distance are drawn at full resolution.  Beyond it, each
+    // doubling of the distance drops them one more level of detail, down to the coarsest.
+    void set_lod_distance( const Scalar distance ) { lod_distance_ = distance; }
+
+    // The Chunks beyond the far distance are drawn with the far material program, which
+    // skips the bump and specular mapping; see RendererMaterialManager.
+    void set_far_distance( const Scalar distance ) { far_distance_ = distance; }
 
 #ifdef DEBUG_COLLISIONS
     void render( const SDL_GL_Window& window, const Camera& camera, const World& world, const Player& player );
@@ -247,28 +602,108 @@ struct Renderer
 #endif
 
     unsigned get_num_chunks_drawn() const { return num_chunks_drawn_; }
+
+    // These split the Chunks drawn between the near and far material programs.
+    unsigned get_num_chunks_near() const { return num_chunks_near_; }
+    unsigned get_num_chunks_far() const { return num_chunks_far_; }
+
+    // These are the Chunks inside of the frustum that were not drawn, because the terrain
+    // around them has no openings toward the camera (hidden), or because the nearby terrain
+    // covers them (occluded).
+    unsigned get_num_chunks_hidden() const { return num_chunks_hidden_; }
+    unsigned get_num_chunks_occluded() const { return num_chunks_occluded_; }
+
     unsigned get_num_triangles_drawn() const { return num_triangles_drawn_; }
 
+#ifdef DEBUG_GL_CALLS
+    // These count the GL calls made to draw the Chunks in the last frame; see GLCallCounter.
+    unsigned long get_num_gl_calls() const { return num_gl_calls_; }
+    unsigned long get_num_gl_draw_calls() const { return num_gl_draw_calls_; }
+#endif
+    size_t get_gpu_memory_used() const { return gpu_memory_used_; }
+
 protected:
 
     void render_sky( const Sky& sky );
     void render_chunks( const Camera& camera, const Sky& sky );
+    void build_render_list( const Camera& camera );
+    void find_reachable_chunks( const Camera& camera, const gmtl::Frustumf& view_frustum );
+    void draw_occluders( const Camera& camera );
 #ifdef DEBUG_COLLISIONS
     void render_collisions( const Player& player );
 #endif
     void render_crosshairs( const SDL_GL_Window& window );
+    void enforce_gpu_memory_budget();
+    int get_lod( const Scalar distance_squared ) const;
     gmtl::Matrix44f get_opengl_matrix( const GLenum matrix );
 
     RendererMaterialManager material_manager_;
 
+    QuadIndexBuffer quad_indices_;
+
+    // This must outlive the ChunkRenderers, which free their allocations in it.
+    VertexArena opaque_arena_;
+
     typedef std::map<Vector3i, ChunkRendererSP, VectorLess<Vector3i> > ChunkRendererMap;
     ChunkRendererMap chunk_renderers_;
 
+    // This holds the same ChunkRenderers as chunk_renderers_, for culling.
+    ChunkHierarchy<ChunkRenderer*> chunk_hierarchy_;
+
+    // The FaceConnectivity and occluder height of every Chunk are kept, including those of
+    // the Chunks with nothing to draw, since those can still hide the Chunks behind them.
+    struct ChunkOcclusion
+    {
+        Chunk::FaceConnectivity face_connectivity_;
+        int occluder_height_;
+    };
+
+    typedef std::map<Vector3i, ChunkOcclusion, VectorLess<Vector3i> > ChunkOcclusionMap;
+    ChunkOcclusionMap chunk_occlusion_;
+
+    // These are the positions of the Chunks that are not hidden by terrain in this frame.
+    Vector3iSet reachable_chunks_;
+
+    OcclusionBuffer occlusion_buffer_;
+
+    // This is rebuilt every frame, but kept to reuse its storage.
+    RenderList render_list_;
+
     SkyRenderer sky_renderer_;
 
     unsigned num_chunks_drawn_;
 
+    unsigned
+        num_chunks_near_,
+        num_chunks_far_;
+
+    unsigned
+        num_chunks_hidden_,
+        num_chunks_occluded_;
+
     unsigned num_triangles_drawn_;
+
+#ifdef DEBUG_GL_CALLS
+    unsigned long
+        num_gl_calls_,
+        num_gl_draw_calls_;
+#endif
+
+    unsigned frame_number_;
+
+    size_t
+        gpu_memory_budget_,
+        gpu_memory_used_;
+
+    Scalar
+        lod_distance_,
+        far_distance_;
+
+    Vector3iV restore_requests_;
+
+    // The translucent faces are sorted on these threads.  This is declared last so that it
+    // is destroyed (and thus joined) first.
+    boost::threadpool::pool sort_pool_;
 };
 
 #endif // RENDERER_H
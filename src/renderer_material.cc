@@ -22,6 +22,7 @@
 
 #include "log.h"
 #include "renderer_material.h"
+#include "gl_call_counter.h"
 
 //////////////////////////////////////////////////////////////////////////////////
 // Local definitions:
@@ -135,12 +136,32 @@ const std::string
     RendererMaterialManager::TEXTURE_DIRECTORY = "./media/materials/textures",
     RendererMaterialManager::SHADER_DIRECTORY  = "./media/materials/shaders";
 
+const GLuint
+    RendererMaterialManager::POSITION_ATTRIBUTE,
+    RendererMaterialManager::FACE_ATTRIBUTE,
+    RendererMaterialManager::TEXTURE_COORDINATES_ATTRIBUTE,
+    RendererMaterialManager::LIGHTING_ATTRIBUTE,
+    RendererMaterialManager::SUNLIGHTING_ATTRIBUTE;
+
+#ifdef LIGHT_VOLUMES
+const GLenum
+    RendererMaterialManager::LIGHT_VOLUME_TEXTURE_UNIT,
+    RendererMaterialManager::SUNLIGHT_VOLUME_TEXTURE_UNIT;
+#endif
+
 //////////////////////////////////////////////////////////////////////////////////
 // Function definitions for RendererMaterialManager:
 //////////////////////////////////////////////////////////////////////////////////
 
 RendererMaterialManager::RendererMaterialManager() :
-    material_shader_( new Shader( SHADER_DIRECTORY + "/block.vertex.glsl", SHADER_DIRECTORY + "/block.fragment.glsl" ) )
+#ifdef LIGHT_VOLUMES
+    material_shader_( new Shader( SHADER_DIRECTORY + "/block_light_volume.vertex.glsl", SHADER_DIRECTORY + "/block.fragment.glsl" ) ),
+    far_material_shader_( new Shader( SHADER_DIRECTORY + "/block_far_light_volume.vertex.glsl", SHADER_DIRECTORY + "/block_far.fragment.glsl" ) ),
+#else
+    material_shader_( new Shader( SHADER_DIRECTORY + "/block.vertex.glsl", SHADER_DIRECTORY + "/block.fragment.glsl" ) ),
+    far_material_shader_( new Shader( SHADER_DIRECTORY + "/block_far.vertex.glsl", SHADER_DIRECTORY + "/block_far.fragment.glsl" ) ),
+#endif
+    active_shader_( 0 )
 {
     GLint supported_layers;
     glGetIntegerv( GL_MAX_ARRAY_TEXTURE_LAYERS, &supported_layers );
@@ -162,6 +183,9 @@ RendererMaterialManager::RendererMaterialManager() :
     // just a couple of calls: a call to reorder the vertex indices, and a call to draw
     // them all.  This is MUCH FASTER.
 
+    bind_attribute_locations( *material_shader_ );
+    bind_attribute_locations( *far_material_shader_ );
+
     create_texture_array( ".png",          TEXTURE_SIZE,      TEXTURE_CHANNELS,      texture_array_id_ );
     create_texture_array( ".bump.png",     BUMP_MAP_SIZE,     BUMP_MAP_CHANNELS,     bump_map_array_id_ );
     create_texture_array( ".specular.png", SPECULAR_MAP_SIZE, SPECULAR_MAP_CHANNELS, specular_map_array_id_ );
@@ -189,28 +213,35 @@ void RendererMaterialManager::configure_materials( const Camera& camera, const S
     glActiveTexture( GL_TEXTURE2 );
     glBindTexture( GL_TEXTURE_2D_ARRAY, bump_map_array_id_ );
 
-    material_shader_->enable();
+    // The uniforms are set on each program while it is enabled, so the near program is
+    // set up last.
+    far_material_shader_->enable();
+    set_uniforms( *far_material_shader_, camera, sky );
 
-    const Vector3f
-        sun_direction = spherical_to_cartesian( Vector3f( 1.0f, sky.get_sun_angle()[0], sky.get_sun_angle()[1] ) ),
-        moon_direction = spherical_to_cartesian( Vector3f( 1.0f, sky.get_moon_angle()[0], sky.get_moon_angle()[1] ) );
+    material_shader_->enable();
+    set_uniforms( *material_shader_, camera, sky );
 
+    // Only the near program does the bump and specular mapping.
     material_shader_->set_uniform_vec3f( "camera_position", camera.get_position() );
-    material_shader_->set_uniform_float( "fog_distance", camera.get_draw_distance() );
-
-    material_shader_->set_uniform_vec3f( "sun_direction", sun_direction );
-    material_shader_->set_uniform_vec3f( "moon_direction", moon_direction );
-
-    material_shader_->set_uniform_vec3f( "sun_light_color", sky.get_sun_light_color() );
-    material_shader_->set_uniform_vec3f( "moon_light_color", sky.get_moon_light_color() );
-
-    material_shader_->set_uniform_int( "material_texture_array", 0 );
     material_shader_->set_uniform_int( "material_specular_map_array", 1 );
     material_shader_->set_uniform_int( "material_bump_map_array", 2 );
+
+    active_shader_ = material_shader_.get();
 }
 
 void RendererMaterialManager::deconfigure_materials()
 {
+#ifdef LIGHT_VOLUMES
+    glActiveTexture( SUNLIGHT_VOLUME_TEXTURE_UNIT );
+    glBindTexture( GL_TEXTURE_3D, 0 );
+
+    glActiveTexture( LIGHT_VOLUME_TEXTURE_UNIT );
+    glMatrixMode( GL_TEXTURE );
+    glLoadIdentity();
+    glMatrixMode( GL_MODELVIEW );
+    glBindTexture( GL_TEXTURE_3D, 0 );
+#endif
+
     glActiveTexture( GL_TEXTURE2 );
     glBindTexture( GL_TEXTURE_2D_ARRAY, 0 );
 
@@ -223,7 +254,62 @@ void RendererMaterialManager::deconfigure_materials()
     glDisable( GL_BLEND );
     glDisable( GL_TEXTURE_2D );
 
-    material_shader_->disable();
+    assert( active_shader_ );
+    active_shader_->disable();
+    active_shader_ = 0;
+}
+
+void RendererMaterialManager::select_program( const MaterialProgram program )
+{
+    assert( active_shader_ );
+
+    Shader* shader = program == MATERIAL_PROGRAM_FAR ? far_material_shader_.get() : material_shader_.get();
+
+    if ( shader != active_shader_ )
+    {
+        shader->enable();
+        active_shader_ = shader;
+    }
+}
+
+void RendererMaterialManager::set_chunk_origin( const Vector3i& origin )
+{
+    assert( active_shader_ );
+    active_shader_->set_uniform_vec3f( "chunk_origin", vector_cast<Scalar>( origin ) );
+}
+
+void RendererMaterialManager::bind_attribute_locations( Shader& shader )
+{
+    shader.bind_attribute_location( POSITION_ATTRIBUTE, "vertex_position" );
+    shader.bind_attribute_location( FACE_ATTRIBUTE, "vertex_face" );
+    shader.bind_attribute_location( TEXTURE_COORDINATES_ATTRIBUTE, "vertex_texture_coordinates" );
+#ifndef LIGHT_VOLUMES
+    shader.bind_attribute_location( LIGHTING_ATTRIBUTE, "vertex_lighting" );
+    shader.bind_attribute_location( SUNLIGHTING_ATTRIBUTE, "vertex_sunlighting" );
+#endif
+}
+
+void RendererMaterialManager::set_uniforms( const Shader& shader, const Camera& camera, const Sky& sky )
+{
+    const Vector3f
+        sun_direction = spherical_to_cartesian( Vector3f( 1.0f, sky.get_sun_angle()[0], sky.get_sun_angle()[1] ) ),
+        moon_direction = spherical_to_cartesian( Vector3f( 1.0f, sky.get_moon_angle()[0], sky.get_moon_angle()[1] ) );
+
+    shader.set_uniform_float( "fog_distance", camera.get_draw_distance() );
+
+    shader.set_uniform_vec3f( "sun_direction", sun_direction );
+    shader.set_uniform_vec3f( "moon_direction", moon_direction );
+
+    shader.set_uniform_vec3f( "sun_light_color", sky.get_sun_light_color() );
+    shader.set_uniform_vec3f( "moon_light_color", sky.get_moon_light_color() );
+
+    shader.set_uniform_int( "material_texture_array", 0 );
+
+#ifdef LIGHT_VOLUMES
+    // The light volume textures are bound per-Chunk by the ChunkRenderers.
+    shader.set_uniform_int( "light_volume", LIGHT_VOLUME_TEXTURE_UNIT - GL_TEXTURE0 );
+    shader.set_uniform_int( "sunlight_volume", SUNLIGHT_VOLUME_TEXTURE_UNIT - GL_TEXTURE0 );
+#endif
 }
 
 void RendererMaterialManager::read_texture_data(
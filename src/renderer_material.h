@@ -61,14 +61,48 @@ struct RendererMaterialManager : public boost::noncopyable
         BUMP_MAP_CHANNELS     = 3,
         SPECULAR_MAP_CHANNELS = 1;
 
+    // The vertex attribute indices used by the block shaders.
+    static const GLuint
+        POSITION_ATTRIBUTE            = 0,
+        FACE_ATTRIBUTE                = 1,
+        TEXTURE_COORDINATES_ATTRIBUTE = 2,
+        LIGHTING_ATTRIBUTE            = 3,
+        SUNLIGHTING_ATTRIBUTE         = 4;
+
+#ifdef LIGHT_VOLUMES
+    static const GLenum
+        LIGHT_VOLUME_TEXTURE_UNIT    = GL_TEXTURE3,
+        SUNLIGHT_VOLUME_TEXTURE_UNIT = GL_TEXTURE4;
+#endif
+
+    // The far program skips the bump and specular mapping, which make no visible difference
+    // to distant geometry, and is much cheaper to run.
+    enum MaterialProgram
+    {
+        MATERIAL_PROGRAM_NEAR,
+        MATERIAL_PROGRAM_FAR
+    };
+
     RendererMaterialManager();
     ~RendererMaterialManager();
 
+    // This enables the near program.
     void configure_materials( const Camera& camera, const Sky& sky );
     void deconfigure_materials();
 
+    // This may only be called between configure_materials() and deconfigure_materials().
+    void select_program( const MaterialProgram program );
+
+    // The Chunk vertices are relative to the origin of their Chunk, so this must be
+    // called before each Chunk is rendered, and again after switching programs.
+    void set_chunk_origin( const Vector3i& origin );
+
 protected:
 
+    static void bind_attribute_locations( Shader& shader );
+    // Sets the uniforms that both of the programs have.
+    static void set_uniforms( const Shader& shader, const Camera& camera, const Sky& sky );
+
     void read_texture_data(
         const std::string& filename,
         const int size,
@@ -88,7 +122,12 @@ protected:
         bump_map_array_id_,
         specular_map_array_id_;
 
-    ShaderSP material_shader_;
+    ShaderSP
+        material_shader_,
+        far_material_shader_;
+
+    // This is the program that is currently enabled, if any.
+    Shader* active_shader_;
 };
 
 #endif // RENDERER_MATERIAL_H
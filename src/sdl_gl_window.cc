@@ -132,6 +132,13 @@ void SDL_GL_Window::init_GL()
         throw std::runtime_error( "OpenGL 2.0 not supported" );
     }
 
+    // The opaque Chunk vertices are all kept in one buffer, which is drawn with base vertex
+    // offsets, and which is grown by copying it on the GPU.
+    if ( !glewIsSupported( "GL_ARB_draw_elements_base_vertex GL_ARB_copy_buffer" ) )
+    {
+        throw std::runtime_error( "GL_ARB_draw_elements_base_vertex and GL_ARB_copy_buffer not supported" );
+    }
+
     glShadeModel( GL_SMOOTH );
     glClearDepth( 1.0f );
     glEnable( GL_MULTISAMPLE );
@@ -21,6 +21,7 @@
 #include <stdexcept>
 
 #include "shader.h"
+#include "gl_call_counter.h"
 
 Shader::Shader( const std::string& vertex_shader_filename, const std::string& fragment_shader_program )
 {
@@ -131,6 +132,21 @@ void Shader::set_uniform_int( const std::string& name, const int value ) const
     glUniform1i( get_uniform_location( name ), value );
 }
 
+void Shader::bind_attribute_location( const GLuint index, const std::string& name )
+{
+    glBindAttribLocation( gl_shader_program_, index, name.c_str() );
+    glLinkProgram( gl_shader_program_ );
+
+    int status;
+
+    glGetProgramiv( gl_shader_program_, GL_LINK_STATUS, &status );
+
+    if ( status == GL_FALSE )
+    {
+        throw std::runtime_error( "Shader relinking failed after binding attribute: " + name );
+    }
+}
+
 int Shader::get_uniform_location( const std::string& name ) const
 {
     const int location = glGetUniformLocation( gl_shader_program_, name.c_str() );
@@ -39,6 +39,9 @@ struct Shader
     void set_uniform_float( const std::string& name, const float v ) const;
     void set_uniform_int( const std::string& name, const int v ) const;
 
+    // Binds the named vertex attribute to the given index, and relinks the program.
+    void bind_attribute_location( const GLuint index, const std::string& name );
+
 protected:
 
     GLuint
@@ -478,11 +478,27 @@ void World::update_chunks()
 
     apply_lighting_to_self( chunk_guard, possibly_modified_chunks );
     apply_lighting_to_neighbors( chunk_guard, neighbor_chunks );
+
+    // Most of the possibly modified Chunks end up with exactly the same faces and lighting
+    // as they had before, so only the ones whose mesh versions change are reported.  This
+    // saves the time it would take to send them to the graphics card again.
+    typedef std::map<Chunk*, unsigned> ChunkVersionMap;
+    ChunkVersionMap mesh_versions;
+
+    BOOST_FOREACH( Chunk* chunk, possibly_modified_chunks )
+    {
+        mesh_versions[chunk] = chunk->get_mesh_version();
+    }
+
     update_geometry( chunk_guard, possibly_modified_chunks );
 
-    // TODO: Only add Chunks that were DEFINITELY modified to updated_chunks_.  This will
-    //       save time because they won't need to be sent to the graphics card.
-    updated_chunks_ = possibly_modified_chunks;
+    BOOST_FOREACH( const ChunkVersionMap::value_type& mesh_version, mesh_versions )
+    {
+        if ( mesh_version.first->get_mesh_version() != mesh_version.second )
+        {
+            updated_chunks_.insert( mesh_version.first );
+        }
+    }
 }
 
 void World::reset_lighting_unordered( ChunkGuard& chunk_guard, const ChunkSet& chunks )